@@ -46,12 +46,21 @@ public:
     // Returns true if the format is enabled (safe to call multiple times with same parameter).
     bool enableFormat( const std::string& ext);
 
+    // Set whether to bake the transforms of the scene's node hierarchy into the vertices
+    // (false by default). If true, meshes are placed by the global transforms of the nodes
+    // referencing them (meshes referenced by several nodes are added once per node) before
+    // the importer's transform is applied. Otherwise node transforms are ignored.
+    void setBakeNodeTransforms( bool v) { _bakeNodes = v;}
+
 protected:
     virtual RFeatures::ObjModel::Ptr doLoad( const std::string& filename);
+    FlatMesh::Ptr doLoadFlat( const std::string& filename) override;
+    std::string optionsKey() const override;
 
 private:
     bool _loadTextures;
     bool _failOnNonTriangles;
+    bool _bakeNodes;
     std::unordered_map<std::string, std::string> _available;
 };  // end class
 
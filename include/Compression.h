@@ -0,0 +1,67 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+/**
+ * Transparent compression of model files identified by a compression suffix
+ * following the format extension (e.g. model.obj.gz or model.ply.zst).
+ * Gzip is always available. Zstandard is available if the library was
+ * built with zstd (WITH_ZSTD) in which case output is compressed using
+ * multiple threads.
+ */
+
+#ifndef RMODELIO_COMPRESSION_H
+#define RMODELIO_COMPRESSION_H
+
+#include "rModelIO_Export.h"
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace RModelIO {
+
+enum Compression
+{
+    NO_COMPRESSION,
+    GZIP,   // .gz
+    ZSTD    // .zst
+};  // end enum
+
+// Returns the compression given by the suffix of fname.
+rModelIO_EXPORT Compression compressionOf( const std::string& fname);
+
+// Returns fname without its compression suffix (if any).
+rModelIO_EXPORT std::string stripCompression( const std::string& fname);
+
+// Returns the suffix (with leading dot) used for the given compression.
+rModelIO_EXPORT std::string compressionSuffix( Compression);
+
+// Returns true if the given compression is supported by this build.
+rModelIO_EXPORT bool compressionAvailable( Compression);
+
+// Read and decompress the whole of fname into out. Returns false on error.
+rModelIO_EXPORT bool readCompressed( const std::string& fname, Compression, std::vector<char>& out);
+
+// Run writer on a stream that compresses into os. Returns false on error.
+rModelIO_EXPORT bool writeCompressed( std::ostream& os, Compression, const std::function<bool( std::ostream&)>& writer);
+
+// Compress existing file src into fname. Returns false on error.
+rModelIO_EXPORT bool compressFile( const std::string& src, const std::string& fname, Compression);
+
+}   // end namespace
+
+#endif
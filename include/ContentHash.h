@@ -0,0 +1,53 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+/**
+ * Fast (non-cryptographic) 64 bit content hashing of memory, images and files.
+ * Used to identify unchanged textures and models across imports and exports.
+ */
+
+#ifndef RMODELIO_CONTENT_HASH_H
+#define RMODELIO_CONTENT_HASH_H
+
+#include "rModelIO_Export.h"
+#include <ObjModel.h>   // RFeatures
+#include <cstdint>
+#include <string>
+
+namespace RModelIO {
+
+// Hash n bytes starting at data, continuing from the given seed.
+rModelIO_EXPORT uint64_t hashBytes( const void* data, size_t n, uint64_t seed=0);
+
+// Hash the dimensions, type and pixels of the given image.
+rModelIO_EXPORT uint64_t hashImage( const cv::Mat&, uint64_t seed=0);
+
+// Returns true iff the images have the same dimensions, type and pixels (confirms a hashImage match).
+rModelIO_EXPORT bool sameImage( const cv::Mat&, const cv::Mat&);
+
+// Hash the geometry, texture coordinates, face materials and textures of the given model.
+rModelIO_EXPORT uint64_t hashModel( const RFeatures::ObjModel&, uint64_t seed=0);
+
+// Hash the contents of the given file. Returns false if the file can't be read.
+rModelIO_EXPORT bool hashFile( const std::string& fname, uint64_t& hash);
+
+// Returns the hash as a 16 character hexadecimal string.
+rModelIO_EXPORT std::string hashString( uint64_t);
+
+}   // end namespace
+
+#endif
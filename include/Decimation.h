@@ -0,0 +1,41 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+/**
+ * Fast simplification of large meshes by vertex clustering. Vertices are
+ * snapped to the cells of a uniform grid over the mesh's bounds, with the
+ * grid resolution chosen so that the number of remaining faces is within
+ * a given budget. Texture coordinates are clustered separately for each
+ * material in the joint space of grid cell and texture coordinate so that
+ * texture seams (vertices having more than one texture coordinate) remain.
+ */
+
+#ifndef RMODELIO_DECIMATION_H
+#define RMODELIO_DECIMATION_H
+
+#include "FlatMesh.h"
+
+namespace RModelIO {
+
+// Returns a simplified copy of the mesh having at most maxFaces faces (or a copy
+// of the mesh itself if it already has no more than maxFaces faces). Returns null
+// if the budget can't be met without collapsing every face.
+rModelIO_EXPORT FlatMesh::Ptr decimate( const MeshView&, size_t maxFaces);
+
+}   // end namespace
+
+#endif
@@ -0,0 +1,94 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+/**
+ * Size bounded on-disk cache of files named by key. Entries are written to a
+ * temporary file and renamed into place so that any number of processes can
+ * share the cache directory. Least recently used entries (by modification
+ * time, which is updated on every hit) are removed once the total size of
+ * the cache exceeds its limit. Hit, miss, store, invalidation and eviction
+ * counts are kept for the lifetime of the object.
+ */
+
+#ifndef RMODELIO_FILE_CACHE_H
+#define RMODELIO_FILE_CACHE_H
+
+#include "FileSink.h"
+#include <atomic>
+#include <cstdint>
+
+namespace RModelIO {
+
+class rModelIO_EXPORT FileCache
+{
+public:
+    using Ptr = std::shared_ptr<FileCache>;
+
+    struct Stats
+    {
+        size_t hits;
+        size_t misses;
+        size_t stores;
+        size_t invalidations;   // Hits later found to be unusable
+        size_t evictions;
+    };  // end struct
+
+    // Create a cache in directory dir (created if it doesn't exist) for files having
+    // extension ext (including the leading dot) and of at most maxBytes total size.
+    // Returns null if the directory can't be created.
+    static Ptr create( const std::string& dir, const std::string& ext, uint64_t maxBytes);
+
+    // The absolute path to the cache directory.
+    const std::string& directory() const { return _dir;}
+
+    uint64_t maxBytes() const { return _maxBytes;}
+
+    // Returns the path of the cached file for the given key (marking it as recently used)
+    // or an empty string if not cached.
+    std::string lookup( const std::string& key);
+
+    // Call if the file returned from lookup turned out to be unusable. The entry is removed
+    // and counted as an invalidation (the lookup remains counted as a hit).
+    void invalidate( const std::string& key);
+
+    // Cache the file for key using the given writer (or task that writes the named file)
+    // returning true on success. The cache is trimmed to size afterwards.
+    bool insert( const std::string& key, const FileSink::Writer&);
+    bool insertFile( const std::string& key, const FileSink::Task&);
+
+    // Remove least recently used entries until the cache is within its size limit.
+    // Does nothing if another process is trimming the same cache; trims by threads
+    // of the same process are serialised.
+    void trim();
+
+    Stats stats() const;
+
+private:
+    const std::string _dir;
+    const std::string _ext;
+    const uint64_t _maxBytes;
+    std::atomic<size_t> _hits, _misses, _stores, _invalidations, _evictions;
+
+    FileCache( const std::string&, const std::string&, uint64_t);
+    std::string _path( const std::string&) const;
+    FileCache( const FileCache&) = delete;
+    void operator=( const FileCache&) = delete;
+};  // end class
+
+}   // end namespace
+
+#endif
@@ -0,0 +1,132 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+/**
+ * Asynchronous sink for the files written by the exporters. Each file is
+ * queued with a writer that is run on one of a small pool of worker threads
+ * so that geometry, material and texture files are written concurrently.
+ * The number of outstanding writes is bounded (add blocks while the queue
+ * is full) and wait blocks until all queued writes have completed.
+ */
+
+#ifndef RMODELIO_FILE_SINK_H
+#define RMODELIO_FILE_SINK_H
+
+#include "Compression.h"
+#include <condition_variable>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+
+namespace RModelIO {
+
+class rModelIO_EXPORT FileSink
+{
+public:
+    using Ptr = std::shared_ptr<FileSink>;
+
+    // Writes the contents of a file to the given stream returning true on success.
+    using Writer = std::function<bool( std::ostream&)>;
+
+    // Writes the named file itself (e.g. via a third party library) returning true on success.
+    using Task = std::function<bool( const std::string&)>;
+
+    // Use nthreads worker threads (0 for the hardware concurrency up to a maximum of 4)
+    // and allow at most maxPending queued writes before add blocks.
+    static Ptr create( size_t nthreads=0, size_t maxPending=16);
+
+    explicit FileSink( size_t nthreads=0, size_t maxPending=16);
+    virtual ~FileSink();    // Waits for all outstanding writes.
+
+    // Queue the writing of file fname using the given writer. The file is opened in binary mode.
+    void add( const std::string& fname, const Writer&);
+
+    // Queue a task that writes file fname itself.
+    void addTask( const std::string& fname, const Task&);
+
+    // Queue the copying of existing file src to fname. A hard link is made if allowHardLink
+    // is true. Otherwise (or if linking fails) a copy-on-write clone of the file is tried
+    // where the filesystem supports it before falling back to a full copy.
+    void addCopy( const std::string& src, const std::string& fname, bool allowHardLink=false);
+
+    // Files subsequently queued as fname are instead written compressed to fname
+    // with the compression suffix appended. Use NO_COMPRESSION to cancel.
+    void setCompression( const std::string& fname, Compression);
+
+    // Synchronously copy (or link) src to fname as described for addCopy.
+    static bool transferFile( const std::string& src, const std::string& fname, bool allowHardLink=false);
+
+    // Run the task on a uniquely named temporary file in the same directory as fname
+    // and rename it to fname on success. Readers of fname never see a partial file.
+    static bool writeAtomic( const std::string& fname, const Task&);
+
+    // Block until all queued writes are complete. Returns false if any failed
+    // since the last call to wait in which case err() describes the failures.
+    bool wait();
+
+    const std::string& err() const { return _err;}
+
+protected:
+    // Open fname for writing, write to it using the given writer, and close it.
+    // Derived types may override to redirect output but must call wait in their destructors.
+    virtual bool writeFile( const std::string& fname, const Writer&);
+
+    // Run the given task to write fname.
+    virtual bool runTask( const std::string& fname, const Task&);
+
+    // Copy or link existing file src to fname.
+    virtual bool copyFile( const std::string& src, const std::string& fname, bool allowHardLink);
+
+private:
+    struct Job
+    {
+        std::string fname;
+        Writer writer;
+        Task task;
+        std::string src;    // Source file if copying
+        bool link;
+    };  // end struct
+
+    const size_t _maxPending;
+    std::unordered_map<std::string, Compression> _compress;
+    std::vector<std::thread> _workers;
+    std::deque<Job> _jobs;
+    size_t _active;
+    bool _stop;
+    std::vector<std::string> _errs;
+    std::string _err;
+    std::mutex _mutex;
+    std::condition_variable _jobAdded;     // Signals workers that a job is available
+    std::condition_variable _jobTaken;     // Signals producers that the queue has space
+    std::condition_variable _jobsDone;     // Signals waiters that all jobs are complete
+
+    void _push( Job&&);
+    void _work();
+
+    FileSink( const FileSink&) = delete;
+    void operator=( const FileSink&) = delete;
+};  // end class
+
+}   // end namespace
+
+#endif
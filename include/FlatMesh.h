@@ -0,0 +1,69 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+/**
+ * A triangle mesh held in contiguous owning arrays as loaded by
+ * ObjModelImporter::loadFlat. Faces are sorted by material so that
+ * each material's faces form a single range. Use view() to pass the
+ * mesh to an exporter and toModel() to build an ObjModel from it.
+ */
+
+#ifndef RMODELIO_FLAT_MESH_H
+#define RMODELIO_FLAT_MESH_H
+
+#include "MeshView.h"
+
+namespace RModelIO {
+
+struct rModelIO_EXPORT FlatMesh
+{
+    using Ptr = std::shared_ptr<FlatMesh>;
+    static Ptr create() { return Ptr( new FlatMesh);}
+
+    // Create from a view copying its arrays and sorting its faces by material.
+    static Ptr create( const MeshView&);
+
+    std::vector<float> positions;           // 3 per vertex
+    std::vector<uint32_t> indices;          // 3 per face
+    std::vector<float> uvs;                 // 2 per texture coordinate (empty if no materials)
+    std::vector<uint32_t> uvIndices;        // 3 per face into uvs (if empty, uvs has one entry per vertex)
+    std::vector<uint32_t> materialOffsets;  // Faces of material i are [materialOffsets[i], materialOffsets[i+1])
+    std::vector<cv::Mat> textures;          // One per material
+
+    size_t numVtxs() const { return positions.size() / 3;}
+    size_t numFaces() const { return indices.size() / 3;}
+    size_t numMaterials() const { return textures.size();}
+
+    // Returns the first face and the number of faces of material i.
+    uint32_t materialBegin( size_t i) const { return materialOffsets[i];}
+    uint32_t materialSize( size_t i) const { return materialOffsets[i+1] - materialOffsets[i];}
+
+    // Returns a view of this mesh which is valid while the mesh is unchanged.
+    MeshView view() const;
+
+    // Build an ObjModel from this mesh.
+    RFeatures::ObjModel::Ptr toModel() const { return view().toModel();}
+
+private:
+    FlatMesh(){}
+    FlatMesh( const FlatMesh&) = delete;
+    void operator=( const FlatMesh&) = delete;
+};  // end struct
+
+}   // end namespace
+
+#endif
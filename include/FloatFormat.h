@@ -0,0 +1,63 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+/**
+ * How the text format exporters write floating point values. By default
+ * values are written by the output stream itself. Alternatively, values
+ * may be written in the shortest form that reads back as the same float,
+ * or with a fixed number of significant digits. Formatting uses
+ * std::to_chars where the standard library provides it for floats and
+ * falls back to streams in the classic locale otherwise, so the output
+ * never depends on the global locale.
+ */
+
+#ifndef RMODELIO_FLOAT_FORMAT_H
+#define RMODELIO_FLOAT_FORMAT_H
+
+#include "rModelIO_Export.h"
+#include <algorithm>
+
+namespace RModelIO {
+
+class rModelIO_EXPORT FloatFormat
+{
+public:
+    // Buffer size needed by format.
+    static const int BUF_SIZE = 32;
+
+    // digits < 0 uses the stream's formatting, 0 writes the shortest round trip
+    // form and otherwise the given number of significant digits (at most 9).
+    explicit FloatFormat( int digits=-1) : _digits( std::min( digits, 9)) {}
+
+    static FloatFormat stream() { return FloatFormat(-1);}
+    static FloatFormat roundTrip() { return FloatFormat(0);}
+    static FloatFormat significant( int digits) { return FloatFormat( std::max( digits, 1));}
+
+    int digits() const { return _digits;}
+    bool usesStream() const { return _digits < 0;}
+
+    // Write v into buf (at least BUF_SIZE chars) returning one past the last char written.
+    // Not valid if usesStream() is true.
+    char* format( char* buf, float v) const;
+
+private:
+    int _digits;
+};  // end class
+
+}   // end namespace
+
+#endif
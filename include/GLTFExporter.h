@@ -0,0 +1,52 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+/**
+ * Export model to glTF 2.0 as either binary .glb (a single file) or
+ * .gltf (JSON with an adjacent .bin buffer and texture images).
+ * Each material becomes a mesh primitive with tightly packed buffers
+ * of float positions, float texture coordinates and 32 bit indices.
+ * Faces without a material are written as a final untextured primitive.
+ */
+
+#ifndef RMODELIO_GLTF_EXPORTER_H
+#define RMODELIO_GLTF_EXPORTER_H
+
+#include "ObjModelExporter.h"
+
+namespace RModelIO {
+
+class rModelIO_EXPORT GLTFExporter : public ObjModelExporter
+{
+public:
+    // If embedTextures is true, texture images are embedded in .glb files,
+    // otherwise they are written adjacent to the model and referenced by URI.
+    // Textures are always referenced by URI for .gltf files.
+    explicit GLTFExporter( bool embedTextures=true);
+
+protected:
+    bool doSave( const RFeatures::ObjModel&, const std::string& filename) override;
+    bool doSaveView( const MeshView&, const std::string& filename) override;
+    bool needsWorkingDir( const std::string& filename) const override;
+
+private:
+    const bool _embedTextures;
+};  // end class
+
+}   // end namespace
+
+#endif
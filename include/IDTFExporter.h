@@ -23,6 +23,7 @@
 #define RMODELIO_IDTF_EXPORTER_H
 
 #include "ObjModelExporter.h"
+#include "Scene.h"
 
 namespace RModelIO {
 
@@ -32,21 +33,76 @@ public:
     // IDTF is used as an intermediate step to producing U3D files. In such cases, it is
     // not necessary to leave the produced files on the filesystem post conversion. If
     // desired, set delFiles to delete from the filesystem the produced IDTF file and
-    // any saved tga images (ObjModel material textures) upon any new call to save,
+    // any saved texture images (ObjModel material textures) upon any new call to save,
     // or upon destruction of this object. See RModelIO::U3DExporter.
-    // Setting media9 true will transform coordinates as (a,b,c) --> (a,-c,b).
+    // Setting media9 true sets the transform to Transform::media9() which maps
+    // coordinates as (a,b,c) --> (a,-c,b). See ObjModelExporter::setTransform.
     IDTFExporter( bool delFiles=false, bool media9=false);
     ~IDTFExporter() override;
 
+    // The exporter doesn't calculate normals and by default writes a separate zero normal
+    // for each corner of each face. Set compact normals to instead write a single zero
+    // normal referenced by every corner which roughly halves the size of the file.
+    void setCompactNormals( bool enable) { _compactNormals = enable;}
+    bool compactNormals() const { return _compactNormals;}
+
+    // Textures are normally written concurrently with the IDTF file. Set true to finish
+    // writing the textures before the IDTF file is started (e.g. if it's being read as it's
+    // written by a converter that expects the textures to exist once the IDTF is complete).
+    void setWriteTexturesFirst( bool enable) { _texturesFirst = enable;}
+
+    // A model placed in a scene by a transform applied before the exporter's transform.
+    using Instance = Scene::Instance;
+
+    // Save several models as a single scene. Instances of the same model, or of models
+    // with identical content (see Scene.h), share the model's resources (meshes, shaders and
+    // textures) which are written once and referenced by a node for each instance with
+    // the instance's transform as the node's transform. Instance transforms other than
+    // the identity require the exporter's transform to be invertible.
+    bool saveScene( const std::vector<Instance>&, const std::string& filename);
+
+    // Image formats for material textures that IDTFConverter can read.
+    enum TextureFormat
+    {
+        TGA,
+        PNG,
+        JPEG
+    };  // end enum
+
+    // Set the image format that material textures are saved in (uncompressed TGA by default).
+    // For PNG, quality is the compression level in [0,9] and for JPEG it is the quality in
+    // [0,100]. Set quality -1 to use OpenCV's default. PNG greatly reduces the size of the
+    // intermediate files. Textures are encoded in parallel with one another and with the IDTF.
+    void setTextureFormat( TextureFormat fmt, int quality=-1);
+    TextureFormat textureFormat() const { return _txfmt;}
+    int textureQuality() const { return _txqual;}
+
+    // Set the maximum width and height of saved textures (0 for no limit, the default).
+    // Larger textures are downscaled (preserving aspect ratio) before being saved.
+    void setMaxTextureSize( int maxDim) { _maxTxDim = maxDim;}
+    int maxTextureSize() const { return _maxTxDim;}
+
+    // Set the maximum number of faces to export (0 for no limit, the default). Models having
+    // more faces are simplified to within the budget before writing (see Decimation.h).
+    void setMaxFaces( size_t n) { _maxFaces = n;}
+    size_t maxFaces() const { return _maxFaces;}
+
 protected:
     virtual bool doSave( const RFeatures::ObjModel&, const std::string& filename);
 
 private:
     const bool _delOnDtor;
-    const bool _media9;
+    bool _compactNormals;
+    bool _texturesFirst;
+    size_t _maxFaces;
+    TextureFormat _txfmt;
+    int _txqual;
+    int _maxTxDim;
     std::string _idtffile;
-    std::vector<std::string> _tgafiles;
+    std::vector<std::string> _txfiles;
     void reset();
+    bool _saveScene( const std::vector<Instance>&, const std::string&);
+    bool _addTextures( const RFeatures::ObjModel&, const std::string&, std::vector<std::pair<int, std::string> >&);
 };  // end class
 
 }   // end namespace
@@ -23,6 +23,7 @@
  */
 
 #include "rModelIO_Export.h"
+#include "FileCache.h"
 #include <CameraParams.h>
 #include <ObjModel.h>
 #include <iostream>
@@ -63,6 +64,18 @@ public:
     bool setModel( const std::string& u3dfilename);
     bool setModel( const RFeatures::ObjModel&, const std::string&);
 
+    // Cache used when converting models to U3D (null by default for no caching).
+    // See RModelIO::U3DExporter::createCache.
+    static FileCache::Ptr U3DCache;
+
+    // Maximum number of faces of models converted to U3D (0 by default for no limit).
+    // Models having more faces are simplified. See RModelIO::U3DExporter::setMaxFaces.
+    static size_t U3DMaxFaces;
+
+    // Maximum width and height of the textures of models converted to U3D (0 by default
+    // for no limit). See RModelIO::U3DExporter::setMaxTextureSize.
+    static int U3DMaxTextureSize;
+
 private:
     float _fw;
     float _fh;
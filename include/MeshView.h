@@ -0,0 +1,114 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+/**
+ * Non-owning view of a triangle mesh held in flat caller owned arrays.
+ * Exporters save directly from a view without building an ObjModel.
+ *
+ * Texture coordinates are optional. If uvIndices is null, uvs has one
+ * entry per vertex and is indexed by the face's vertex indices. Otherwise
+ * uvIndices gives the index into uvs of each corner of each face.
+ *
+ * Material IDs per face are optional and index into textures (-1 for no
+ * material). Alternatively, faces may be sorted by material with the faces
+ * of material i in [materialOffsets[i], materialOffsets[i+1]) and faces from
+ * materialOffsets[numMaterials()] onwards having no material. If neither is
+ * given, all faces use material 0 if there are textures and uvs and no
+ * material otherwise.
+ */
+
+#ifndef RMODELIO_MESH_VIEW_H
+#define RMODELIO_MESH_VIEW_H
+
+#include "rModelIO_Export.h"
+#include <ObjModel.h>   // RFeatures
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace RModelIO {
+
+struct rModelIO_EXPORT MeshView
+{
+    const float* positions = nullptr;       // nvtxs * 3
+    size_t nvtxs = 0;
+    const uint32_t* indices = nullptr;      // nfaces * 3
+    size_t nfaces = 0;
+    const float* uvs = nullptr;             // nuvs * 2 (optional)
+    size_t nuvs = 0;
+    const uint32_t* uvIndices = nullptr;    // nfaces * 3 (optional)
+    const int32_t* faceMaterials = nullptr; // nfaces (optional)
+    const uint32_t* materialOffsets = nullptr;  // numMaterials() + 1 (optional)
+    std::vector<cv::Mat> textures;          // One per material
+
+    size_t numMaterials() const { return textures.size();}
+
+    // Returns the material of face f or -1 if none.
+    int material( size_t f) const
+    {
+        if ( !uvs)
+            return -1;
+        if ( faceMaterials)
+            return faceMaterials[f];
+        if ( materialOffsets)
+        {
+            const uint32_t* end = materialOffsets + textures.size();
+            if ( f >= *end)
+                return -1;
+            return int( std::upper_bound( materialOffsets, end + 1, uint32_t(f)) - materialOffsets) - 1;
+        }   // end if
+        return textures.empty() ? -1 : 0;
+    }   // end material
+
+    // Returns the index into uvs of corner i of face f. Only valid for faces having a material.
+    uint32_t uvIndex( size_t f, int i) const { return uvIndices ? uvIndices[3*f+i] : indices[3*f+i];}
+
+    const float* position( uint32_t v) const { return &positions[3*v];}
+    const float* uv( uint32_t i) const { return &uvs[2*i];}
+
+    // Returns an empty string if the view is consistent or else a description of the problem.
+    std::string check() const;
+
+    // Returns the faces of each material (the last list has the faces without a material).
+    std::vector<std::vector<uint32_t> > materialFaces() const;
+
+    // Build an ObjModel from the view.
+    RFeatures::ObjModel::Ptr toModel() const;
+};  // end struct
+
+
+// Flat arrays copied from an ObjModel's geometry (vertices, faces and materials
+// in ID order) together with a view of them.
+struct rModelIO_EXPORT ModelArrays
+{
+    explicit ModelArrays( const RFeatures::ObjModel&);
+
+    std::vector<float> pos;
+    std::vector<uint32_t> idx;
+    std::vector<float> uvs;
+    std::vector<uint32_t> uvidx;
+    std::vector<int32_t> fmats;
+    MeshView view;
+
+private:
+    ModelArrays( const ModelArrays&) = delete;
+    void operator=( const ModelArrays&) = delete;
+};  // end struct
+
+}   // end namespace
+
+#endif
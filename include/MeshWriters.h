@@ -0,0 +1,179 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+/**
+ * Serialisation core shared by the text format exporters. Each writer is
+ * a template instantiated per format and per combination of attributes
+ * so that the loops over vertices and faces have no branches on what is
+ * being written. Exporters choose the instantiation once per mesh.
+ */
+
+#ifndef RMODELIO_MESH_WRITERS_H
+#define RMODELIO_MESH_WRITERS_H
+
+#include "FloatFormat.h"
+#include "MeshView.h"
+#include "Transform.h"
+#include <ostream>
+
+namespace RModelIO {
+namespace MeshWriters {
+
+// Line prefixes and index base of each supported text format.
+struct OBJ
+{
+    static const char* position() { return "v\t";}
+    static const char* uv() { return "vt\t";}
+    static const char* uvSuffix() { return " 0";}
+    static const char* face() { return "f\t";}
+    static const char* uvSeparator() { return "/";}
+    static uint32_t indexBase() { return 1;}
+};  // end struct
+
+struct PLY
+{
+    static const char* position() { return "";}
+    static const char* face() { return "3 ";}
+    static const char* uvSeparator() { return "";}
+    static uint32_t indexBase() { return 0;}
+};  // end struct
+
+struct IDTF
+{
+    static const char* position() { return "\t\t\t\t";}
+    static const char* uv() { return "\t\t\t\t";}
+    static const char* uvSuffix() { return " 0 0";}
+    static const char* face() { return "\t\t\t\t";}
+    static const char* uvSeparator() { return "";}
+    static uint32_t indexBase() { return 0;}
+};  // end struct
+
+
+// How texture coordinates are referenced by the corners of faces.
+enum UVMode
+{
+    NO_UVS,         // Not written
+    VERTEX_UVS,     // One per vertex (indexed by vertex)
+    INDEXED_UVS     // Indexed by MeshView::uvIndices
+};  // end enum
+
+
+template <UVMode M> inline uint32_t uvIndex( const MeshView&, size_t, int) { return 0;}
+template <> inline uint32_t uvIndex<VERTEX_UVS>( const MeshView& m, size_t f, int i) { return m.indices[3*f+i];}
+template <> inline uint32_t uvIndex<INDEXED_UVS>( const MeshView& m, size_t f, int i) { return m.uvIndices[3*f+i];}
+
+
+// Write n tuples of N floats each one per line with the given prefix and suffix.
+template <int N>
+void writeTuples( std::ostream& os, const float* p, size_t n, const char* prefix, const char* suffix, const FloatFormat& ff)
+{
+    if ( ff.usesStream())
+    {
+        for ( size_t i = 0; i < n; ++i, p += N)
+        {
+            os << prefix << p[0];
+            for ( int j = 1; j < N; ++j)
+                os << ' ' << p[j];
+            os << suffix << '\n';
+        }   // end for
+        return;
+    }   // end if
+
+    char line[N * (FloatFormat::BUF_SIZE + 1)];
+    for ( size_t i = 0; i < n; ++i, p += N)
+    {
+        char* c = ff.format( line, p[0]);
+        for ( int j = 1; j < N; ++j)
+        {
+            *c++ = ' ';
+            c = ff.format( c, p[j]);
+        }   // end for
+        os << prefix;
+        os.write( line, c - line);
+        os << suffix << '\n';
+    }   // end for
+}   // end writeTuples
+
+
+// Write n positions (three floats each) one per line.
+template <class F>
+void writePositions( std::ostream& os, const float* p, size_t n, const FloatFormat& ff=FloatFormat())
+{
+    writeTuples<3>( os, p, n, F::position(), "", ff);
+}   // end writePositions
+
+
+// Write all positions of the mesh transformed by xf.
+template <class F>
+void writePositions( std::ostream& os, const MeshView& m, const Transform& xf, const FloatFormat& ff=FloatFormat())
+{
+    xf.forEachBatch( m.positions, m.nvtxs, [&]( const float* p, size_t n){ writePositions<F>( os, p, n, ff);});
+}   // end writePositions
+
+
+// Write n texture coordinates (two floats each) one per line.
+template <class F>
+void writeUVs( std::ostream& os, const float* uv, size_t n, const FloatFormat& ff=FloatFormat())
+{
+    writeTuples<2>( os, uv, n, F::uv(), F::uvSuffix(), ff);
+}   // end writeUVs
+
+
+template <class F, UVMode M>
+inline void writeCorner( std::ostream& os, const MeshView& m, size_t f, int i)
+{
+    os << m.indices[3*f+i] + F::indexBase();
+    if ( M != NO_UVS)
+        os << F::uvSeparator() << uvIndex<M>( m, f, i) + F::indexBase();
+}   // end writeCorner
+
+
+// Write the faces given by the range of face indices one per line.
+template <class F, UVMode M, typename FaceIt>
+void writeFaces( std::ostream& os, const MeshView& m, FaceIt begin, FaceIt end)
+{
+    for ( FaceIt it = begin; it != end; ++it)
+    {
+        const size_t f = *it;
+        os << F::face();
+        writeCorner<F,M>( os, m, f, 0);
+        os << ' ';
+        writeCorner<F,M>( os, m, f, 1);
+        os << ' ';
+        writeCorner<F,M>( os, m, f, 2);
+        os << '\n';
+    }   // end for
+}   // end writeFaces
+
+
+// Choose the instantiation for the mesh. Texture coordinates are written if withUVs is true
+// and the mesh has them.
+template <class F, typename FaceIt>
+void writeFaces( std::ostream& os, const MeshView& m, bool withUVs, FaceIt begin, FaceIt end)
+{
+    if ( !withUVs || !m.uvs)
+        writeFaces<F, NO_UVS>( os, m, begin, end);
+    else if ( m.uvIndices)
+        writeFaces<F, INDEXED_UVS>( os, m, begin, end);
+    else
+        writeFaces<F, VERTEX_UVS>( os, m, begin, end);
+}   // end writeFaces
+
+}   // end namespace
+}   // end namespace
+
+#endif
@@ -23,6 +23,7 @@
 #define RMODELIO_OBJ_EXPORTER_H
 
 #include "ObjModelExporter.h"
+#include "TextureStore.h"
 
 namespace RModelIO {
 
@@ -31,8 +32,42 @@ class rModelIO_EXPORT OBJExporter : public ObjModelExporter
 public:
     OBJExporter();
 
+    enum TextureFormat
+    {
+        PNG,
+        JPEG,
+        WEBP
+    };  // end enum
+
+    // Set the image format that material textures are saved in (PNG by default).
+    // For PNG, quality is the compression level in [0,9] and for JPEG and WebP it
+    // is the quality in [0,100]. Set quality -1 to use OpenCV's default.
+    // Textures are encoded in parallel with one another and with the geometry.
+    void setTextureFormat( TextureFormat fmt, int quality=-1);
+
+    // Textures with pixels unchanged since being loaded from an image file (see TextureSources)
+    // are exported by copying the original file instead of encoding the texture again. Such
+    // textures keep the format of the original file regardless of setTextureFormat. Set
+    // allowHardLinks true to hard link to the original file rather than copying it (in which
+    // case changes to the exported file will also change the original). Enabled by default.
+    void setTexturePassThrough( bool enable, bool allowHardLinks=false);
+
+    // Write textures into the given content addressed store directory rather than adjacent
+    // to the exported model. Each unique texture (per format and quality) is encoded and
+    // written to the store only once, with the .mtl file referencing the stored file.
+    // Pass an empty string to stop using a store. Returns false if the directory can't be created.
+    bool setTextureStore( const std::string& dir);
+
 protected:
     bool doSave( const RFeatures::ObjModel&, const std::string& filename) override;
+    bool doSaveView( const MeshView&, const std::string& filename) override;
+
+private:
+    TextureFormat _txfmt;
+    int _txqual;
+    bool _passThru;
+    bool _hardLinks;
+    TextureStore::Ptr _txstore;
 };  // end class
 
 }   // end namespace
@@ -22,7 +22,10 @@
 #ifndef RMODELIO_OBJ_MODEL_EXPORTER_H
 #define RMODELIO_OBJ_MODEL_EXPORTER_H
 
-#include "rModelIO_Export.h"
+#include "FileSink.h"
+#include "FloatFormat.h"
+#include "MeshView.h"
+#include "Transform.h"
 #include <IOFormats.h>  // rlib
 #include <ObjModel.h>   // RFeatures
 
@@ -35,10 +38,93 @@ public:
     virtual ~ObjModelExporter(){}
 
     // Returns true on success. The filename extension must be supported.
+    // Returns only once all files written as part of the export are complete.
+    // The extension may be followed by a compression suffix (see Compression.h)
+    // to compress the model file (but not any accompanying files).
     bool save( const RFeatures::ObjModel&, const std::string& filename);
 
+    // Save to the given stream in the format given by the extension of name (e.g. "model.obj"
+    // or just "obj" which is taken as "model.obj") which may have a compression suffix. Any
+    // side files (e.g. materials and textures) are queued on sideSink named relative to the
+    // directory of name. Saving fails if the format needs side files and sideSink is null.
+    // Nothing is written to disk for formats written through the file sink (OBJ, PLY, RMB,
+    // IDTF and GLB). Formats that write files directly (glTF with its separate .bin file,
+    // and U3D when converting or caching) are saved in a temporary working directory
+    // first (see needsWorkingDir).
+    bool save( const RFeatures::ObjModel&, std::ostream&, const std::string& name, FileSink* sideSink=nullptr);
+
+    // As above but the saved model is placed in the given buffer.
+    bool save( const RFeatures::ObjModel&, std::vector<char>&, const std::string& name, FileSink* sideSink=nullptr);
+
+    // As above but saving directly from a view of caller owned arrays which
+    // must remain valid until save returns.
+    bool save( const MeshView&, const std::string& filename);
+    bool save( const MeshView&, std::ostream&, const std::string& name, FileSink* sideSink=nullptr);
+    bool save( const MeshView&, std::vector<char>&, const std::string& name, FileSink* sideSink=nullptr);
+
+    // Set a transform applied to vertex positions as they are written (identity by default).
+    // The model itself is not modified or copied.
+    void setTransform( const Transform& t) { _transform = t;}
+    const Transform& transform() const { return _transform;}
+
+    // Set how text formats write vertex positions and texture coordinates (see FloatFormat.h).
+    // By default, values are written using the output stream's own formatting.
+    void setFloatFormat( const FloatFormat& f) { _ffmt = f;}
+    const FloatFormat& floatFormat() const { return _ffmt;}
+
+    // Set the number of threads used to write files (0 for hardware concurrency)
+    // and the maximum number of file writes that may be queued at any one time.
+    void setFileConcurrency( size_t nthreads, size_t maxPending);
+
 protected:
+    // Implementations should queue the writing of their files to fileSink() rather than
+    // writing them synchronously. Queued files are waited on after doSave returns.
+    // Vertex positions must be written transformed by transform().
     virtual bool doSave( const RFeatures::ObjModel&, const std::string& filename) = 0;
+
+    // Save from a view. Exporters that work from flat arrays should override this and
+    // implement doSave by passing it viewOf(model). The default builds an ObjModel from
+    // the view and calls doSave.
+    virtual bool doSaveView( const MeshView&, const std::string& filename);
+
+    // Returns a view of the given model's geometry. The arrays it references are
+    // kept until the files queued during the current save have been written.
+    const MeshView& viewOf( const RFeatures::ObjModel&);
+
+    FileSink& fileSink();
+
+    // Returns the directory in which the model file given to doSave will finally reside.
+    // This is its parent directory unless saving to a stream in which case it's the
+    // directory that side files are named relative to.
+    std::string modelDir( const std::string& filename) const;
+
+    // Exporters that write the model file themselves rather than through fileSink() must call
+    // this once it's written so that it can be compressed if the save filename asks for it.
+    void wroteModelFile() { _wroteModel = true;}
+
+    // Exporters that write any files for the given model filename other than through fileSink()
+    // must return true so that saving to a stream provides a working directory to write them in.
+    virtual bool needsWorkingDir( const std::string& filename) const { return false;}
+
+    // Save to filename as save does but calling the given function in place of doSave
+    // (for exporters providing other kinds of save).
+    bool saveUsing( const std::string& filename, const std::function<bool( const std::string&)>&);
+
+private:
+    size_t _nthreads;
+    size_t _maxPending;
+    FileSink::Ptr _sink;
+    Transform _transform;
+    FloatFormat _ffmt;
+    std::shared_ptr<void> _held;    // Data referenced by queued writes
+    bool _wroteModel;               // Model file written directly by the exporter
+    bool _toStream;                 // Currently saving to a stream
+    std::string _sideDir;           // Directory side files are named relative to when saving to a stream
+
+    using Saver = std::function<bool( const std::string&)>;
+    bool _saveFile( const std::string&, const Saver&);
+    bool _saveStream( std::ostream&, const std::string&, FileSink*, const Saver&);
+    bool _saveToStream( std::ostream&, const std::string&, FileSink*, const Saver&);
 };  // end class
 
 }   // end namespace
@@ -22,7 +22,9 @@
 #ifndef RMODELIO_OBJ_MODEL_IMPORTER_H
 #define RMODELIO_OBJ_MODEL_IMPORTER_H
 
-#include "rModelIO_Export.h"
+#include "FileCache.h"
+#include "FlatMesh.h"
+#include "Transform.h"
 #include <IOFormats.h>  // rlib
 #include <ObjModel.h>   // RFeatures
 
@@ -36,10 +38,46 @@ public:
     virtual ~ObjModelImporter(){}
 
     // On error, NULL object returned. The filename extension must be supported.
+    // The extension may be followed by a compression suffix (see Compression.h)
+    // in which case the file is decompressed as it's read.
     RFeatures::ObjModel::Ptr load( const std::string& filename);
 
+    // As load but returns the model as flat arrays without building an ObjModel.
+    // Unlike load, duplicate vertices and faces are kept as they are in the file.
+    FlatMesh::Ptr loadFlat( const std::string& filename);
+
+    // Set a transform (e.g. a unit or axis conversion preset) applied to vertex positions
+    // as they are read (identity by default).
+    void setTransform( const Transform& t) { _transform = t;}
+    const Transform& transform() const { return _transform;}
+
+    // Create a cache of converted models suitable for passing to setCache.
+    static FileCache::Ptr createCache( const std::string& dir, uint64_t maxBytes);
+
+    // Set the cache of converted models (null to disable caching which is the default).
+    // Models are cached by the canonical path, size and modification time of the loaded
+    // file together with the importer's options. The same cache may be shared between
+    // importers and between processes.
+    void setCache( FileCache::Ptr c) { _cache = c;}
+    FileCache::Ptr cache() const { return _cache;}
+
 protected:
+    // Implementations must handle filenames having a compression suffix
+    // and must apply transform() to vertex positions.
     virtual RFeatures::ObjModel::Ptr doLoad( const std::string& filename) = 0;
+
+    // Importers that can read into flat arrays directly should override this.
+    // The default loads an ObjModel with doLoad and copies it into a FlatMesh.
+    virtual FlatMesh::Ptr doLoadFlat( const std::string& filename);
+
+    // Returns a description of the importer's options that affect the loaded model.
+    virtual std::string optionsKey() const { return "";}
+
+private:
+    FileCache::Ptr _cache;
+    Transform _transform;
+    bool _checkLoad( const std::string&);
+    bool _cacheKey( const std::string&, const char*, std::string&) const;
 };  // end class
 
 }   // end namespace
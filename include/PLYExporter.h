@@ -33,6 +33,7 @@ public:
 
 protected:
     bool doSave( const RFeatures::ObjModel&, const std::string& filename) override;
+    bool doSaveView( const MeshView&, const std::string& filename) override;
 };  // end class
 
 }   // end namespace
@@ -0,0 +1,48 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+/**
+ * Export model to the native RModelIO binary format (.rmb) described in
+ * RMBFormat.h. Textures are stored as raw pixels so that reloading with
+ * RMBImporter requires no parsing or image decoding.
+ */
+
+#ifndef RMODELIO_RMB_EXPORTER_H
+#define RMODELIO_RMB_EXPORTER_H
+
+#include "ObjModelExporter.h"
+
+namespace RModelIO {
+
+class rModelIO_EXPORT RMBExporter : public ObjModelExporter
+{
+public:
+    RMBExporter();
+
+    // Write the model in RMB format to the given stream returning true on success.
+    // Positions are transformed by the given transform as they are written.
+    static bool write( std::ostream&, const RFeatures::ObjModel&, const Transform& xf=Transform());
+    static bool write( std::ostream&, const MeshView&, const Transform& xf=Transform());
+
+protected:
+    bool doSave( const RFeatures::ObjModel&, const std::string& filename) override;
+    bool doSaveView( const MeshView&, const std::string& filename) override;
+};  // end class
+
+}   // end namespace
+
+#endif
@@ -0,0 +1,100 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+/**
+ * Layout of the native RModelIO binary model format (.rmb).
+ *
+ * A file is a Header followed by a table of nsections Section entries
+ * and then the sections themselves. Every section starts on an ALIGNMENT
+ * byte boundary so its contents can be used in place from a memory mapping.
+ * All values are little endian (checked using Header::endianMark).
+ *
+ * Sections:
+ * POSITIONS        float[nvtxs][3]
+ * FACES            uint32[nfaces][3] indices into POSITIONS
+ * MATERIAL_FACES   uint32[n] indices into FACES of the faces using the material
+ * MATERIAL_UVS     float[n][3][2] texture coordinates of the corners of each of
+ *                  the material's faces (in the same order as MATERIAL_FACES)
+ * TEXTURE          TextureHeader followed by rows*cols continuous pixels
+ *
+ * There is one each of the MATERIAL sections and TEXTURE for each material
+ * (identified by Section::material in [0,nmats)).
+ */
+
+#ifndef RMODELIO_RMB_FORMAT_H
+#define RMODELIO_RMB_FORMAT_H
+
+#include <cstdint>
+
+namespace RModelIO {
+namespace RMB {
+
+static const char MAGIC[4] = {'R','M','B','\x1a'};
+static const uint32_t VERSION = 1;
+static const uint32_t ENDIAN_MARK = 0x01020304;
+static const uint64_t ALIGNMENT = 16;
+
+enum SectionType : uint32_t
+{
+    POSITIONS = 1,
+    FACES = 2,
+    MATERIAL_FACES = 3,
+    MATERIAL_UVS = 4,
+    TEXTURE = 5
+};  // end enum
+
+struct Header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t endianMark;
+    uint32_t nsections;
+    uint64_t fileSize;
+    uint64_t tableOffset;
+    uint32_t nvtxs;
+    uint32_t nfaces;
+    uint32_t nmats;
+    uint32_t reserved;
+};  // end struct
+
+struct Section
+{
+    uint32_t type;
+    uint32_t material;  // Material index (MATERIAL_* and TEXTURE sections only)
+    uint64_t offset;    // From start of file
+    uint64_t size;      // In bytes
+};  // end struct
+
+struct TextureHeader
+{
+    int32_t rows;
+    int32_t cols;
+    int32_t type;       // OpenCV matrix type
+    int32_t reserved;
+};  // end struct
+
+static_assert( sizeof(Header) == 48, "Unexpected RMB::Header size!");
+static_assert( sizeof(Section) == 24, "Unexpected RMB::Section size!");
+static_assert( sizeof(TextureHeader) == ALIGNMENT, "Unexpected RMB::TextureHeader size!");
+
+// Round n up to the next multiple of ALIGNMENT.
+inline uint64_t align( uint64_t n) { return (n + ALIGNMENT - 1) & ~(ALIGNMENT - 1);}
+
+}   // end namespace
+}   // end namespace
+
+#endif
@@ -0,0 +1,49 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+/**
+ * Import models saved in the native RModelIO binary format (.rmb) by RMBExporter.
+ * The file is memory mapped and the model built directly from the mapped sections
+ * after checking the format version and that all sections lie within the file.
+ */
+
+#ifndef RMODELIO_RMB_IMPORTER_H
+#define RMODELIO_RMB_IMPORTER_H
+
+#include "ObjModelImporter.h"
+
+namespace RModelIO {
+
+class rModelIO_EXPORT RMBImporter : public ObjModelImporter
+{
+public:
+    // Set loadTextures false to ignore the stored materials.
+    explicit RMBImporter( bool loadTextures=true);
+
+protected:
+    RFeatures::ObjModel::Ptr doLoad( const std::string& filename) override;
+    FlatMesh::Ptr doLoadFlat( const std::string& filename) override;
+    std::string optionsKey() const override { return _loadTextures ? "T" : "t";}
+
+private:
+    const bool _loadTextures;
+    template <typename T> std::shared_ptr<T> _load( const std::string&);
+};  // end class
+
+}   // end namespace
+
+#endif
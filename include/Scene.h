@@ -0,0 +1,75 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+/**
+ * A scene of model instances as written by the IDTF and U3D exporters.
+ * Instances of the same model, or of models with identical content, share
+ * a unique model which is placed by a node for each instance.
+ */
+
+#ifndef RMODELIO_SCENE_H
+#define RMODELIO_SCENE_H
+
+#include "Transform.h"
+#include <string>
+#include <vector>
+
+namespace RModelIO {
+
+class rModelIO_EXPORT Scene
+{
+public:
+    // A model placed in a scene by a transform applied before the exporter's transform.
+    struct Instance
+    {
+        const RFeatures::ObjModel* model;
+        Transform transform;
+    };  // end struct
+
+    // A node placing one of the scene's unique models.
+    struct Node
+    {
+        int model;
+        cv::Matx44d tm;
+    };  // end struct
+
+    // Build the scene for an exporter that writes vertices transformed by xf. An instance
+    // transform T becomes the node transform X T X^-1 so instance transforms other than
+    // the identity need xf to be invertible. Unique models having more than maxFaces faces
+    // (if maxFaces > 0) are simplified (see Decimation.h). Returns false and sets err on error
+    // (including if a model can't be simplified to within the budget).
+    bool build( const std::vector<Instance>&, const Transform& xf, size_t maxFaces, std::string& err);
+
+    // The unique models (simplified copies if over the face budget).
+    const std::vector<const RFeatures::ObjModel*>& models() const { return _models;}
+
+    // The node of each instance in the order given.
+    const std::vector<Node>& nodes() const { return _nodes;}
+
+private:
+    std::vector<const RFeatures::ObjModel*> _models;
+    std::vector<RFeatures::ObjModel::Ptr> _simplified;  // Keeps simplified models alive
+    std::vector<Node> _nodes;
+};  // end class
+
+
+// Returns the texture downscaled (if necessary) to have no side longer than maxDim (0 for no limit).
+rModelIO_EXPORT cv::Mat scaleTexture( const cv::Mat&, int maxDim);
+
+}   // end namespace
+
+#endif
@@ -0,0 +1,71 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+/**
+ * File sink used by ObjModelExporter to save models to a stream. Exporters
+ * save to names in a private working directory. The model file is written to
+ * the stream rather than to disk. Side files (e.g. materials and textures) in
+ * the working directory are passed to a separate sink under names relative to
+ * a given directory. The save fails if there are side files and no side sink.
+ * Files outside the working directory (e.g. in a TextureStore) are written
+ * as normal. The working directory need only exist if the exporter writes
+ * files in it directly; it is created if a task must write the model file.
+ */
+
+#ifndef RMODELIO_STREAM_SINK_H
+#define RMODELIO_STREAM_SINK_H
+
+#include "FileSink.h"
+
+namespace RModelIO {
+
+class rModelIO_EXPORT StreamSink : public FileSink
+{
+public:
+    // Write the file called fname (in working directory workDir) to os. Other files in
+    // workDir are queued on side (if not null) named relative to sideDir instead.
+    StreamSink( std::ostream& os, const std::string& fname, const std::string& workDir,
+                FileSink* side, const std::string& sideDir);
+    ~StreamSink() override;
+
+    // Call after waiting on this sink to pass on any files that the exporter wrote
+    // directly to the working directory rather than through the sink. Waits on the
+    // side sink and returns false if the model file wasn't written, if any side
+    // files couldn't be written, or if there are side files but no side sink.
+    bool finish();
+
+protected:
+    bool writeFile( const std::string&, const Writer&) override;
+    bool runTask( const std::string&, const Task&) override;
+    bool copyFile( const std::string&, const std::string&, bool) override;
+
+private:
+    std::ostream& _os;
+    const std::string _fname;
+    const std::string _workDir;
+    FileSink* _side;
+    const std::string _sideDir;
+    bool _written;
+
+    bool _inWorkDir( const std::string&) const;
+    std::string _sideName( const std::string&) const;
+    bool _streamFile( const std::string&);
+};  // end class
+
+}   // end namespace
+
+#endif
@@ -0,0 +1,68 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+/**
+ * Process wide record of the image files that model textures were loaded from.
+ * Importers add the source file of each texture they decode. Exporters can then
+ * look up a texture by its pixels and, if the source file is unchanged on disk,
+ * copy or link it rather than encoding the texture again. The record holds at
+ * most maxSources() entries, discarding the least recently used beyond that.
+ */
+
+#ifndef RMODELIO_TEXTURE_SOURCES_H
+#define RMODELIO_TEXTURE_SOURCES_H
+
+#include "rModelIO_Export.h"
+#include <ObjModel.h>   // RFeatures
+#include <cstdint>
+#include <ctime>
+#include <string>
+
+namespace RModelIO {
+
+class rModelIO_EXPORT TextureSources
+{
+public:
+    struct Source
+    {
+        std::string path;       // Absolute path to the image file
+        uint64_t fileHash;      // Hash of the file's contents when loaded
+        uintmax_t fileSize;     // Size of the file when loaded
+        std::time_t mtime;      // Last modification time of the file when loaded
+    };  // end struct
+
+    // Record that image img was decoded from the file at path having contents hash fileHash.
+    static void add( const cv::Mat& img, const std::string& path, uint64_t fileHash);
+
+    // Returns true iff img has the same pixels as an image loaded from a file that is unchanged
+    // on disk since it was loaded, in which case src is set to describe the file. Images are
+    // only hashed if sources have been recorded. On a hash match, the file is decoded again
+    // to confirm its pixels are the same.
+    static bool find( const cv::Mat& img, Source& src);
+
+    // Forget all recorded sources.
+    static void clear();
+
+    // Set the maximum number of recorded sources (4096 by default). Sources beyond
+    // this are forgotten in least recently used order. Zero disables recording.
+    static void setMaxSources( size_t n);
+    static size_t maxSources();
+};  // end class
+
+}   // end namespace
+
+#endif
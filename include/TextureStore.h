@@ -0,0 +1,74 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+/**
+ * Content addressed directory of texture images shared between exports.
+ * Images are stored once under a name made from a hash of their content
+ * so that models sharing textures reference the same file. Files are
+ * written to a temporary name and renamed into place so the store is
+ * safe to share between concurrent exporters (and processes). Within a
+ * process, an image being written by one exporter is not written again by
+ * any other exporter storing the same image. Instead, the pending write is
+ * given to the caller to wait on outside of any sink's worker threads.
+ */
+
+#ifndef RMODELIO_TEXTURE_STORE_H
+#define RMODELIO_TEXTURE_STORE_H
+
+#include "FileSink.h"
+#include <cstdint>
+#include <future>
+
+namespace RModelIO {
+
+class rModelIO_EXPORT TextureStore
+{
+public:
+    using Ptr = std::shared_ptr<TextureStore>;
+
+    // Create a store in the given directory (created if it doesn't exist).
+    // Returns null if the directory can't be created.
+    static Ptr create( const std::string& dir);
+
+    // Writes by other exports of files this export also needs.
+    using Pending = std::vector<std::shared_future<bool> >;
+
+    // Wait for the pending writes to complete returning true iff all succeeded.
+    // Must not be called from a sink worker thread. Clears pending.
+    static bool wait( Pending&);
+
+    // The absolute path to the store directory.
+    const std::string& directory() const { return _dir;}
+
+    // Returns the path of the stored file for the given content key and file extension
+    // (including the leading dot). If not already stored, the file is queued on the sink
+    // to be written using the given writer. If the file is being written by another export,
+    // that write is appended to pending and the file is complete once it has finished.
+    std::string store( FileSink&, uint64_t key, const std::string& ext, const FileSink::Writer&, Pending& pending);
+
+    // As above but the stored file is queued to be copied from existing file src.
+    std::string storeCopy( FileSink&, uint64_t key, const std::string& ext, const std::string& src, Pending& pending);
+
+private:
+    const std::string _dir;
+    explicit TextureStore( const std::string&);
+    std::string _store( FileSink&, uint64_t, const std::string&, const FileSink::Task&, Pending&);
+};  // end class
+
+}   // end namespace
+
+#endif
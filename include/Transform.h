@@ -0,0 +1,97 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+/**
+ * A 4x4 affine transform applied to vertex positions as they are exported
+ * or imported. Positions are transformed in fixed size batches from flat
+ * arrays of floats so that the inner loop is simple enough for the compiler
+ * to vectorise. Presets are provided for common unit and axis conversions.
+ */
+
+#ifndef RMODELIO_TRANSFORM_H
+#define RMODELIO_TRANSFORM_H
+
+#include "rModelIO_Export.h"
+#include <ObjModel.h>   // RFeatures
+#include <algorithm>
+
+namespace RModelIO {
+
+class rModelIO_EXPORT Transform
+{
+public:
+    // The number of positions transformed at a time by forEachBatch.
+    static const size_t BATCH_SIZE = 256;
+
+    Transform();    // Identity
+    explicit Transform( const cv::Matx44d&);   // Bottom row must be 0 0 0 1
+
+    // Presets.
+    static Transform scale( double s);
+    static Transform translate( const cv::Vec3d&);
+    static Transform mmToMetres() { return scale( 0.001);}
+    static Transform metresToMm() { return scale( 1000.0);}
+    static Transform yUpToZUp();    // (a,b,c) --> (a,-c,b)
+    static Transform zUpToYUp();    // (a,b,c) --> (a,c,-b)
+    static Transform media9() { return yUpToZUp();}    // Orientation expected by the LaTeX media9 package
+
+    // Returns the transform applying other first and then this.
+    Transform operator*( const Transform& other) const;
+
+    const cv::Matx44d& matrix() const { return _m;}
+    bool isIdentity() const { return _identity;}
+
+    cv::Vec3f operator()( const cv::Vec3f&) const;
+
+    // Transform n positions (three floats each) from src into dst which may be the same array.
+    void apply( const float* src, size_t n, float* dst) const;
+
+    // Call fn( const float* pos, size_t npos) for consecutive batches of at most BATCH_SIZE
+    // transformed positions from src. If the transform is the identity, fn is called once
+    // with the untransformed src array.
+    template <typename F>
+    void forEachBatch( const float* src, size_t n, F fn) const;
+
+private:
+    cv::Matx44d _m;
+    float _a[12];   // Top three rows as floats
+    bool _identity;
+    void _set();
+};  // end class
+
+
+template <typename F>
+void Transform::forEachBatch( const float* src, size_t n, F fn) const
+{
+    if ( _identity)
+    {
+        fn( src, n);
+        return;
+    }   // end if
+
+    float buf[3*BATCH_SIZE];
+    for ( size_t i = 0; i < n; i += BATCH_SIZE)
+    {
+        const size_t nb = std::min( BATCH_SIZE, n - i);
+        apply( &src[3*i], nb, buf);
+        fn( buf, nb);
+    }   // end for
+}   // end forEachBatch
+
+}   // end namespace
+
+#endif
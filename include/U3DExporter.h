@@ -19,9 +19,11 @@
  * Export RFeatures::ObjModel objects to U3D format via creation
  * of IDTF files (see RModelIO::IDTFExporter).
  *
- * The IDTFConverter that can convert .idtf files to .u3d files must be
+ * The IDTFConverter that can convert .idtf files to .u3d files should be
  * available on the PATH. IDTFConverter can be found at
  * https://www2.iaas.msu.ru/tmp/u3d/ (thanks to Michail Vidiassov).
+ * If it isn't found, U3D export is disabled unless the native writer is
+ * chosen (see setNativeWriter).
  *
  * Richard Palmer
  * August 2017
@@ -30,7 +32,9 @@
 #ifndef RMODELIO_U3D_EXPORTER_H
 #define RMODELIO_U3D_EXPORTER_H
 
-#include "ObjModelExporter.h"
+#include "FileCache.h"
+#include "IDTFExporter.h"
+#include <future>
 
 namespace RModelIO {
 
@@ -39,23 +43,132 @@ class rModelIO_EXPORT U3DExporter : public ObjModelExporter
 public:
     // Defines name of the IDTFConverter program which must be on the path.
     // Defaults to "IDTFConverter" ("IDTFConverter.exe" on Windows).
+    // Set before creating exporters since it isn't synchronised.
     static std::string IDTFConverter;   
 
-    // Returns true iff IDTFConverter is on the PATH.
+    // Returns true iff IDTFConverter is on the PATH. The PATH is searched once per
+    // converter name and the result remembered.
     static bool isAvailable();
 
-    // U3D conversion produces an IDTF file and a tga texture.
+    // Set whether U3D files are written directly by U3DWriter rather than converted
+    // from IDTF (the default is to convert). Enabling it enables U3D export without
+    // IDTFConverter. The native writer is experimental: its output has not yet been
+    // checked with the reference U3D library or a viewer, it can't reduce position,
+    // texture coordinate or geometry quality, and its files are larger. The IDTF
+    // transport, texture format and timeout settings only apply to conversion.
+    void setNativeWriter( bool native);
+    bool nativeWriter() const { return _native;}
+
+    // U3D conversion produces an IDTF file and texture images.
     // Normally, both are destroyed immediately after saving the
     // U3D model. Set delOnDestroy to false to retain these files.
-    // Setting media9 true will transform coordinates as (a,b,c) --> (a,-c,b).
+    // Setting media9 true sets the transform to Transform::media9() which maps
+    // coordinates as (a,b,c) --> (a,-c,b). See ObjModelExporter::setTransform.
     U3DExporter( bool delOnDestroy=true, bool media9=false);
 
+    // How the intermediate IDTF is passed to IDTFConverter.
+    // IDTF_FILE writes the IDTF file next to the U3D file before conversion (the default).
+    // IDTF_PIPE streams the IDTF to the converter through a named pipe in a scratch directory
+    // so that conversion overlaps writing and no IDTF is written to disk. Falls back to
+    // IDTF_SCRATCH where named pipes aren't available (Windows).
+    // IDTF_SCRATCH writes the IDTF file to a scratch directory on tmpfs (/dev/shm) if
+    // available for converters that need to seek within the file.
+    // Textures are written to the scratch directory in the latter two cases.
+    enum IDTFTransport { IDTF_FILE, IDTF_PIPE, IDTF_SCRATCH };
+    void setIDTFTransport( IDTFTransport t) { _transport = t;}
+    IDTFTransport idtfTransport() const { return _transport;}
+
+    // Compression quality used by IDTFConverter (its -pq, -tcq, -gq and -tq options).
+    // Position, texture coordinate and geometry quality are in [0,1000] and texture
+    // quality is in [0,100]. Lower values give smaller files. Defaults are the maximum.
+    // When writing natively, texture quality gives PNG at 100 and JPEG otherwise, and
+    // saving fails unless the other factors are at their maximum.
+    struct Quality
+    {
+        int position = 1000;
+        int texCoord = 1000;
+        int geometry = 1000;
+        int texture = 100;
+    };  // end struct
+    void setQuality( const Quality& q) { _quality = q;}
+    const Quality& quality() const { return _quality;}
+
+    // Set the format of the intermediate texture images read by IDTFConverter (see
+    // IDTFExporter::setTextureFormat). Defaults to PNG at the fastest compression level
+    // which is lossless and much smaller than TGA. Textures are re-encoded by the
+    // converter at the texture quality so this affects only the temporary files.
+    void setTextureFormat( IDTFExporter::TextureFormat fmt, int quality=-1) { _txfmt = fmt; _txqual = quality;}
+
+    // Set the maximum width and height of textures (0 for no limit, the default).
+    // Larger textures are downscaled before conversion which also reduces the U3D size.
+    void setMaxTextureSize( int maxDim) { _maxTxDim = maxDim;}
+    int maxTextureSize() const { return _maxTxDim;}
+
+    // Set the maximum number of faces to save (0 for no limit, the default). Larger models
+    // are simplified to within the budget before saving (see IDTFExporter::setMaxFaces).
+    // Both conversion time and the size of the U3D file are roughly proportional to it.
+    void setMaxFaces( size_t n) { _maxFaces = n;}
+    size_t maxFaces() const { return _maxFaces;}
+
+    // Set the time limit for each conversion after which the converter is terminated
+    // and the save fails (0 for no limit which is the default).
+    void setTimeout( int seconds) { _timeout = seconds;}
+    int timeout() const { return _timeout;}
+
+    // Set the number of asynchronous saves run at once (0 for the hardware concurrency
+    // up to a maximum of 4). Each runs at most one converter process at a time.
+    void setMaxConcurrent( size_t n);
+
+    // Save asynchronously using a copy of this exporter's current settings. Saves are
+    // queued (blocking if many are already queued) and run concurrently so that IDTF for
+    // one model is generated while others are being converted. The model is kept alive
+    // until its save is complete. The future's value is empty on success or else
+    // describes the error.
+    std::future<std::string> saveAsync( const RFeatures::ObjModel::Ptr&, const std::string& filename);
+
+    // Block until all asynchronous saves are complete.
+    void waitAsync();
+
+    // Save several models as a single U3D scene with instances of the same model sharing
+    // the model's resources (see IDTFExporter::saveScene). Scenes aren't cached.
+    bool saveScene( const std::vector<IDTFExporter::Instance>&, const std::string& filename);
+
+    // Create a cache of saved models suitable for passing to setCache.
+    static FileCache::Ptr createCache( const std::string& dir, uint64_t maxBytes);
+
+    // Set the cache of saved models (null to disable caching which is the default).
+    // Models are cached by a hash of their geometry, texture coordinates and textures
+    // together with the exporter's transform, float format, quality, face budget, texture settings
+    // and whether writing natively. On a hit, the cached file is copied (or hard linked if
+    // allowHardLinks is true) and saving is skipped. Hit rates are given by the cache's stats.
+    // The same cache may be shared between exporters and processes.
+    void setCache( FileCache::Ptr c, bool allowHardLinks=false) { _cache = c; _cacheLinks = allowHardLinks;}
+    FileCache::Ptr cache() const { return _cache;}
+
 protected:
     virtual bool doSave( const RFeatures::ObjModel&, const std::string& filename);
 
+    // The converter writes files directly as does the native writer when caching.
+    bool needsWorkingDir( const std::string& filename) const override { return !_native || _cache;}
+
 private:
     const bool _delOnDestroy;
-    const bool _media9;
+    bool _native;
+    IDTFTransport _transport;
+    Quality _quality;
+    size_t _maxFaces;
+    IDTFExporter::TextureFormat _txfmt;
+    int _txqual;
+    int _maxTxDim;
+    int _timeout;
+    size_t _maxConcurrent;
+    FileSink::Ptr _pool;    // Runs asynchronous saves
+    FileCache::Ptr _cache;
+    bool _cacheLinks;
+
+    std::string _cacheKey( const RFeatures::ObjModel&) const;
+    bool _convert( const std::function<bool( IDTFExporter&, const std::string&)>&, const std::string&);
+    bool _writeNative( const std::vector<IDTFExporter::Instance>&, const std::string&, bool);
 };  // end class
 
 }   // end namespace
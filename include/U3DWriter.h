@@ -0,0 +1,56 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+/**
+ * Writes scenes directly in the binary Universal 3D format (ECMA-363) so
+ * that U3D files can be made without IDTFConverter. Files have the same
+ * structure as those converted from IDTFExporter's output: under a group
+ * node, each instance has a model node for each mesh of its model (a mesh
+ * per material and one for faces without a material) with a shader using
+ * the material's texture, and the scene is lit by an ambient light.
+ *
+ * Meshes are written as CLOD base meshes without progressive resolution
+ * updates. Positions and texture coordinates are stored as unquantised
+ * floats (so files are larger than the converter's at reduced quality) and
+ * normals are excluded (viewers calculate them). Textures are embedded as
+ * PNG or JPEG images.
+ *
+ * Output has been checked against a decoder written from the standard but
+ * not yet against the reference U3D library or a viewer.
+ */
+
+#ifndef RMODELIO_U3D_WRITER_H
+#define RMODELIO_U3D_WRITER_H
+
+#include "Scene.h"
+#include <iostream>
+
+namespace RModelIO {
+
+struct rModelIO_EXPORT U3DWriteOptions
+{
+    Transform xf;               // Applied to vertex positions
+    int textureQuality = 100;   // Textures are PNG at 100 and otherwise JPEG of this quality
+    int maxTextureDim = 0;      // Textures are downscaled to have no side longer than this (0 for no limit)
+};  // end struct
+
+// Write the scene to the given stream. Returns false if a texture can't be encoded or the stream fails.
+rModelIO_EXPORT bool writeU3D( std::ostream&, const Scene&, const U3DWriteOptions&);
+
+}   // end namespace
+
+#endif
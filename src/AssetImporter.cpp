@@ -16,13 +16,19 @@
  ************************************************************************/
 
 #include <AssetImporter.h>
+#include <TextureSources.h>
+#include <ContentHash.h>
+#include <Compression.h>
 #include <FeatureUtils.h>   // RFeatures
 #include <FileIO.h>     // rlib
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <assimp/importerdesc.h>
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/MemoryIOWrapper.h>
 #include <cassert>
+#include <cstring>
 #include <iostream>
 #include <iomanip>
 #include <boost/algorithm/string.hpp>
@@ -30,6 +36,7 @@
 #include <boost/regex.hpp>
 #include <boost/tokenizer.hpp>
 using RModelIO::AssetImporter;
+using RModelIO::FlatMesh;
 using RFeatures::ObjModel;
 
 namespace {
@@ -45,6 +52,13 @@ cv::Mat loadImage( const boost::filesystem::path& ppath, const std::string& imgf
     {
         if ( !RFeatures::loadImage( imgPath.string(), m))
             std::cerr << "[ERROR] RFeatures::loadImage(" << imgPath.string() << "): FAILED!" << std::endl;
+        else
+        {
+            // Record where the texture came from so exporters can reuse the file.
+            uint64_t fhash = 0;
+            if ( RModelIO::hashFile( imgPath.string(), fhash))
+                RModelIO::TextureSources::add( m, imgPath.string(), fhash);
+        }   // end else
     }   // end if
     return m;
 }   // loadImage
@@ -116,7 +130,70 @@ private:
 };  // end struct
 
 
-int setObjectFaces( const aiMesh* mesh, std::vector<int>& fids, int& nonTriangles, ObjModel::Ptr model)
+// Copy n vectors from src into dst taking the first dims components of each.
+void copyVectors( float* dst, const aiVector3D* src, size_t n, int dims)
+{
+    if ( dims == 3 && sizeof(aiVector3D) == 3 * sizeof(float))
+    {
+        std::memcpy( dst, src, n * sizeof(aiVector3D));
+        return;
+    }   // end if
+
+    for ( size_t i = 0; i < n; ++i)
+        for ( int j = 0; j < dims; ++j)
+            *dst++ = float( src[i][j]);
+}   // end copyVectors
+
+
+// Returns the vertex positions of the mesh transformed by xf as a flat array.
+std::vector<float> meshPositions( const aiMesh* mesh, const RModelIO::Transform& xf)
+{
+    std::vector<float> vpos( 3 * size_t(mesh->mNumVertices));
+    if ( !vpos.empty())
+    {
+        copyVectors( &vpos[0], mesh->mVertices, mesh->mNumVertices, 3);
+        xf.apply( &vpos[0], mesh->mNumVertices, &vpos[0]);
+    }   // end if
+    return vpos;
+}   // end meshPositions
+
+
+// A mesh of the scene and the transform to apply to its vertices.
+using MeshInstance = std::pair<uint, RModelIO::Transform>;
+
+
+void collectInstances( const aiNode* node, const RModelIO::Transform& pxf, std::vector<MeshInstance>& insts)
+{
+    const aiMatrix4x4& m = node->mTransformation;
+    const RModelIO::Transform xf = pxf * RModelIO::Transform( cv::Matx44d( m.a1, m.a2, m.a3, m.a4,
+                                                                            m.b1, m.b2, m.b3, m.b4,
+                                                                            m.c1, m.c2, m.c3, m.c4,
+                                                                            m.d1, m.d2, m.d3, m.d4));
+    for ( uint i = 0; i < node->mNumMeshes; ++i)
+        insts.push_back( MeshInstance( node->mMeshes[i], xf));
+    for ( uint i = 0; i < node->mNumChildren; ++i)
+        collectInstances( node->mChildren[i], xf, insts);
+}   // end collectInstances
+
+
+// Returns the meshes to add with their transforms. If bakeNodes is true, each mesh is added once
+// for every node referencing it with the node's global transform followed by xf. Otherwise every
+// mesh is added once with just xf.
+std::vector<MeshInstance> meshInstances( const aiScene* scene, const RModelIO::Transform& xf, bool bakeNodes)
+{
+    std::vector<MeshInstance> insts;
+    if ( bakeNodes && scene->mRootNode)
+        collectInstances( scene->mRootNode, xf, insts);
+    else
+    {
+        for ( uint i = 0; i < scene->mNumMeshes; ++i)
+            insts.push_back( MeshInstance( i, xf));
+    }   // end else
+    return insts;
+}   // end meshInstances
+
+
+int setObjectFaces( const aiMesh* mesh, const std::vector<float>& vpos, std::vector<int>& fids, int& nonTriangles, ObjModel::Ptr model)
 {
     IntSet faceSet;
     const int nfaces = (int)mesh->mNumFaces;
@@ -136,16 +213,19 @@ int setObjectFaces( const aiMesh* mesh, std::vector<int>& fids, int& nonTriangle
             continue;
         }   // end if
 
-        const aiVector3D& av0 = mesh->mVertices[aiface.mIndices[0]];
-        const aiVector3D& av1 = mesh->mVertices[aiface.mIndices[1]];
-        const aiVector3D& av2 = mesh->mVertices[aiface.mIndices[2]];
+        const float* p0 = &vpos[3*aiface.mIndices[0]];
+        const float* p1 = &vpos[3*aiface.mIndices[1]];
+        const float* p2 = &vpos[3*aiface.mIndices[2]];
+        const cv::Vec3f av0( p0[0], p0[1], p0[2]);
+        const cv::Vec3f av1( p1[0], p1[1], p1[2]);
+        const cv::Vec3f av2( p2[0], p2[1], p2[2]);
 
 #ifndef NDEBUG
         // All three vertices must be unique to make a triangle, or it's not necessary (and is counted as a duplicate).
         // This shouldn't ever happen if AssImp is doing its job properly.
         if ( av0 == av1 || av1 == av2 || av2 == av0)
         {
-            std::cerr << "[ERROR] RModelIO::AssetImporter::setObjectFaces(): Triple of aiVector3D vertices are not all different!" << std::endl;
+            std::cerr << "[ERROR] RModelIO::AssetImporter::setObjectFaces(): Triple of vertices are not all different!" << std::endl;
             fids[i] = -1;
             dupFaces++;
             continue;
@@ -225,8 +305,8 @@ void setObjectTextureCoordinates( const aiMesh* mesh, int matId, const std::vect
 }   // end setObjectTextureCoordinates
 
 
-// Returns -1 if no textures loaded.
-int addMaterial( const boost::filesystem::path& ppath, const aiScene *scene, int meshIdx, ObjModel::Ptr model)
+// Returns the first of the diffuse, ambient or specular textures of the given mesh's material.
+cv::Mat loadMeshTexture( const boost::filesystem::path& ppath, const aiScene *scene, int meshIdx)
 {
     const aiMesh* mesh = scene->mMeshes[meshIdx];
     const aiMaterial* aimat = scene->mMaterials[mesh->mMaterialIndex];
@@ -239,7 +319,14 @@ int addMaterial( const boost::filesystem::path& ppath, const aiScene *scene, int
         tx = mat.ambient()[0];
     else if ( mat.loadSpecular())
         tx = mat.specular()[0];
+    return tx;
+}   // end loadMeshTexture
+
 
+// Returns -1 if no textures loaded.
+int addMaterial( const boost::filesystem::path& ppath, const aiScene *scene, int meshIdx, ObjModel::Ptr model)
+{
+    const cv::Mat tx = loadMeshTexture( ppath, scene, meshIdx);
     if ( tx.empty())
     {
         std::cerr << "\tProblem loading image textures!" << std::endl;
@@ -250,7 +337,8 @@ int addMaterial( const boost::filesystem::path& ppath, const aiScene *scene, int
 }   // end addMaterial
 
 
-ObjModel::Ptr createModel( Assimp::Importer* importer, const boost::filesystem::path& ppath, bool loadTextures, bool failOnNonTriangles)
+ObjModel::Ptr createModel( Assimp::Importer* importer, const boost::filesystem::path& ppath, bool loadTextures, bool failOnNonTriangles,
+                           const RModelIO::Transform& xf, bool bakeNodes)
 {
     const aiScene* scene = importer->GetScene();
     const uint nmaterials = scene->mNumMaterials;
@@ -260,17 +348,19 @@ ObjModel::Ptr createModel( Assimp::Importer* importer, const boost::filesystem::
     ObjModel::Ptr model = RFeatures::ObjModel::create();
 
     std::vector<int>* fidxs = new std::vector<int>;
+    std::unordered_map<uint, int> meshMats;   // Materials of meshes already added (for baked instances)
 
-    for ( uint i = 0; i < nmeshes; ++i)
+    for ( const MeshInstance& inst : meshInstances( scene, xf, bakeNodes))
     {
         fidxs->clear();
+        const uint i = inst.first;
         const aiMesh* mesh = scene->mMeshes[i];
 
         std::cerr << "=====================[ MESH " << std::setw(2) << i << " ]=====================" << std::endl;
         if ( mesh->HasFaces() && mesh->HasPositions())
         {
             int nonTriangles = 0;
-            const int dupTriangles = setObjectFaces( mesh, *fidxs, nonTriangles, model);
+            const int dupTriangles = setObjectFaces( mesh, meshPositions( mesh, inst.second), *fidxs, nonTriangles, model);
             if ( nonTriangles > 0)
             {
                 if ( failOnNonTriangles)
@@ -298,7 +388,9 @@ ObjModel::Ptr createModel( Assimp::Importer* importer, const boost::filesystem::
             if ( mesh->HasTextureCoords(0))
             {
                 // New materials are added only if they define a texture.
-                const int matId = addMaterial( ppath, scene, i, model);
+                if ( meshMats.count(i) == 0)
+                    meshMats[i] = addMaterial( ppath, scene, i, model);
+                const int matId = meshMats.at(i);
                 if ( matId >= 0)
                     setObjectTextureCoordinates( mesh, matId, *fidxs, model);
             }   // end if
@@ -313,6 +405,182 @@ ObjModel::Ptr createModel( Assimp::Importer* importer, const boost::filesystem::
 }   // end createModel
 
 
+// Copy the meshes of the imported scene into a flat mesh. Textured meshes come
+// first (one material each) followed by the meshes without a texture.
+RModelIO::FlatMesh::Ptr createFlat( Assimp::Importer* importer, const boost::filesystem::path& ppath, bool loadTextures, bool failOnNonTriangles,
+                                    const RModelIO::Transform& xf, bool bakeNodes)
+{
+    const aiScene* scene = importer->GetScene();
+    const std::vector<MeshInstance> insts = meshInstances( scene, xf, bakeNodes);
+
+    std::vector<size_t> textured, untextured;   // Indices into insts
+    std::vector<cv::Mat> txs;
+    std::unordered_map<uint, cv::Mat> meshTxs;  // Textures of meshes already loaded (for baked instances)
+    size_t nvtxs = 0;
+    size_t nfaces = 0;
+    size_t nonTriangles = 0;
+    for ( size_t k = 0; k < insts.size(); ++k)
+    {
+        const uint i = insts[k].first;
+        const aiMesh* mesh = scene->mMeshes[i];
+        if ( !mesh->HasFaces() || !mesh->HasPositions())
+            continue;
+
+        for ( uint j = 0; j < mesh->mNumFaces; ++j)
+        {
+            if ( mesh->mFaces[j].mNumIndices == 3)
+                nfaces++;
+            else
+                nonTriangles++;
+        }   // end for
+        nvtxs += mesh->mNumVertices;
+
+        cv::Mat tx;
+        if ( loadTextures && mesh->HasTextureCoords(0))
+        {
+            if ( meshTxs.count(i) == 0)
+                meshTxs[i] = loadMeshTexture( ppath, scene, i);
+            tx = meshTxs.at(i);
+        }   // end if
+        if ( tx.empty())
+            untextured.push_back(k);
+        else
+        {
+            textured.push_back(k);
+            txs.push_back(tx);
+        }   // end else
+    }   // end for
+
+    if ( nonTriangles > 0)
+    {
+        if ( failOnNonTriangles)
+        {
+            std::cerr << "[ERROR] RModelIO::AssetImporter::createFlat()"
+                      << " failed on discovery of " << nonTriangles
+                      << " non-triangular polygons." << std::endl;
+            return nullptr;
+        }   // end if
+        std::cerr << "[WARNING] RModelIO::AssetImporter::createFlat(): "
+                  << nonTriangles << " non-triangular faces found!" << std::endl;
+    }   // end if
+
+    RModelIO::FlatMesh::Ptr fmesh = RModelIO::FlatMesh::create();
+    fmesh->positions.resize( 3*nvtxs);
+    fmesh->indices.reserve( 3*nfaces);
+    if ( !textured.empty())
+        fmesh->uvs.resize( 2*nvtxs);    // One per vertex (zero for untextured meshes)
+    fmesh->textures = txs;
+
+    std::vector<size_t> order = textured;
+    order.insert( order.end(), untextured.begin(), untextured.end());
+    uint32_t voff = 0;
+    for ( size_t k = 0; k < order.size(); ++k)
+    {
+        if ( k < textured.size())   // Start of material k
+            fmesh->materialOffsets.push_back( uint32_t( fmesh->indices.size() / 3));
+
+        const MeshInstance& inst = insts[order[k]];
+        const aiMesh* mesh = scene->mMeshes[inst.first];
+        float* vpos = &fmesh->positions[3*voff];
+        copyVectors( vpos, mesh->mVertices, mesh->mNumVertices, 3);
+        inst.second.apply( vpos, mesh->mNumVertices, vpos);
+        if ( k < textured.size())
+            copyVectors( &fmesh->uvs[2*voff], mesh->mTextureCoords[0], mesh->mNumVertices, 2);
+
+        for ( uint j = 0; j < mesh->mNumFaces; ++j)
+        {
+            const aiFace& aiface = mesh->mFaces[j];
+            if ( aiface.mNumIndices != 3)
+                continue;
+            fmesh->indices.push_back( voff + aiface.mIndices[0]);
+            fmesh->indices.push_back( voff + aiface.mIndices[1]);
+            fmesh->indices.push_back( voff + aiface.mIndices[2]);
+        }   // end for
+        voff += mesh->mNumVertices;
+
+        if ( k + 1 == textured.size())  // End of the last material
+            fmesh->materialOffsets.push_back( uint32_t( fmesh->indices.size() / 3));
+    }   // end for
+
+    return fmesh;
+}   // end createFlat
+
+
+// Serves compressed files to Assimp decompressed in memory. The model file (requested by its
+// name without the compression suffix) is always read from the given compressed file. Other
+// files (e.g. materials) are read uncompressed if present, or else from a compressed version.
+class CompressedIOSystem : public Assimp::DefaultIOSystem
+{
+public:
+    CompressedIOSystem( const std::string& fname, const std::string& cfname) : _fname(fname), _cfname(cfname) {}
+
+    bool Exists( const char* f) const override
+    {
+        return Assimp::DefaultIOSystem::Exists(f) || !compressedFile(f).empty();
+    }   // end Exists
+
+    Assimp::IOStream* Open( const char* f, const char* mode="rb") override
+    {
+        const std::string cf = compressedFile(f);
+        if ( cf.empty() || mode[0] != 'r')
+            return Assimp::DefaultIOSystem::Open( f, mode);
+
+        std::vector<char> data;
+        if ( !RModelIO::readCompressed( cf, RModelIO::compressionOf( cf), data))
+            return nullptr;
+        uint8_t* buf = new uint8_t[data.size()];
+        std::copy( data.begin(), data.end(), buf);
+        return new Assimp::MemoryIOStream( buf, data.size(), true);  // Takes ownership of buf
+    }   // end Open
+
+private:
+    const std::string _fname;
+    const std::string _cfname;
+
+    // Returns the compressed file to read for f or empty if f should be read as is.
+    std::string compressedFile( const char* f) const
+    {
+        if ( _fname == f)
+            return _cfname;
+        if ( Assimp::DefaultIOSystem::Exists(f))
+            return "";
+        for ( RModelIO::Compression c : { RModelIO::GZIP, RModelIO::ZSTD})
+        {
+            const std::string cf = std::string(f) + RModelIO::compressionSuffix(c);
+            if ( RModelIO::compressionAvailable(c) && boost::filesystem::exists( cf))
+                return cf;
+        }   // end for
+        return "";
+    }   // end compressedFile
+};  // end class
+
+
+// Read the file into the common AssImp format returning the scene or null on failure.
+const aiScene* readScene( Assimp::Importer* importer, const std::string& fname)
+{
+    importer->SetPropertyInteger( AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);
+
+    // Assimp identifies the format by extension so compressed files are requested without the
+    // compression suffix and are decompressed by the IO system (which the importer deletes).
+    const std::string sname = RModelIO::stripCompression( fname);
+    if ( sname != fname)
+        importer->SetIOHandler( new CompressedIOSystem( sname, fname));
+
+    importer->ReadFile( sname, aiProcess_Triangulate
+                             | aiProcess_SortByPType
+                             | aiProcess_JoinIdenticalVertices
+                             | aiProcess_RemoveRedundantMaterials
+                             | aiProcess_OptimizeMeshes
+                             | aiProcess_FindDegenerates
+                             | aiProcess_FindInvalidData
+                             //| aiProcess_OptimizeGraph
+                             //| aiProcess_FixInfacingNormals
+                             //| aiProcess_FindInstances
+                             );
+    return importer->GetScene();
+}   // end readScene
+
+
 std::string getImporterSuffix( const Assimp::Importer* importer, size_t i)
 {
     const aiImporterDesc* adesc = importer->GetImporterInfo(i);
@@ -338,7 +606,7 @@ std::string getImporterDescription( const Assimp::Importer* importer, size_t i)
 // public
 AssetImporter::AssetImporter( bool loadTextures, bool failOnNonTriangles)
     : RModelIO::ObjModelImporter(),
-      _loadTextures(loadTextures), _failOnNonTriangles(failOnNonTriangles)
+      _loadTextures(loadTextures), _failOnNonTriangles(failOnNonTriangles), _bakeNodes(false)
 {
     std::unordered_set<std::string> disallowed;
     disallowed.insert("3d");
@@ -396,31 +664,23 @@ bool AssetImporter::enableFormat( const std::string& ext)
 }   // end enableFormat
 
 
-// public
-ObjModel::Ptr AssetImporter::doLoad( const std::string& fname)
+// protected
+std::string AssetImporter::optionsKey() const
 {
-    Assimp::Importer* importer = new Assimp::Importer;
-    importer->SetPropertyInteger( AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);
+    return std::string(_loadTextures ? "T" : "t") + (_failOnNonTriangles ? "F" : "f") + (_bakeNodes ? "B" : "b");
+}   // end optionsKey
 
-    // Read the file into the common AssImp format.
-    importer->ReadFile( fname, aiProcess_Triangulate
-                             | aiProcess_SortByPType
-                             | aiProcess_JoinIdenticalVertices
-                             | aiProcess_RemoveRedundantMaterials
-                             | aiProcess_OptimizeMeshes
-                             | aiProcess_FindDegenerates
-                             | aiProcess_FindInvalidData
-                             //| aiProcess_OptimizeGraph
-                             //| aiProcess_FixInfacingNormals
-                             //| aiProcess_FindInstances
-                             );
 
+// protected
+ObjModel::Ptr AssetImporter::doLoad( const std::string& fname)
+{
+    Assimp::Importer* importer = new Assimp::Importer;
     ObjModel::Ptr model;
-    if ( !importer->GetScene())
+    if ( !readScene( importer, fname))
         setErr( "Unable to read 3D scene into importer from " + fname);
     else
     {
-        model = createModel( importer, boost::filesystem::path( fname).parent_path(), _loadTextures, _failOnNonTriangles);
+        model = createModel( importer, boost::filesystem::path( fname).parent_path(), _loadTextures, _failOnNonTriangles, transform(), _bakeNodes);
         if (model == nullptr)
             setErr( "Unable to translate imported model into standard format!");
         importer->FreeScene();
@@ -430,3 +690,23 @@ ObjModel::Ptr AssetImporter::doLoad( const std::string& fname)
     return model;
 }   // end doLoad
 
+
+
+// protected
+RModelIO::FlatMesh::Ptr AssetImporter::doLoadFlat( const std::string& fname)
+{
+    Assimp::Importer* importer = new Assimp::Importer;
+    FlatMesh::Ptr mesh;
+    if ( !readScene( importer, fname))
+        setErr( "Unable to read 3D scene into importer from " + fname);
+    else
+    {
+        mesh = createFlat( importer, boost::filesystem::path( fname).parent_path(), _loadTextures, _failOnNonTriangles, transform(), _bakeNodes);
+        if ( !mesh)
+            setErr( "Unable to translate imported model into flat arrays!");
+        importer->FreeScene();
+    }   // end else
+
+    delete importer;
+    return mesh;
+}   // end doLoadFlat
@@ -0,0 +1,266 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include <Compression.h>
+#include <boost/algorithm/string.hpp>
+#include <boost/iostreams/copy.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/device/file.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <algorithm>
+#include <fstream>
+#include <thread>
+#ifdef RMODELIO_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+
+namespace {
+
+const std::string GZ = ".gz";
+const std::string ZST = ".zst";
+
+
+bool copyStream( std::istream& is, std::ostream& os)
+{
+    std::vector<char> buf( 1 << 16);
+    while ( is)
+    {
+        is.read( buf.data(), buf.size());
+        os.write( buf.data(), is.gcount());
+    }   // end while
+    return is.eof() && os.good();
+}   // end copyStream
+
+
+#ifdef RMODELIO_WITH_ZSTD
+// Stream buffer that compresses everything written to it into another stream.
+class ZstdOutBuf : public std::streambuf
+{
+public:
+    explicit ZstdOutBuf( std::ostream& os)
+        : _os(os), _in( ZSTD_CStreamInSize()), _out( ZSTD_CStreamOutSize()), _ok(true)
+    {
+        const int nworkers = int( std::min<unsigned>( 4, std::thread::hardware_concurrency()));
+        _cctx = ZSTD_createCCtx();
+        ZSTD_CCtx_setParameter( _cctx, ZSTD_c_compressionLevel, 3);
+        ZSTD_CCtx_setParameter( _cctx, ZSTD_c_nbWorkers, nworkers);   // Fails harmlessly if zstd built single threaded
+        setp( _in.data(), _in.data() + _in.size());
+    }   // end ctor
+
+    ~ZstdOutBuf() override { ZSTD_freeCCtx( _cctx);}
+
+    bool finish() { return _compress( ZSTD_e_end);}
+
+protected:
+    int overflow( int c) override
+    {
+        if ( !_compress( ZSTD_e_continue))
+            return traits_type::eof();
+        if ( !traits_type::eq_int_type( c, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }   // end if
+        return traits_type::not_eof(c);
+    }   // end overflow
+
+    int sync() override { return _compress( ZSTD_e_flush) ? 0 : -1;}
+
+private:
+    std::ostream& _os;
+    std::vector<char> _in;
+    std::vector<char> _out;
+    ZSTD_CCtx* _cctx;
+    bool _ok;
+
+    bool _compress( ZSTD_EndDirective mode)
+    {
+        ZSTD_inBuffer in = { _in.data(), size_t( pptr() - pbase()), 0};
+        bool done = false;
+        while ( _ok && !done)
+        {
+            ZSTD_outBuffer out = { _out.data(), _out.size(), 0};
+            const size_t remaining = ZSTD_compressStream2( _cctx, &out, &in, mode);
+            if ( ZSTD_isError( remaining))
+                _ok = false;
+            else
+            {
+                _os.write( _out.data(), out.pos);
+                done = mode == ZSTD_e_continue ? in.pos == in.size : remaining == 0;
+            }   // end else
+        }   // end while
+        setp( _in.data(), _in.data() + _in.size());
+        _ok = _ok && _os.good();
+        return _ok;
+    }   // end _compress
+};  // end class
+
+
+bool readZstd( const std::string& fname, std::vector<char>& out)
+{
+    std::ifstream ifs( fname.c_str(), std::ios::in | std::ios::binary);
+    if ( !ifs.is_open())
+        return false;
+
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+    std::vector<char> ibuf( ZSTD_DStreamInSize());
+    std::vector<char> obuf( ZSTD_DStreamOutSize());
+    bool ok = true;
+    size_t last = 1;    // Non-zero until a frame has been completely decoded and flushed
+    while ( ok && ifs)
+    {
+        ifs.read( ibuf.data(), ibuf.size());
+        ZSTD_inBuffer in = { ibuf.data(), size_t( ifs.gcount()), 0};
+        bool full = false;  // Output buffer filled so more may be waiting to be flushed
+        while ( ok && (in.pos < in.size || full))
+        {
+            ZSTD_outBuffer ob = { obuf.data(), obuf.size(), 0};
+            last = ZSTD_decompressStream( dctx, &ob, &in);
+            ok = !ZSTD_isError( last);
+            out.insert( out.end(), obuf.data(), obuf.data() + ob.pos);
+            full = ob.pos == ob.size;
+        }   // end while
+    }   // end while
+    ZSTD_freeDCtx( dctx);
+    return ok && ifs.eof() && last == 0;   // A truncated frame leaves last > 0
+}   // end readZstd
+#endif
+
+}   // end namespace
+
+
+RModelIO::Compression RModelIO::compressionOf( const std::string& fname)
+{
+    const std::string lname = boost::algorithm::to_lower_copy( fname);
+    if ( boost::algorithm::ends_with( lname, GZ))
+        return GZIP;
+    if ( boost::algorithm::ends_with( lname, ZST))
+        return ZSTD;
+    return NO_COMPRESSION;
+}   // end compressionOf
+
+
+std::string RModelIO::stripCompression( const std::string& fname)
+{
+    return fname.substr( 0, fname.size() - compressionSuffix( compressionOf( fname)).size());
+}   // end stripCompression
+
+
+std::string RModelIO::compressionSuffix( Compression c)
+{
+    if ( c == GZIP)
+        return GZ;
+    if ( c == ZSTD)
+        return ZST;
+    return "";
+}   // end compressionSuffix
+
+
+bool RModelIO::compressionAvailable( Compression c)
+{
+#ifdef RMODELIO_WITH_ZSTD
+    const bool haveZstd = true;
+#else
+    const bool haveZstd = false;
+#endif
+    return c != ZSTD || haveZstd;
+}   // end compressionAvailable
+
+
+bool RModelIO::readCompressed( const std::string& fname, Compression c, std::vector<char>& out)
+{
+    out.clear();
+    try
+    {
+        if ( c == GZIP)
+        {
+            namespace bio = boost::iostreams;
+            bio::filtering_istream fis;
+            fis.push( bio::gzip_decompressor());
+            fis.push( bio::file_source( fname, std::ios::in | std::ios::binary));
+            if ( !fis.component<bio::file_source>(1)->is_open())
+                return false;
+            bio::copy( fis, bio::back_inserter( out));
+            return true;
+        }   // end if
+#ifdef RMODELIO_WITH_ZSTD
+        if ( c == ZSTD)
+            return readZstd( fname, out);
+#endif
+        if ( c == NO_COMPRESSION)
+        {
+            std::ifstream ifs( fname.c_str(), std::ios::in | std::ios::binary);
+            out.assign( std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+            return ifs.is_open();
+        }   // end if
+    }   // end try
+    catch ( const std::exception& e)
+    {
+        std::cerr << "[ERROR] RModelIO::readCompressed: " << fname << " : " << e.what() << std::endl;
+    }   // end catch
+    return false;
+}   // end readCompressed
+
+
+bool RModelIO::writeCompressed( std::ostream& os, Compression c, const std::function<bool( std::ostream&)>& writer)
+{
+    try
+    {
+        if ( c == GZIP)
+        {
+            namespace bio = boost::iostreams;
+            bio::filtering_ostream fos;
+            fos.push( bio::gzip_compressor());
+            fos.push( os);
+            const bool ok = writer( fos) && fos.good();
+            fos.reset();    // Flush and write the gzip footer
+            return ok && os.good();
+        }   // end if
+#ifdef RMODELIO_WITH_ZSTD
+        if ( c == ZSTD)
+        {
+            ZstdOutBuf zbuf( os);
+            std::ostream zos( &zbuf);
+            const bool ok = writer( zos) && zos.good();
+            return zbuf.finish() && ok;
+        }   // end if
+#endif
+        if ( c == NO_COMPRESSION)
+            return writer( os) && os.good();
+    }   // end try
+    catch ( const std::exception& e)
+    {
+        std::cerr << "[ERROR] RModelIO::writeCompressed: " << e.what() << std::endl;
+    }   // end catch
+    return false;
+}   // end writeCompressed
+
+
+bool RModelIO::compressFile( const std::string& src, const std::string& fname, Compression c)
+{
+    std::ifstream ifs( src.c_str(), std::ios::in | std::ios::binary);
+    if ( !ifs.is_open())
+        return false;
+    std::ofstream ofs( fname.c_str(), std::ios::out | std::ios::binary);
+    if ( !ofs.is_open())
+        return false;
+    const bool ok = writeCompressed( ofs, c, [&ifs]( std::ostream& os){ return copyStream( ifs, os);});
+    ofs.close();
+    return ok && !ofs.fail();
+}   // end compressFile
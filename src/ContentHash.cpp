@@ -0,0 +1,177 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include <ContentHash.h>
+#include <MeshView.h>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+const uint64_t P1 = 0x9E3779B185EBCA87ULL;
+const uint64_t P2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t P3 = 0x165667B19E3779F9ULL;
+const uint64_t P4 = 0x85EBCA77C2B2AE63ULL;
+
+inline uint64_t rotl( uint64_t x, int r) { return (x << r) | (x >> (64 - r));}
+
+inline uint64_t read64( const unsigned char* p)
+{
+    uint64_t v;
+    std::memcpy( &v, p, 8);
+    return v;
+}   // end read64
+
+inline uint64_t mix( uint64_t acc, uint64_t v) { return rotl( acc + v * P2, 31) * P1;}
+
+inline uint64_t merge( uint64_t h, uint64_t acc) { return (h ^ mix( 0, acc)) * P1 + P4;}
+
+}   // end namespace
+
+
+// Four independent accumulators over 32 byte stripes so the loop pipelines well.
+uint64_t RModelIO::hashBytes( const void* data, size_t n, uint64_t seed)
+{
+    const unsigned char* p = static_cast<const unsigned char*>( data);
+    const unsigned char* end = p + n;
+    uint64_t h;
+
+    if ( n >= 32)
+    {
+        uint64_t a0 = seed + P1 + P2;
+        uint64_t a1 = seed + P2;
+        uint64_t a2 = seed;
+        uint64_t a3 = seed - P1;
+        const unsigned char* lim = end - 32;
+        do
+        {
+            a0 = mix( a0, read64(p));
+            a1 = mix( a1, read64(p+8));
+            a2 = mix( a2, read64(p+16));
+            a3 = mix( a3, read64(p+24));
+            p += 32;
+        } while ( p <= lim);
+
+        h = rotl(a0, 1) + rotl(a1, 7) + rotl(a2, 12) + rotl(a3, 18);
+        h = merge( h, a0);
+        h = merge( h, a1);
+        h = merge( h, a2);
+        h = merge( h, a3);
+    }   // end if
+    else
+        h = seed + P3;
+
+    h += uint64_t(n);
+
+    for ( ; p + 8 <= end; p += 8)
+        h = rotl( h ^ mix( 0, read64(p)), 27) * P1 + P4;
+
+    for ( ; p < end; ++p)
+        h = rotl( h ^ (uint64_t(*p) * P3), 11) * P1;
+
+    // Final avalanche
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}   // end hashBytes
+
+
+uint64_t RModelIO::hashImage( const cv::Mat& img, uint64_t seed)
+{
+    const int hdr[3] = { img.rows, img.cols, img.type()};
+    uint64_t h = hashBytes( hdr, sizeof(hdr), seed);
+    if ( img.empty())
+        return h;
+
+    const size_t rowBytes = size_t(img.cols) * img.elemSize();
+    if ( img.isContinuous())
+        return hashBytes( img.ptr(0), rowBytes * img.rows, h);
+
+    for ( int i = 0; i < img.rows; ++i)
+        h = hashBytes( img.ptr(i), rowBytes, h);
+    return h;
+}   // end hashImage
+
+
+bool RModelIO::sameImage( const cv::Mat& a, const cv::Mat& b)
+{
+    if ( a.rows != b.rows || a.cols != b.cols || a.type() != b.type())
+        return false;
+    const size_t rowBytes = size_t(a.cols) * a.elemSize();
+    for ( int i = 0; i < a.rows; ++i)
+        if ( memcmp( a.ptr(i), b.ptr(i), rowBytes) != 0)
+            return false;
+    return true;
+}   // end sameImage
+
+
+namespace {
+template <typename T>
+uint64_t hashVector( const std::vector<T>& v, uint64_t seed)
+{
+    return RModelIO::hashBytes( v.data(), v.size() * sizeof(T), seed);
+}   // end hashVector
+}   // end namespace
+
+
+uint64_t RModelIO::hashModel( const RFeatures::ObjModel& model, uint64_t seed)
+{
+    const ModelArrays arrays( model);
+    uint64_t h = hashVector( arrays.pos, seed);
+    h = hashVector( arrays.idx, h);
+    h = hashVector( arrays.uvs, h);
+    h = hashVector( arrays.uvidx, h);
+    h = hashVector( arrays.fmats, h);
+    for ( const cv::Mat& tx : arrays.view.textures)
+        h = hashImage( tx, h);
+    return h;
+}   // end hashModel
+
+
+bool RModelIO::hashFile( const std::string& fname, uint64_t& hash)
+{
+    std::ifstream ifs( fname.c_str(), std::ios::in | std::ios::binary);
+    if ( !ifs.is_open())
+        return false;
+
+    // Hash in large blocks chained through the seed.
+    static const size_t BLOCK = 1 << 20;
+    std::vector<char> buf( BLOCK);
+    hash = 0;
+    while ( ifs)
+    {
+        ifs.read( buf.data(), BLOCK);
+        const std::streamsize n = ifs.gcount();
+        if ( n > 0)
+            hash = hashBytes( buf.data(), size_t(n), hash);
+    }   // end while
+    return ifs.eof();
+}   // end hashFile
+
+
+std::string RModelIO::hashString( uint64_t h)
+{
+    std::ostringstream oss;
+    oss << std::hex << std::setw(16) << std::setfill('0') << h;
+    return oss.str();
+}   // end hashString
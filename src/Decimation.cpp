@@ -0,0 +1,308 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include <Decimation.h>
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+using RModelIO::MeshView;
+using RModelIO::FlatMesh;
+
+
+namespace {
+
+const uint32_t MAX_RES = 1 << 20;   // Cell indices must fit in 21 bits
+
+// Call fn(begin,end) over subranges of [0,n) on separate threads.
+template <typename Fn>
+void parallelFor( size_t n, const Fn& fn)
+{
+    static const size_t MIN_CHUNK = 1 << 16;
+    const size_t nthreads = std::min<size_t>( std::max<unsigned>( 1, std::thread::hardware_concurrency()),
+                                              (n + MIN_CHUNK - 1) / MIN_CHUNK);
+    if ( nthreads <= 1)
+    {
+        fn( 0, n);
+        return;
+    }   // end if
+
+    const size_t chunk = (n + nthreads - 1) / nthreads;
+    std::vector<std::thread> threads;
+    for ( size_t b = 0; b < n; b += chunk)
+    {
+        const size_t e = std::min( n, b + chunk);
+        threads.push_back( std::thread( [&fn, b, e](){ fn( b, e);}));
+    }   // end for
+    for ( std::thread& t : threads)
+        t.join();
+}   // end parallelFor
+
+
+class Clustering
+{
+public:
+    explicit Clustering( const MeshView& v) : _v(v), _keys( v.nvtxs), _cids( v.nvtxs)
+    {
+        _lo[0] = _lo[1] = _lo[2] = 0;
+        float hi[3] = {0,0,0};
+        for ( size_t i = 0; i < v.nvtxs; ++i)
+        {
+            const float* p = v.position( uint32_t(i));
+            for ( int j = 0; j < 3; ++j)
+            {
+                if ( i == 0 || p[j] < _lo[j])
+                    _lo[j] = p[j];
+                if ( i == 0 || p[j] > hi[j])
+                    hi[j] = p[j];
+            }   // end for
+        }   // end for
+        _extent = std::max( std::max( hi[0] - _lo[0], hi[1] - _lo[1]), hi[2] - _lo[2]);
+        if ( _extent <= 0)
+            _extent = 1;
+    }   // end ctor
+
+    // Cluster the vertices on a grid of res cells along the longest side of the bounds
+    // returning the number of faces that aren't collapsed.
+    size_t cluster( uint32_t res)
+    {
+        _res = res;
+        const double scale = double(res) / _extent;
+        parallelFor( _v.nvtxs, [&]( size_t b, size_t e)
+        {
+            for ( size_t i = b; i < e; ++i)
+            {
+                const float* p = _v.position( uint32_t(i));
+                uint64_t key = 0;
+                for ( int j = 0; j < 3; ++j)
+                {
+                    const uint64_t c = std::min<uint64_t>( res - 1, uint64_t( std::max( 0.0, (p[j] - _lo[j]) * scale)));
+                    key |= c << (21*j);
+                }   // end for
+                _keys[i] = key;
+            }   // end for
+        });
+
+        std::unordered_map<uint64_t, uint32_t> cmap;
+        cmap.reserve( _v.nvtxs / 4);
+        for ( size_t i = 0; i < _v.nvtxs; ++i)
+            _cids[i] = cmap.insert( std::make_pair( _keys[i], uint32_t( cmap.size()))).first->second;
+        _nclusters = cmap.size();
+
+        std::mutex mtx;
+        size_t nfaces = 0;
+        parallelFor( _v.nfaces, [&]( size_t b, size_t e)
+        {
+            size_t n = 0;
+            for ( size_t f = b; f < e; ++f)
+                n += kept( f) ? 1 : 0;
+            std::lock_guard<std::mutex> lock( mtx);
+            nfaces += n;
+        });
+        return nfaces;
+    }   // end cluster
+
+    // Returns true if face f isn't collapsed by the current clustering.
+    bool kept( size_t f) const
+    {
+        const uint32_t* vidxs = &_v.indices[3*f];
+        const uint32_t a = _cids[vidxs[0]];
+        const uint32_t b = _cids[vidxs[1]];
+        const uint32_t c = _cids[vidxs[2]];
+        return a != b && b != c && a != c;
+    }   // end kept
+
+    FlatMesh::Ptr build() const;
+
+private:
+    const MeshView& _v;
+    float _lo[3];
+    float _extent;
+    uint32_t _res;
+    std::vector<uint64_t> _keys;    // Grid cell of each vertex
+    std::vector<uint32_t> _cids;    // Cluster of each vertex
+    size_t _nclusters;
+};  // end class
+
+
+// Texture coordinates are clustered by vertex cluster, material and texture coordinate cell.
+struct UVKey
+{
+    uint32_t cid;
+    int32_t mat;
+    int32_t u, v;
+    bool operator==( const UVKey& k) const { return cid == k.cid && mat == k.mat && u == k.u && v == k.v;}
+};  // end struct
+
+struct UVKeyHash
+{
+    size_t operator()( const UVKey& k) const
+    {
+        uint64_t h = k.cid;
+        h = h * 0x9E3779B185EBCA87ULL + uint32_t(k.mat);
+        h = h * 0x9E3779B185EBCA87ULL + uint32_t(k.u);
+        h = h * 0x9E3779B185EBCA87ULL + uint32_t(k.v);
+        return size_t( h ^ (h >> 29));
+    }   // end operator()
+};  // end struct
+
+
+// Kept faces are identified by their (sorted) vertex clusters and material.
+struct FaceKey
+{
+    uint32_t c[3];
+    int32_t mat;
+    bool operator==( const FaceKey& k) const { return c[0] == k.c[0] && c[1] == k.c[1] && c[2] == k.c[2] && mat == k.mat;}
+};  // end struct
+
+struct FaceKeyHash
+{
+    size_t operator()( const FaceKey& k) const
+    {
+        uint64_t h = k.c[0];
+        h = h * 0x9E3779B185EBCA87ULL + k.c[1];
+        h = h * 0x9E3779B185EBCA87ULL + k.c[2];
+        h = h * 0x9E3779B185EBCA87ULL + uint32_t(k.mat);
+        return size_t( h ^ (h >> 29));
+    }   // end operator()
+};  // end struct
+
+
+FlatMesh::Ptr Clustering::build() const
+{
+    // Cluster positions are the mean of their vertices.
+    std::vector<double> csums( 3*_nclusters, 0.0);
+    std::vector<uint32_t> ccounts( _nclusters, 0);
+    for ( size_t i = 0; i < _v.nvtxs; ++i)
+    {
+        const float* p = _v.position( uint32_t(i));
+        double* s = &csums[3*_cids[i]];
+        s[0] += p[0];
+        s[1] += p[1];
+        s[2] += p[2];
+        ccounts[_cids[i]]++;
+    }   // end for
+
+    std::vector<float> pos;
+    std::vector<uint32_t> idx, uvidx;
+    std::vector<int32_t> fmats;
+    std::vector<double> uvsums;
+    std::vector<uint32_t> uvcounts;
+    std::vector<int64_t> vmap( _nclusters, -1);    // Cluster to output vertex
+    std::unordered_map<UVKey, uint32_t, UVKeyHash> uvmap;
+    std::unordered_set<FaceKey, FaceKeyHash> fkeys;
+
+    for ( size_t f = 0; f < _v.nfaces; ++f)
+    {
+        if ( !kept( f))
+            continue;
+
+        // Skip faces collapsed onto the same clusters as an earlier face with the same material.
+        const int m = _v.material(f);
+        FaceKey fkey{ { _cids[_v.indices[3*f]], _cids[_v.indices[3*f+1]], _cids[_v.indices[3*f+2]]}, m};
+        std::sort( fkey.c, fkey.c + 3);
+        if ( !fkeys.insert( fkey).second)
+            continue;
+
+        fmats.push_back( m);
+        for ( int i = 0; i < 3; ++i)
+        {
+            const uint32_t c = _cids[_v.indices[3*f+i]];
+            if ( vmap[c] < 0)
+            {
+                vmap[c] = int64_t( pos.size() / 3);
+                const double* s = &csums[3*c];
+                pos.insert( pos.end(), { float(s[0]/ccounts[c]), float(s[1]/ccounts[c]), float(s[2]/ccounts[c])});
+            }   // end if
+            idx.push_back( uint32_t( vmap[c]));
+
+            uint32_t uvi = 0;
+            if ( m >= 0)
+            {
+                const float* uv = _v.uv( _v.uvIndex( f, i));
+                const UVKey key{ c, m, int32_t( std::floor( uv[0] * _res)), int32_t( std::floor( uv[1] * _res))};
+                uvi = uvmap.insert( std::make_pair( key, uint32_t( uvcounts.size()))).first->second;
+                if ( uvi == uvcounts.size())
+                {
+                    uvsums.insert( uvsums.end(), { 0.0, 0.0});
+                    uvcounts.push_back( 0);
+                }   // end if
+                uvsums[2*uvi] += uv[0];
+                uvsums[2*uvi+1] += uv[1];
+                uvcounts[uvi]++;
+            }   // end if
+            uvidx.push_back( uvi);
+        }   // end for
+    }   // end for
+
+    std::vector<float> uvs( uvsums.size());
+    for ( size_t i = 0; i < uvcounts.size(); ++i)
+    {
+        uvs[2*i] = float( uvsums[2*i] / uvcounts[i]);
+        uvs[2*i+1] = float( uvsums[2*i+1] / uvcounts[i]);
+    }   // end for
+
+    MeshView view;
+    view.positions = pos.data();
+    view.nvtxs = pos.size() / 3;
+    view.indices = idx.data();
+    view.nfaces = idx.size() / 3;
+    if ( !uvs.empty())
+    {
+        view.textures = _v.textures;
+        view.uvs = uvs.data();
+        view.nuvs = uvs.size() / 2;
+        view.uvIndices = uvidx.data();
+        view.faceMaterials = fmats.data();
+    }   // end if
+    return FlatMesh::create( view);
+}   // end build
+
+}   // end namespace
+
+
+FlatMesh::Ptr RModelIO::decimate( const MeshView& v, size_t maxFaces)
+{
+    if ( v.nfaces <= maxFaces)
+        return FlatMesh::create( v);
+
+    // Find (to within a few percent) the finest grid keeping at most maxFaces faces.
+    Clustering clustering( v);
+    uint32_t lo = 1;
+    uint32_t hi = 2;
+    while ( hi < MAX_RES && clustering.cluster( hi) <= maxFaces)
+    {
+        lo = hi;
+        hi *= 2;
+    }   // end while
+
+    while ( hi - lo > std::max<uint32_t>( 1, lo / 32))
+    {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if ( clustering.cluster( mid) <= maxFaces)
+            lo = mid;
+        else
+            hi = mid;
+    }   // end while
+
+    // Even the coarsest grid may keep too many faces (leaving lo at 1 which collapses all).
+    if ( clustering.cluster( lo) == 0)
+        return nullptr;
+    return clustering.build();
+}   // end decimate
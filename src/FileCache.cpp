@@ -0,0 +1,203 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include <FileCache.h>
+#include <boost/filesystem/operations.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <mutex>
+using RModelIO::FileCache;
+using RModelIO::FileSink;
+namespace bfs = boost::filesystem;
+
+namespace {
+
+const char* LOCK_FILE = ".lock";
+const std::time_t STALE_TEMP_SECS = 3600;   // Temporary files older than this are from crashed writers
+
+// File locks (fcntl) are held per process so don't exclude other threads of this one.
+std::mutex& trimMutex()
+{
+    static std::mutex mtx;
+    return mtx;
+}   // end trimMutex
+
+struct Entry
+{
+    bfs::path path;
+    uintmax_t size;
+    std::time_t mtime;
+};  // end struct
+
+}   // end namespace
+
+
+// public static
+FileCache::Ptr FileCache::create( const std::string& dir, const std::string& ext, uint64_t maxBytes)
+{
+    boost::system::error_code ec;
+    const bfs::path dpath = bfs::absolute( dir);
+    bfs::create_directories( dpath, ec);
+    if ( !bfs::is_directory( dpath))
+        return nullptr;
+    std::ofstream( (dpath / LOCK_FILE).string().c_str(), std::ios::app);   // file_lock requires an existing file
+    return Ptr( new FileCache( dpath.string(), ext, maxBytes));
+}   // end create
+
+
+// private
+FileCache::FileCache( const std::string& dir, const std::string& ext, uint64_t maxBytes)
+    : _dir(dir), _ext(ext), _maxBytes(maxBytes), _hits(0), _misses(0), _stores(0), _invalidations(0), _evictions(0)
+{
+}   // end ctor
+
+
+// private
+std::string FileCache::_path( const std::string& key) const
+{
+    return (bfs::path(_dir) / (key + _ext)).string();
+}   // end _path
+
+
+// public
+std::string FileCache::lookup( const std::string& key)
+{
+    const std::string fname = _path( key);
+    boost::system::error_code ec;
+    bfs::last_write_time( fname, std::time(nullptr), ec);   // Fails if not present
+    if ( ec)
+    {
+        _misses++;
+        return "";
+    }   // end if
+    _hits++;
+    return fname;
+}   // end lookup
+
+
+// public
+void FileCache::invalidate( const std::string& key)
+{
+    boost::system::error_code ec;
+    bfs::remove( _path( key), ec);
+    _invalidations++;
+}   // end invalidate
+
+
+// public
+bool FileCache::insert( const std::string& key, const FileSink::Writer& writer)
+{
+    return insertFile( key, [writer]( const std::string& f)
+            {
+                std::ofstream ofs( f.c_str(), std::ios::out | std::ios::binary);
+                if ( !ofs.is_open())
+                    return false;
+                const bool ok = writer( ofs);
+                ofs.close();
+                return ok && !ofs.fail();
+            });
+}   // end insert
+
+
+// public
+bool FileCache::insertFile( const std::string& key, const FileSink::Task& task)
+{
+    bool ok = false;
+    try
+    {
+        ok = FileSink::writeAtomic( _path( key), task);
+    }   // end try
+    catch ( const std::exception&)
+    {
+        ok = false;
+    }   // end catch
+
+    if ( ok)
+    {
+        _stores++;
+        trim();
+    }   // end if
+    return ok;
+}   // end insertFile
+
+
+// public
+void FileCache::trim()
+{
+    using boost::interprocess::file_lock;
+    std::lock_guard<std::mutex> lock( trimMutex());
+    try
+    {
+        file_lock flock( (bfs::path(_dir) / LOCK_FILE).string().c_str());
+        if ( !flock.try_lock())
+            return;     // Another process is trimming
+
+        const std::time_t now = std::time(nullptr);
+        std::vector<Entry> entries;
+        uint64_t total = 0;
+        boost::system::error_code ec;
+        for ( bfs::directory_iterator it( _dir, ec), end; !ec && it != end; it.increment(ec))
+        {
+            const bfs::path& p = it->path();
+            if ( !bfs::is_regular_file( p, ec))
+                continue;
+            const std::time_t mtime = bfs::last_write_time( p, ec);
+            if ( ec)
+                continue;
+            const std::string ext = p.extension().string();
+            if ( ext == ".tmp")
+            {
+                if ( now - mtime > STALE_TEMP_SECS)
+                    bfs::remove( p, ec);
+                continue;
+            }   // end if
+            if ( ext != _ext)
+                continue;
+            const uintmax_t sz = bfs::file_size( p, ec);
+            if ( ec)
+                continue;
+            entries.push_back( Entry{ p, sz, mtime});
+            total += sz;
+        }   // end for
+
+        if ( total <= _maxBytes)
+            return;
+
+        std::sort( entries.begin(), entries.end(), []( const Entry& a, const Entry& b){ return a.mtime < b.mtime;});
+        for ( const Entry& e : entries)
+        {
+            if ( total <= _maxBytes)
+                break;
+            if ( bfs::remove( e.path, ec))  // Open readers keep their handles on POSIX systems
+                _evictions++;
+            total -= e.size;
+        }   // end for
+    }   // end try
+    catch ( const std::exception& e)
+    {
+        std::cerr << "[WARNING] RModelIO::FileCache::trim: " << e.what() << std::endl;
+    }   // end catch
+}   // end trim
+
+
+// public
+FileCache::Stats FileCache::stats() const
+{
+    return Stats{ _hits, _misses, _stores, _invalidations, _evictions};
+}   // end stats
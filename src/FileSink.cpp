@@ -0,0 +1,310 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include <FileSink.h>
+#include <boost/filesystem/operations.hpp>
+#include <boost/version.hpp>
+#include <algorithm>
+#include <fstream>
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+using RModelIO::FileSink;
+
+
+// public static
+FileSink::Ptr FileSink::create( size_t nthreads, size_t maxPending)
+{
+    return Ptr( new FileSink( nthreads, maxPending));
+}   // end create
+
+
+// public
+FileSink::FileSink( size_t nthreads, size_t maxPending)
+    : _maxPending( std::max<size_t>( 1, maxPending)), _active(0), _stop(false)
+{
+    if ( nthreads == 0)
+        nthreads = std::min<size_t>( 4, std::max<unsigned>( 1, std::thread::hardware_concurrency()));
+    for ( size_t i = 0; i < nthreads; ++i)
+        _workers.push_back( std::thread( &FileSink::_work, this));
+}   // end ctor
+
+
+// public
+FileSink::~FileSink()
+{
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }   // end lock
+    _jobAdded.notify_all();
+    for ( std::thread& t : _workers)
+        t.join();
+}   // end dtor
+
+
+// public
+void FileSink::add( const std::string& fname, const Writer& writer)
+{
+    _push( Job{ fname, writer, Task(), "", false});
+}   // end add
+
+
+// public
+void FileSink::addTask( const std::string& fname, const Task& task)
+{
+    _push( Job{ fname, Writer(), task, "", false});
+}   // end addTask
+
+
+// public
+void FileSink::addCopy( const std::string& src, const std::string& fname, bool allowHardLink)
+{
+    _push( Job{ fname, Writer(), Task(), src, allowHardLink});
+}   // end addCopy
+
+
+// public
+void FileSink::setCompression( const std::string& fname, Compression c)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if ( c == NO_COMPRESSION)
+        _compress.erase( fname);
+    else
+        _compress[fname] = c;
+}   // end setCompression
+
+
+namespace {
+
+// Run task on a temporary file (with the same name in the same directory
+// so the extension is preserved) then compress the temporary into fname.
+bool compressTask( const std::string& fname, RModelIO::Compression c, const FileSink::Task& task)
+{
+    namespace bfs = boost::filesystem;
+    const bfs::path fpath( fname);
+    const bfs::path tmpdir = fpath.parent_path() / bfs::unique_path( ".%%%%-%%%%-%%%%");
+    boost::system::error_code ec;
+    if ( !bfs::create_directory( tmpdir, ec))
+        return false;
+    const std::string tmpname = (tmpdir / RModelIO::stripCompression( fpath.filename().string())).string();
+    const bool ok = task( tmpname) && RModelIO::compressFile( tmpname, fname, c);
+    bfs::remove_all( tmpdir, ec);
+    return ok;
+}   // end compressTask
+
+
+#ifdef __linux__
+// Try to make fname a copy-on-write clone of src (e.g. on btrfs or XFS).
+bool reflinkFile( const std::string& src, const std::string& fname)
+{
+#ifdef FICLONE
+    const int sfd = ::open( src.c_str(), O_RDONLY);
+    if ( sfd < 0)
+        return false;
+    const int dfd = ::open( fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if ( dfd < 0)
+    {
+        ::close( sfd);
+        return false;
+    }   // end if
+    const bool cloned = ::ioctl( dfd, FICLONE, sfd) == 0;
+    ::close( dfd);
+    ::close( sfd);
+    if ( !cloned)
+        ::unlink( fname.c_str());
+    return cloned;
+#else
+    return false;
+#endif
+}   // end reflinkFile
+#endif
+
+}   // end namespace
+
+
+// public static
+bool FileSink::transferFile( const std::string& src, const std::string& fname, bool allowHardLink)
+{
+    namespace bfs = boost::filesystem;
+    boost::system::error_code ec;
+    if ( bfs::equivalent( src, fname, ec))
+        return true;
+    bfs::remove( fname, ec);
+
+    if ( allowHardLink)
+    {
+        bfs::create_hard_link( src, fname, ec);
+        if ( !ec)
+            return true;
+    }   // end if
+
+#ifdef __linux__
+    if ( reflinkFile( src, fname))
+        return true;
+#endif
+
+#if BOOST_VERSION >= 107400
+    bfs::copy_file( src, fname, bfs::copy_options::overwrite_existing, ec);
+#else
+    bfs::copy_file( src, fname, bfs::copy_option::overwrite_if_exists, ec);   // Deprecated from Boost 1.74
+#endif
+    return !ec;
+}   // end transferFile
+
+
+// public static
+bool FileSink::writeAtomic( const std::string& fname, const Task& task)
+{
+    namespace bfs = boost::filesystem;
+    const bfs::path fpath( fname);
+    const bfs::path tmppath = fpath.parent_path() / bfs::unique_path( fpath.filename().string() + ".%%%%-%%%%.tmp");
+    boost::system::error_code ec;
+    if ( !task( tmppath.string()))
+    {
+        bfs::remove( tmppath, ec);
+        return false;
+    }   // end if
+
+    bfs::rename( tmppath, fpath, ec);
+    if ( ec)
+    {
+        bfs::remove( tmppath, ec);
+        return bfs::exists( fpath);   // Another process may have written the same file
+    }   // end if
+    return true;
+}   // end writeAtomic
+
+
+// public
+bool FileSink::wait()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _jobsDone.wait( lock, [this](){ return _jobs.empty() && _active == 0;});
+    _err = "";
+    for ( const std::string& e : _errs)
+        _err += (_err.empty() ? "" : "; ") + e;
+    _errs.clear();
+    return _err.empty();
+}   // end wait
+
+
+// protected virtual
+bool FileSink::writeFile( const std::string& fname, const Writer& writer)
+{
+    std::ofstream ofs( fname.c_str(), std::ios::out | std::ios::binary);
+    if ( !ofs.is_open())
+        return false;
+    const bool ok = writer( ofs);
+    ofs.close();
+    return ok && !ofs.fail();
+}   // end writeFile
+
+
+// protected virtual
+bool FileSink::runTask( const std::string& fname, const Task& task) { return task( fname);}
+
+
+// protected virtual
+bool FileSink::copyFile( const std::string& src, const std::string& fname, bool allowHardLink)
+{
+    return transferFile( src, fname, allowHardLink);
+}   // end copyFile
+
+
+// private
+void FileSink::_push( Job&& job)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    auto cit = _compress.find( job.fname);
+    if ( cit != _compress.end())
+    {
+        const Compression c = cit->second;
+        job.fname += compressionSuffix( c);
+        if ( !job.src.empty())
+        {
+            const std::string src = job.src;
+            job.task = [src, c]( const std::string& f){ return compressFile( src, f, c);};
+            job.src = "";
+        }   // end if
+        else if ( job.task)
+        {
+            const Task task = job.task;
+            job.task = [task, c]( const std::string& f){ return compressTask( f, c, task);};
+        }   // end else if
+        else
+        {
+            const Writer writer = job.writer;
+            job.writer = [writer, c]( std::ostream& os){ return writeCompressed( os, c, writer);};
+        }   // end else
+    }   // end if
+
+    _jobTaken.wait( lock, [this](){ return _jobs.size() < _maxPending;});
+    _jobs.push_back( std::move(job));
+    lock.unlock();
+    _jobAdded.notify_one();
+}   // end _push
+
+
+// private
+void FileSink::_work()
+{
+    while ( true)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _jobAdded.wait( lock, [this](){ return _stop || !_jobs.empty();});
+        if ( _jobs.empty()) // Only when stopping
+            return;
+
+        Job job = std::move( _jobs.front());
+        _jobs.pop_front();
+        _active++;
+        lock.unlock();
+        _jobTaken.notify_one();
+
+        std::string err;
+        try
+        {
+            bool ok;
+            if ( !job.src.empty())
+                ok = copyFile( job.src, job.fname, job.link);
+            else if ( job.task)
+                ok = runTask( job.fname, job.task);
+            else
+                ok = writeFile( job.fname, job.writer);
+            if ( !ok)
+                err = "Unable to write " + job.fname;
+        }   // end try
+        catch ( const std::exception& e)
+        {
+            err = "Unable to write " + job.fname + " : " + e.what();
+        }   // end catch
+
+        lock.lock();
+        if ( !err.empty())
+            _errs.push_back( err);
+        _active--;
+        const bool done = _jobs.empty() && _active == 0;
+        lock.unlock();
+        if ( done)
+            _jobsDone.notify_all();
+    }   // end while
+}   // end _work
@@ -0,0 +1,78 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include <FlatMesh.h>
+#include <cstring>
+using RModelIO::FlatMesh;
+using RModelIO::MeshView;
+
+
+// public
+MeshView FlatMesh::view() const
+{
+    MeshView v;
+    v.positions = positions.data();
+    v.nvtxs = numVtxs();
+    v.indices = indices.data();
+    v.nfaces = numFaces();
+    if ( !uvs.empty())
+    {
+        v.uvs = uvs.data();
+        v.nuvs = uvs.size() / 2;
+    }   // end if
+    if ( !uvIndices.empty())
+        v.uvIndices = uvIndices.data();
+    if ( !materialOffsets.empty())
+        v.materialOffsets = materialOffsets.data();
+    v.textures = textures;
+    return v;
+}   // end view
+
+
+// public static
+FlatMesh::Ptr FlatMesh::create( const MeshView& v)
+{
+    Ptr mesh = create();
+    mesh->positions.resize( 3*v.nvtxs);
+    if ( v.nvtxs > 0)
+        std::memcpy( &mesh->positions[0], v.positions, mesh->positions.size() * sizeof(float));
+
+    const std::vector<std::vector<uint32_t> > mfaces = v.materialFaces();
+    const size_t nmats = v.numMaterials();
+    mesh->indices.reserve( 3*v.nfaces);
+    if ( v.uvs)
+    {
+        mesh->uvs.assign( v.uvs, v.uvs + 2*v.nuvs);
+        mesh->uvIndices.reserve( 3*v.nfaces);
+    }   // end if
+
+    mesh->materialOffsets.reserve( nmats + 1);
+    for ( size_t m = 0; m <= nmats; ++m)
+    {
+        mesh->materialOffsets.push_back( uint32_t( mesh->indices.size() / 3));
+        for ( uint32_t f : mfaces[m])
+        {
+            mesh->indices.insert( mesh->indices.end(), &v.indices[3*f], &v.indices[3*f+3]);
+            if ( v.uvs)
+                for ( int i = 0; i < 3; ++i)
+                    mesh->uvIndices.push_back( m < nmats ? v.uvIndex( f, i) : 0);
+        }   // end for
+    }   // end for
+
+    mesh->textures = v.textures;
+    return mesh;
+}   // end create
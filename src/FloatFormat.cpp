@@ -0,0 +1,104 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include <FloatFormat.h>
+#if __cplusplus >= 201703L
+#include <charconv>
+#endif
+#include <iomanip>
+#include <locale>
+#include <sstream>
+using RModelIO::FloatFormat;
+
+
+namespace {
+
+#if !defined(__cpp_lib_to_chars) || __cpp_lib_to_chars < 201611L
+// Streams in the classic locale so that output doesn't depend on the global locale.
+struct ClassicStreams
+{
+    ClassicStreams()
+    {
+        oss.imbue( std::locale::classic());
+        iss.imbue( std::locale::classic());
+    }   // end ctor
+
+    std::ostringstream oss;
+    std::istringstream iss;
+};  // end struct
+
+
+ClassicStreams& classicStreams()
+{
+    thread_local ClassicStreams streams;
+    return streams;
+}   // end classicStreams
+
+
+char* printDigits( char* buf, float v, int digits)
+{
+    std::ostringstream& oss = classicStreams().oss;
+    oss.str("");
+    oss.clear();
+    oss << std::setprecision( digits) << double(v);   // As %.*g
+    const std::string str = oss.str();
+    return std::copy_n( str.data(), std::min<size_t>( str.size(), FloatFormat::BUF_SIZE), buf);
+}   // end printDigits
+
+
+bool readsBack( const char* buf, const char* end, float v)
+{
+    std::istringstream& iss = classicStreams().iss;
+    iss.str( std::string( buf, end));
+    iss.clear();
+    float r = 0;
+    iss >> r;
+    return r == v;
+}   // end readsBack
+
+
+// A float needs at most 9 significant digits to round trip. If v reads back from
+// its 6 digit form, no shorter form exists that isn't also given by %.6g.
+char* printShortest( char* buf, float v)
+{
+    char* end = buf;
+    for ( int digits = 6; digits <= 9; ++digits)
+    {
+        end = printDigits( buf, v, digits);
+        if ( readsBack( buf, end, v))
+            break;
+    }   // end for
+    return end;
+}   // end printShortest
+#endif
+
+}   // end namespace
+
+
+// public
+char* FloatFormat::format( char* buf, float v) const
+{
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    if ( _digits == 0)
+        return std::to_chars( buf, buf + BUF_SIZE, v).ptr;
+    return std::to_chars( buf, buf + BUF_SIZE, v, std::chars_format::general, _digits).ptr;
+#else
+    if ( _digits == 0)
+        return printShortest( buf, v);
+    return printDigits( buf, v, _digits);
+#endif
+}   // end format
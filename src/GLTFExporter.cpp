@@ -0,0 +1,491 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include <GLTFExporter.h>
+#include <TextureSources.h>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <limits>
+#include <sstream>
+using RModelIO::GLTFExporter;
+using RModelIO::TextureSources;
+using RModelIO::MeshView;
+using RModelIO::Transform;
+using RFeatures::ObjModel;
+
+
+GLTFExporter::GLTFExporter( bool embedTextures)
+    : RModelIO::ObjModelExporter(), _embedTextures(embedTextures)
+{
+    addSupported( "glb", "glTF 2.0 Binary");
+    addSupported( "gltf", "glTF 2.0");
+}   // end ctor
+
+
+namespace {
+
+const int ARRAY_BUFFER = 34962;
+const int ELEMENT_ARRAY_BUFFER = 34963;
+const int FLOAT = 5126;
+const int UNSIGNED_INT = 5125;
+
+const uint32_t GLB_MAGIC = 0x46546C67;  // "glTF"
+const uint32_t GLB_JSON = 0x4E4F534A;   // "JSON"
+const uint32_t GLB_BIN = 0x004E4942;    // "BIN\0"
+
+
+// The binary buffer and its views. All views start on four byte boundaries.
+struct Buffer
+{
+    struct View
+    {
+        size_t offset;
+        size_t length;
+        int target; // 0 if none (e.g. images)
+    };  // end struct
+
+    std::vector<char> bytes;
+    std::vector<View> views;
+
+    // Append n bytes as a new view returning its index.
+    size_t add( const void* data, size_t n, int target)
+    {
+        bytes.resize( (bytes.size() + 3) & ~size_t(3), 0);
+        const size_t offset = bytes.size();
+        bytes.resize( offset + n);
+        if ( n > 0)
+            std::memcpy( &bytes[offset], data, n);
+        views.push_back( View{ offset, n, target});
+        return views.size() - 1;
+    }   // end add
+};  // end struct
+
+
+struct Primitive
+{
+    int material;   // Index of the glTF material or -1 if none
+    size_t posView;
+    size_t uvView;
+    size_t idxView;
+    size_t nvtxs;
+    size_t nidxs;
+    float min[3];
+    float max[3];
+};  // end struct
+
+
+// Pack the given faces into positions, texture coordinates (if mid >= 0) and indices, splitting
+// vertices that have different texture coordinates on different faces.
+Primitive addPrimitive( const MeshView& model, const RModelIO::Transform& xf, const std::vector<uint32_t>& fids, bool textured, int gmat, Buffer& buf)
+{
+    std::unordered_map<uint64_t, uint32_t> cmap;   // (vertex index, UV index) --> packed index
+    std::vector<float> pos;
+    std::vector<float> uvs;
+    std::vector<uint32_t> idxs;
+    pos.reserve( fids.size() * 3);
+    idxs.reserve( fids.size() * 3);
+    if ( textured)
+        uvs.reserve( fids.size() * 2);
+
+    Primitive p;
+    p.material = gmat;
+    for ( int i = 0; i < 3; ++i)
+    {
+        p.min[i] = std::numeric_limits<float>::max();
+        p.max[i] = std::numeric_limits<float>::lowest();
+    }   // end for
+
+    for ( uint32_t f : fids)
+    {
+        const uint32_t* vidxs = &model.indices[3*f];
+        for ( int i = 0; i < 3; ++i)
+        {
+            const uint32_t uvidx = textured ? model.uvIndex( f, i) : 0;
+            const uint64_t key = (uint64_t(vidxs[i]) << 32) | uvidx;
+            auto it = cmap.find(key);
+            if ( it != cmap.end())
+            {
+                idxs.push_back( it->second);
+                continue;
+            }   // end if
+
+            const uint32_t idx = uint32_t( cmap.size());
+            cmap[key] = idx;
+            idxs.push_back( idx);
+
+            const float* v = model.position( vidxs[i]);
+            pos.insert( pos.end(), v, v+3);
+
+            if ( textured)
+            {
+                const float* uv = model.uv( uvidx);
+                uvs.push_back( uv[0]);
+                uvs.push_back( 1.0f - uv[1]);   // glTF texture origin is top left
+            }   // end if
+        }   // end for
+    }   // end for
+
+    p.nvtxs = cmap.size();
+    p.nidxs = idxs.size();
+
+    // Transform the packed positions in place before finding their bounds.
+    xf.apply( pos.data(), p.nvtxs, pos.data());
+    for ( size_t i = 0; i < pos.size(); i += 3)
+    {
+        for ( int j = 0; j < 3; ++j)
+        {
+            p.min[j] = std::min( p.min[j], pos[i+j]);
+            p.max[j] = std::max( p.max[j], pos[i+j]);
+        }   // end for
+    }   // end for
+
+    p.posView = buf.add( pos.data(), pos.size() * sizeof(float), ARRAY_BUFFER);
+    p.uvView = textured ? buf.add( uvs.data(), uvs.size() * sizeof(float), ARRAY_BUFFER) : 0;
+    p.idxView = buf.add( idxs.data(), idxs.size() * sizeof(uint32_t), ELEMENT_ARRAY_BUFFER);
+    return p;
+}   // end addPrimitive
+
+
+// An encoded texture image.
+struct Image
+{
+    std::string mimeType;
+    std::string uri;            // Set if referenced
+    std::vector<char> bytes;    // Set if embedded
+    size_t view;
+};  // end struct
+
+
+std::string mimeType( const std::string& ext)
+{
+    return ext == ".png" ? "image/png" : "image/jpeg";
+}   // end mimeType
+
+
+// Returns the lower case extension of the texture's source file if it's a format glTF supports.
+std::string passThroughExtension( const cv::Mat& tx, TextureSources::Source& src)
+{
+    if ( !TextureSources::find( tx, src))
+        return "";
+    std::string ext = boost::algorithm::to_lower_copy( boost::filesystem::path( src.path).extension().string());
+    if ( ext == ".jpeg")
+        ext = ".jpg";
+    return ext == ".png" || ext == ".jpg" ? ext : "";
+}   // end passThroughExtension
+
+
+// Encode the texture (or read its unchanged source file) into memory.
+bool encodeImage( const cv::Mat& tx, Image& img)
+{
+    TextureSources::Source src;
+    const std::string ext = passThroughExtension( tx, src);
+    if ( !ext.empty())
+    {
+        std::ifstream ifs( src.path.c_str(), std::ios::in | std::ios::binary);
+        img.bytes.assign( std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+        img.mimeType = mimeType( ext);
+        if ( !img.bytes.empty())
+            return true;
+    }   // end if
+
+    std::vector<uchar> buf;
+    if ( !cv::imencode( ".png", tx, buf))
+        return false;
+    img.bytes.assign( buf.begin(), buf.end());
+    img.mimeType = "image/png";
+    return true;
+}   // end encodeImage
+
+
+std::string jsonString( const std::string& s)
+{
+    std::string js = "\"";
+    for ( char c : s)
+    {
+        if ( c == '"' || c == '\\')
+            js += '\\';
+        js += c;
+    }   // end for
+    return js + "\"";
+}   // end jsonString
+
+
+void writeJSONArray( std::ostream& os, const float* v, int n)
+{
+    os << "[";
+    for ( int i = 0; i < n; ++i)
+        os << (i > 0 ? "," : "") << v[i];
+    os << "]";
+}   // end writeJSONArray
+
+
+std::string makeJSON( const Buffer& buf, const std::string& bufuri, const std::vector<Primitive>& prims, const std::vector<Image>& imgs)
+{
+    std::ostringstream os;
+    os.precision( std::numeric_limits<float>::max_digits10);
+    os << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"RModelIO (https://github.com/richeytastic/rModelIO)\"}";
+    // A model without faces has a node without a mesh (glTF doesn't allow empty arrays).
+    os << ",\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[" << (prims.empty() ? "{}" : "{\"mesh\":0}") << "]";
+
+    // Buffer and its views
+    if ( !buf.bytes.empty())
+    {
+        os << ",\"buffers\":[{\"byteLength\":" << buf.bytes.size();
+        if ( !bufuri.empty())
+            os << ",\"uri\":" << jsonString( bufuri);
+        os << "}]";
+        os << ",\"bufferViews\":[";
+        for ( size_t i = 0; i < buf.views.size(); ++i)
+        {
+            const Buffer::View& v = buf.views[i];
+            os << (i > 0 ? "," : "") << "{\"buffer\":0,\"byteOffset\":" << v.offset << ",\"byteLength\":" << v.length;
+            if ( v.target != 0)
+                os << ",\"target\":" << v.target;
+            os << "}";
+        }   // end for
+        os << "]";
+    }   // end if
+
+    // Accessors (positions, texture coordinates and indices for each primitive)
+    std::ostringstream accs, mesh;
+    accs.precision( os.precision());
+    accs << ",\"accessors\":[";
+    mesh << ",\"meshes\":[{\"primitives\":[";
+    size_t acc = 0;
+    for ( size_t i = 0; i < prims.size(); ++i)
+    {
+        const Primitive& p = prims[i];
+        accs << (i > 0 ? "," : "");
+        accs << "{\"bufferView\":" << p.posView << ",\"componentType\":" << FLOAT << ",\"count\":" << p.nvtxs << ",\"type\":\"VEC3\",\"min\":";
+        writeJSONArray( accs, p.min, 3);
+        accs << ",\"max\":";
+        writeJSONArray( accs, p.max, 3);
+        accs << "}";
+        mesh << (i > 0 ? "," : "") << "{\"attributes\":{\"POSITION\":" << acc++;
+        if ( p.material >= 0)
+        {
+            accs << ",{\"bufferView\":" << p.uvView << ",\"componentType\":" << FLOAT << ",\"count\":" << p.nvtxs << ",\"type\":\"VEC2\"}";
+            mesh << ",\"TEXCOORD_0\":" << acc++;
+        }   // end if
+        accs << ",{\"bufferView\":" << p.idxView << ",\"componentType\":" << UNSIGNED_INT << ",\"count\":" << p.nidxs << ",\"type\":\"SCALAR\"}";
+        mesh << "},\"indices\":" << acc++;
+        if ( p.material >= 0)
+            mesh << ",\"material\":" << p.material;
+        mesh << "}";
+    }   // end for
+    accs << "]";
+    mesh << "]}]";
+    if ( !prims.empty())
+        os << accs.str() << mesh.str();
+
+    // Materials, textures and images (one to one)
+    if ( !imgs.empty())
+    {
+        os << ",\"materials\":[";
+        for ( size_t i = 0; i < imgs.size(); ++i)
+        {
+            os << (i > 0 ? "," : "") << "{\"pbrMetallicRoughness\":{\"baseColorTexture\":{\"index\":" << i
+               << "},\"metallicFactor\":0,\"roughnessFactor\":1}}";
+        }   // end for
+        os << "],\"textures\":[";
+        for ( size_t i = 0; i < imgs.size(); ++i)
+            os << (i > 0 ? "," : "") << "{\"source\":" << i << "}";
+        os << "],\"images\":[";
+        for ( size_t i = 0; i < imgs.size(); ++i)
+        {
+            if ( imgs[i].uri.empty())
+                os << (i > 0 ? "," : "") << "{\"bufferView\":" << imgs[i].view << ",\"mimeType\":" << jsonString( imgs[i].mimeType) << "}";
+            else
+                os << (i > 0 ? "," : "") << "{\"uri\":" << jsonString( imgs[i].uri) << "}";
+        }   // end for
+        os << "]";
+    }   // end if
+
+    os << "}";
+    return os.str();
+}   // end makeJSON
+
+
+void writeU32( std::ostream& os, uint32_t v)
+{
+    // glTF is little endian as are the platforms this library targets.
+    os.write( reinterpret_cast<const char*>(&v), 4);
+}   // end writeU32
+
+
+bool writeGLB( std::ostream& os, const std::string& json, const Buffer& buf)
+{
+    const uint32_t jlen = uint32_t( (json.size() + 3) & ~size_t(3));
+    const uint32_t blen = uint32_t( (buf.bytes.size() + 3) & ~size_t(3));
+    const uint32_t total = 12 + 8 + jlen + (blen > 0 ? 8 + blen : 0);
+
+    writeU32( os, GLB_MAGIC);
+    writeU32( os, 2);
+    writeU32( os, total);
+
+    writeU32( os, jlen);
+    writeU32( os, GLB_JSON);
+    os.write( json.data(), json.size());
+    for ( size_t i = json.size(); i < jlen; ++i)
+        os.put(' ');
+
+    if ( blen > 0)
+    {
+        writeU32( os, blen);
+        writeU32( os, GLB_BIN);
+        os.write( buf.bytes.data(), buf.bytes.size());
+        for ( size_t i = buf.bytes.size(); i < blen; ++i)
+            os.put('\0');
+    }   // end if
+
+    return os.good();
+}   // end writeGLB
+
+
+// Build the buffer, encoding any embedded images in parallel with packing the geometry. If buffile
+// is empty, the model is written as .glb, otherwise the buffer is written to buffile and os gets the JSON.
+bool writeModel( std::ostream& os, const MeshView& model, const RModelIO::Transform& xf, const std::vector<cv::Mat>& txs,
+                 std::vector<Image> imgs, const std::string& bufuri, const std::string& buffile)
+{
+    Buffer buf;
+    std::vector<std::future<bool> > encoded( imgs.size());
+    for ( size_t i = 0; i < imgs.size(); ++i)
+    {
+        if ( imgs[i].uri.empty())
+            encoded[i] = std::async( std::launch::async, [&txs, &imgs, i](){ return encodeImage( txs[i], imgs[i]);});
+    }   // end for
+
+    // One primitive per material having faces followed by one for the faces without a material.
+    std::vector<Primitive> prims;
+    const std::vector<std::vector<uint32_t> > mfaces = model.materialFaces();
+    const int nmats = int(model.numMaterials());
+    for ( int gmat = 0; gmat < nmats; ++gmat)
+        if ( !mfaces[gmat].empty())
+            prims.push_back( addPrimitive( model, xf, mfaces[gmat], true, gmat, buf));
+    if ( !mfaces.back().empty())
+        prims.push_back( addPrimitive( model, xf, mfaces.back(), false, -1, buf));
+
+    bool ok = true;
+    for ( size_t i = 0; i < imgs.size(); ++i)
+    {
+        if ( !imgs[i].uri.empty())
+            continue;
+        if ( !encoded[i].get())
+            ok = false;
+        else
+        {
+            imgs[i].view = buf.add( imgs[i].bytes.data(), imgs[i].bytes.size(), 0);
+            std::vector<char>().swap( imgs[i].bytes);
+        }   // end else
+    }   // end for
+
+    if ( !ok)
+        return false;
+
+    const std::string json = makeJSON( buf, bufuri, prims, imgs);
+    if ( buffile.empty())
+        return writeGLB( os, json, buf);
+
+    std::ofstream ofs( buffile.c_str(), std::ios::out | std::ios::binary);
+    ofs.write( buf.bytes.data(), buf.bytes.size());
+    ofs.close();
+    os << json;
+    return !ofs.fail() && os.good();
+}   // end writeModel
+
+}   // end namespace
+
+
+// protected
+bool GLTFExporter::doSave( const ObjModel& model, const std::string& fname)
+{
+    return doSaveView( viewOf(model), fname);
+}   // end doSave
+
+
+// The .bin buffer of a .gltf model is written directly by the task writing the JSON.
+// protected
+bool GLTFExporter::needsWorkingDir( const std::string& fname) const
+{
+    return boost::algorithm::to_lower_copy( boost::filesystem::path( fname).extension().string()) != ".glb";
+}   // end needsWorkingDir
+
+
+// protected
+bool GLTFExporter::doSaveView( const MeshView& model, const std::string& fname)
+{
+    using Path = boost::filesystem::path;
+    const Path mpath( fname);
+    const bool binary = boost::algorithm::to_lower_copy( mpath.extension().string()) == ".glb";
+    const bool embed = binary && _embedTextures;
+
+    // One image per material in material order (as for the primitives).
+    std::vector<cv::Mat> txs;
+    std::vector<Image> imgs;
+    const int nmats = int(model.numMaterials());
+    for ( int mid = 0; mid < nmats; ++mid)
+    {
+        txs.push_back( model.textures[mid]);
+        imgs.push_back( Image());
+        if ( txs.back().empty())
+        {
+            std::ostringstream eoss;
+            eoss << "[ERROR] RModelIO::GLTFExporter::doSaveView: Material " << mid << " has no texture!";
+            setErr(eoss.str());
+            return false;
+        }   // end if
+
+        if ( embed)
+            continue;
+
+        // Referenced textures are written (or copied) alongside the model.
+        std::ostringstream oss;
+        oss << mpath.stem().string() << "_" << mid;
+        TextureSources::Source src;
+        const std::string srcext = passThroughExtension( txs.back(), src);
+        if ( !srcext.empty())
+        {
+            imgs.back().uri = oss.str() + srcext;
+            fileSink().addCopy( src.path, (mpath.parent_path() / imgs.back().uri).string());
+        }   // end if
+        else
+        {
+            imgs.back().uri = oss.str() + ".png";
+            const cv::Mat tx = txs.back();
+            fileSink().add( (mpath.parent_path() / imgs.back().uri).string(), [tx]( std::ostream& os)
+                    {
+                        std::vector<uchar> buf;
+                        if ( !cv::imencode( ".png", tx, buf))
+                            return false;
+                        os.write( reinterpret_cast<const char*>( buf.data()), buf.size());
+                        return os.good();
+                    });
+        }   // end else
+    }   // end for
+
+    // For .gltf, the buffer is written to an adjacent .bin file by the same task that writes the JSON.
+    const std::string bufuri = binary ? "" : mpath.stem().string() + ".bin";
+    const std::string buffile = binary ? "" : (mpath.parent_path() / bufuri).string();
+    const MeshView* mptr = &model;
+    const Transform xf = transform();
+    fileSink().add( fname, [=]( std::ostream& os){ return writeModel( os, *mptr, xf, txs, imgs, bufuri, buffile);});
+    return true;
+}   // end doSaveView
@@ -16,23 +16,32 @@
  ************************************************************************/
 
 #include <IDTFExporter.h>
-#include <ImageIO.h>   // RFeatures::saveAsTGA
+#include <MeshWriters.h>
+#include <ImageIO.h>   // RFeatures::saveTGA
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <iomanip>
 #include <fstream>
 #include <sstream>
+#include <future>
+#include <thread>
 #include <boost/filesystem/operations.hpp>
 using RModelIO::IDTFExporter;
+using RModelIO::Transform;
+using RModelIO::FloatFormat;
+using RModelIO::Scene;
 using RFeatures::ObjModel;
 using std::unordered_map;
 
 
 // public
 IDTFExporter::IDTFExporter( bool delOnDtor, bool m9)
-    : RModelIO::ObjModelExporter(), _delOnDtor(delOnDtor), _media9(m9)
+    : RModelIO::ObjModelExporter(), _delOnDtor(delOnDtor), _compactNormals(false), _texturesFirst(false), _maxFaces(0), _txfmt(TGA), _txqual(-1), _maxTxDim(0)
 {
     addSupported( "idtf", "Intermediate Data Text Format");
+    if ( m9)
+        setTransform( Transform::media9());
 }   // end ctor
 
 
@@ -40,6 +49,14 @@ IDTFExporter::IDTFExporter( bool delOnDtor, bool m9)
 IDTFExporter::~IDTFExporter() { reset();}
 
 
+// public
+void IDTFExporter::setTextureFormat( TextureFormat fmt, int quality)
+{
+    _txfmt = fmt;
+    _txqual = quality;
+}   // end setTextureFormat
+
+
 // Remove saved files.
 // private
 void IDTFExporter::reset()
@@ -55,9 +72,9 @@ void IDTFExporter::reset()
             std::cerr << istr << "Removed " << ffile << std::endl;
         }   // end if
 
-        for ( const std::string& tgafile : _tgafiles)
+        for ( const std::string& txfile : _txfiles)
         {
-            path ifile( tgafile);
+            path ifile( txfile);
             if ( exists( ifile) && is_regular_file(ifile))
             {
                 remove( ifile);
@@ -67,12 +84,47 @@ void IDTFExporter::reset()
     }   // end _delOnDtor
 
     _idtffile = "";
-    _tgafiles.clear();
+    _txfiles.clear();
 }   // end reset
 
 
 namespace {
 
+std::string textureExtension( IDTFExporter::TextureFormat fmt)
+{
+    switch ( fmt)
+    {
+        case IDTFExporter::PNG:
+            return ".png";
+        case IDTFExporter::JPEG:
+            return ".jpg";
+        default:
+            return ".tga";
+    }   // end switch
+}   // end textureExtension
+
+
+std::vector<int> textureParams( IDTFExporter::TextureFormat fmt, int quality)
+{
+    std::vector<int> params;
+    if ( quality < 0)
+        return params;
+
+    switch ( fmt)
+    {
+        case IDTFExporter::PNG:
+            params = { cv::IMWRITE_PNG_COMPRESSION, std::min( quality, 9)};
+            break;
+        case IDTFExporter::JPEG:
+            params = { cv::IMWRITE_JPEG_QUALITY, std::min( quality, 100)};
+            break;
+        default:
+            break;
+    }   // end switch
+    return params;
+}   // end textureParams
+
+
 struct TB {
     TB(int ntabs=0) : n(ntabs) {}
     int n;
@@ -93,7 +145,7 @@ std::ostream& operator<<( std::ostream& os, const TB& t)
 std::ostream& operator<<( std::ostream& os, const NL& nl)
 {
     for ( int i = 0; i < nl.n; ++i)
-        os << std::endl;
+        os << '\n';
     return os;
 }   // end operator<<
 
@@ -120,22 +172,30 @@ void nodeGroup( std::ostream& os)
 }   // end nodeGroup
 
 
-void nodeModel( std::ostream& os, int meshID)
+// Matrices are written a column per line (translation on the last line).
+void parentTM( std::ostream& os, const cv::Matx44d& m)
 {
-    TB t(1), tt(2), ttt(3), tttt(4);
+    TB ttt(3), tttt(4);
+    NL n(1);
+    os << ttt << "PARENT_TM {" << n;
+    os << std::fixed << std::setprecision(6);
+    for ( int j = 0; j < 4; ++j)
+        os << tttt << m(0,j) << " " << m(1,j) << " " << m(2,j) << " " << m(3,j) << n;
+    os << ttt << "}" << n;  // end PARENT_TM
+}   // end parentTM
+
+
+void nodeModel( std::ostream& os, const std::string& nodeName, int meshID, const cv::Matx44d& tm)
+{
+    TB t(1), tt(2), ttt(3);
     NL n(1);
     os << "NODE \"MODEL\" {" << n;
-    os << t << "NODE_NAME \"Mesh" << meshID << "\"" << n;
+    os << t << "NODE_NAME \"" << nodeName << "\"" << n;
     os << t << "PARENT_LIST {" << n;
     os << tt << "PARENT_COUNT 1" << n;
     os << tt << "PARENT 0 {" << n;
     os << ttt << "PARENT_NAME \"ModelGroup\"" << n;
-    os << ttt << "PARENT_TM {" << n;
-    os << tttt << "1.000000 0.000000 0.000000 0.000000" << n;
-    os << tttt << "0.000000 1.000000 0.000000 0.000000" << n;
-    os << tttt << "0.000000 0.000000 1.000000 0.000000" << n;
-    os << tttt << "0.000000 0.000000 0.000000 1.000000" << n;
-    os << ttt << "}" << n;  // end PARENT_TM
+    parentTM( os, tm);
     os << tt << "}" << n;  // end PARENT 0
     os << t << "}" << n;  // end PARENT_LIST
     os << t << "RESOURCE_NAME \"Mesh" << meshID << "\"" << n;
@@ -183,14 +243,16 @@ void resourceLight( std::ostream& os, int lightID)
 }   // end resourceLight
 
 
-void resourceListShader( std::ostream& os, int nmesh, bool hasTX)
+// Shader i is for mesh i and uses texture txIDs[i] (none if -1).
+void resourceListShader( std::ostream& os, const std::vector<int>& txIDs)
 {
     TB t(1), tt(2), ttt(3), tttt(4);
     NL n(1);
     os << "RESOURCE_LIST \"SHADER\" {" << n;
-    os << t << "RESOURCE_COUNT " << nmesh << n;
-    for ( int i = 0; i < nmesh; ++i)    // One to one mapping of shaders to texture maps
+    os << t << "RESOURCE_COUNT " << txIDs.size() << n;
+    for ( size_t i = 0; i < txIDs.size(); ++i)
     {
+        const bool hasTX = txIDs[i] >= 0;
         os << t << "RESOURCE " << i << " {" << n;
         os << tt << "RESOURCE_NAME \"Shader" << i << "\"" << n;
         os << tt << "SHADER_MATERIAL_NAME \"Material0\"" << n;  // All shaders reference same material
@@ -199,7 +261,7 @@ void resourceListShader( std::ostream& os, int nmesh, bool hasTX)
         {
             os << tt << "SHADER_TEXTURE_LAYER_LIST {" << n;
             os << ttt << "TEXTURE_LAYER 0 {" << n;
-            os << tttt << "TEXTURE_NAME \"Texture" << i << "\"" << n;
+            os << tttt << "TEXTURE_NAME \"Texture" << txIDs[i] << "\"" << n;
             os << ttt << "}" << n;  // end TEXTURE_LAYER 0
             os << tt << "}" << n;  // end SHADER_TEXTURE_LAYER_LIST
         }   // end if
@@ -209,12 +271,12 @@ void resourceListShader( std::ostream& os, int nmesh, bool hasTX)
 }   // end resourceListShader
 
 
-void modifierShading( std::ostream& os, int meshID)
+void modifierShading( std::ostream& os, const std::string& nodeName, int meshID)
 {
     TB t(1), tt(2), ttt(3), tttt(4), ttttt(5);
     NL n(1);
     os << "MODIFIER \"SHADING\" {" << n;
-    os << t << "MODIFIER_NAME \"Mesh" << meshID << "\"" << n;
+    os << t << "MODIFIER_NAME \"" << nodeName << "\"" << n;
     os << t << "PARAMETERS {" << n;
     os << tt << "SHADER_LIST_COUNT 1" << n;
     os << tt << "SHADING_GROUP {" << n;
@@ -269,25 +331,29 @@ void resourceListTexture( std::ostream& os, const std::vector<std::pair<int, std
 
 
 
+// Settings from the exporter used while writing the file.
+struct WriteOptions
+{
+    Transform xf;
+    FloatFormat ff;
+    bool compactNormals;
+};  // end struct
+
+
 struct ModelResource
 {
-    // matID >= 0 if the model has materials.
-    ModelResource( const ObjModel* model, bool media9, int matID) : _model(model), _media9(media9)
+    // The mesh comprises the given faces which are textured using material matID if matID >= 0.
+    ModelResource( const ObjModel* model, const WriteOptions& opts, const IntSet& fids, int matID)
+        : _model(model), _xf(opts.xf), _ff(opts.ff), _compactNormals(opts.compactNormals), _matID(matID)
     {
         // Get repeatable sequence of face IDs and the unique set of texture coords for the material
-        const IntSet* fids;
-        if ( matID < 0)
-            fids = &_model->faces();
-        else
-            fids = &_model->materialFaceIds(matID);
-
-        _fidv.resize( fids->size());
+        _fidv.resize( fids.size());
         int k = 0;
         int vid;
-        for ( int fid : *fids)
+        for ( int fid : fids)
         {
             _fidv[k++] = fid;
-            if ( _model->faceMaterialId(fid) >= 0)
+            if ( matID >= 0)
             {
                 const int* uvids = _model->faceUVs(fid);
                 for ( int i = 0; i < 3; ++i)
@@ -315,27 +381,21 @@ struct ModelResource
         }   // end for
     }   // end ctor
 
+    // Texture coordinates are written only if the mesh has a material.
     void writeMesh( std::ostream& os) const
     {
-        const bool hasTX = _model->numMats() > 0;
-        TB tt(2);
-        NL n(1);
-        writeHeader(os);
-        writeShadingDescriptionList(os);
-        writeFacePositionList(os);
-        writeFaceNormalList(os);
-        writeFaceShadingList(os);
-        if ( hasTX)
-            writeFaceTextureCoordList(os);
-        writePositionList(os);
-        writeNormalList(os);
-        if ( hasTX)
-            writeTextureCoordList(os);
+        if ( _matID >= 0)
+            writeMeshT<true>(os);
+        else
+            writeMeshT<false>(os);
     }   // end writeMesh
 
 private:
     const ObjModel* _model;
-    const bool _media9;
+    const Transform& _xf;
+    const FloatFormat& _ff;
+    const bool _compactNormals;     // All corners reference a single normal
+    const int _matID;
     std::vector<int> _fidv;          // Predictable seq. of face IDs
     std::vector<int> _vidv;          // Predictable seq. of vertex IDs
     unordered_map<int,int> _vmap;    // ObjModel vertexID --> MODEL_POSITION_LIST index
@@ -343,13 +403,30 @@ private:
     std::vector<const cv::Vec2f*> _uvlist;  // List of texture UVs to output in MODEL_TEXTURE_COORD_LIST
 
 
+    template <bool TX>
+    void writeMeshT( std::ostream& os) const
+    {
+        writeHeader(os);
+        writeShadingDescriptionList<TX>(os);
+        writeFacePositionList(os);
+        writeFaceNormalList(os);
+        writeFaceShadingList(os);
+        if ( TX)
+            writeFaceTextureCoordList(os);
+        writePositionList(os);
+        writeNormalList(os);
+        if ( TX)
+            writeTextureCoordList(os);
+    }   // end writeMeshT
+
+
     void writeHeader( std::ostream& os) const
     {
         TB ttt(3);
         NL n(1);
         os << ttt << "FACE_COUNT " << _fidv.size() << n;
         os << ttt << "MODEL_POSITION_COUNT " << _vidv.size() << n;
-        os << ttt << "MODEL_NORMAL_COUNT " << (_fidv.size() * 3) << n;
+        os << ttt << "MODEL_NORMAL_COUNT " << (_compactNormals ? 1 : _fidv.size() * 3) << n;
         os << ttt << "MODEL_DIFFUSE_COLOR_COUNT 0" << n;
         os << ttt << "MODEL_SPECULAR_COLOR_COUNT 0" << n;
         os << ttt << "MODEL_TEXTURE_COORD_COUNT " << _uvmap.size() << n;
@@ -358,15 +435,15 @@ private:
     }   // end writeHeader
 
 
+    template <bool TX>
     void writeShadingDescriptionList( std::ostream& os) const
     {
-        const bool hasTX = _model->numMats() > 0;
         TB ttt(3), tttt(4), ttttt(5), tttttt(6);
         NL n(1);
         os << ttt << "MODEL_SHADING_DESCRIPTION_LIST {" << n;
         os << tttt << "SHADING_DESCRIPTION 0 {" << n;
-        os << ttttt << "TEXTURE_LAYER_COUNT " << (hasTX ? 1 : 0) << n;    // No multi-texturing!
-        if ( hasTX)
+        os << ttttt << "TEXTURE_LAYER_COUNT " << (TX ? 1 : 0) << n;    // No multi-texturing!
+        if ( TX)
         {
             os << ttttt << "TEXTURE_COORD_DIMENSION_LIST {" << n;
             os << tttttt << "TEXTURE_LAYER 0 DIMENSION: 2" << n;    // 2D texture map
@@ -400,9 +477,17 @@ private:
         os << TB(3) << "MESH_FACE_NORMAL_LIST {" << NL(1);
         TB ttt(3), tttt(4);
         NL n(1);
-        int i = 0;
-        for ( size_t j = 0; j < _fidv.size(); ++j, i += 3)
-            os << tttt << i << " " << (i+1) << " " << (i+2) << n;
+        if ( _compactNormals)
+        {
+            for ( size_t j = 0; j < _fidv.size(); ++j)
+                os << tttt << "0 0 0" << n;
+        }   // end if
+        else
+        {
+            int i = 0;
+            for ( size_t j = 0; j < _fidv.size(); ++j, i += 3)
+                os << tttt << i << " " << (i+1) << " " << (i+2) << n;
+        }   // end else
         os << ttt << "}" << n;
     }   // end writeFaceNormalList
 
@@ -451,27 +536,27 @@ private:
     // Output mesh positions (mapping the vertex ID to the position of the vertex in this list)
     void writePositionList( std::ostream& os) const
     {
-        TB ttt(3), tttt(4);
+        TB ttt(3);
         NL n(1);
         os << ttt << "MODEL_POSITION_LIST {" << n;
         os << std::fixed << std::setprecision(6);
 
-        if ( _media9)
+        // Gather positions in batches to be transformed together.
+        float buf[3*Transform::BATCH_SIZE];
+        const size_t nv = _vidv.size();
+        for ( size_t i = 0; i < nv; i += Transform::BATCH_SIZE)
         {
-            for ( int vid : _vidv)
+            const size_t nb = std::min( Transform::BATCH_SIZE, nv - i);
+            for ( size_t j = 0; j < nb; ++j)
             {
-                const cv::Vec3f& v = _model->vtx(vid);
-                os << tttt << v[0] << " " << -v[2] << " " << v[1] << n;
+                const cv::Vec3f& v = _model->vtx( _vidv[i+j]);
+                buf[3*j] = v[0];
+                buf[3*j+1] = v[1];
+                buf[3*j+2] = v[2];
             }   // end for
-        }   // end if
-        else
-        {
-            for ( int vid : _vidv)
-            {
-                const cv::Vec3f& v = _model->vtx(vid);
-                os << tttt << v[0] << " " << v[1] << " " << v[2] << n;
-            }   // end for
-        }   // end else
+            _xf.apply( buf, nb, buf);
+            RModelIO::MeshWriters::writePositions<RModelIO::MeshWriters::IDTF>( os, buf, nb, _ff);
+        }   // end for
 
         os << ttt << "}" << n;  // end MODEL_POSITION_LIST
     }   // end writePositionList
@@ -485,12 +570,17 @@ private:
         NL n(1);
         os << ttt << "MODEL_NORMAL_LIST {" << n;
         os << std::fixed << std::setprecision(6);
-        for ( size_t j = 0; j < _fidv.size(); ++j)
-        {
+        if ( _compactNormals)
             os << tttt << nrm[0] << " " << nrm[1] << " " << nrm[2] << n;
-            os << tttt << nrm[0] << " " << nrm[1] << " " << nrm[2] << n;
-            os << tttt << nrm[0] << " " << nrm[1] << " " << nrm[2] << n;
-        }   // end for
+        else
+        {
+            for ( size_t j = 0; j < _fidv.size(); ++j)
+            {
+                os << tttt << nrm[0] << " " << nrm[1] << " " << nrm[2] << n;
+                os << tttt << nrm[0] << " " << nrm[1] << " " << nrm[2] << n;
+                os << tttt << nrm[0] << " " << nrm[1] << " " << nrm[2] << n;
+            }   // end for
+        }   // end else
         os << ttt << "}" << n;  // end MODEL_NORMAL_LIST
     }   // end writeNormalList
 
@@ -500,134 +590,263 @@ private:
         TB ttt(3), tttt(4);
         NL n(1);
         os << ttt << "MODEL_TEXTURE_COORD_LIST {" << n;
-        os << std::fixed << std::setprecision(6);
-        for ( const cv::Vec2f* uv : _uvlist)
-            os << tttt << std::fixed << (*uv)[0] << " " << (*uv)[1] << " " << 0.0 << " " << 0.0 << n;
+        if ( _ff.usesStream())
+        {
+            os << std::fixed << std::setprecision(6);
+            for ( const cv::Vec2f* uv : _uvlist)
+                os << tttt << std::fixed << (*uv)[0] << " " << (*uv)[1] << " " << 0.0 << " " << 0.0 << n;
+        }   // end if
+        else
+        {
+            std::vector<float> uvs;
+            uvs.reserve( 2*_uvlist.size());
+            for ( const cv::Vec2f* uv : _uvlist)
+                uvs.insert( uvs.end(), { (*uv)[0], (*uv)[1]});
+            RModelIO::MeshWriters::writeUVs<RModelIO::MeshWriters::IDTF>( os, uvs.data(), _uvlist.size(), _ff);
+        }   // end else
         os << ttt << "}" << n;  // end MODEL_TEXTURE_COORD_LIST
     }   // end writeTextureCoordList
 };  // end struct
 
 
 
-// Write the model data in IDTF format. Only vertex, face, and texture mapping info are stored.
-std::string writeFile( const ObjModel* model, bool media9, const std::string& filename, const std::vector<std::pair<int, std::string> >& mtf)
+// A unique model of a scene with the texture filenames of its materials.
+struct SceneModel
 {
-    const int nTX = (int)mtf.size();
-    const int nmesh = std::max(1,nTX);
-    std::string errMsg;
-    std::ofstream ofs;
-    try
-    {
-        ofs.open( filename.c_str(), std::ios::out);
+    const ObjModel* model;
+    std::vector<std::pair<int, std::string> > mtf;
+};  // end struct
 
-        TB t(1), tt(2);
-        NL n(1);
-        const std::string meshName("Model");
 
-        // File header
-        ofs << "FILE_FORMAT \"IDTF\"" << n;
-        ofs << "FORMAT_VERSION 100" << n << n;
+// Write the scene in IDTF format. Only vertex, face, and texture mapping info are stored.
+bool writeFile( std::ostream& ofs, const std::vector<SceneModel>& models, const std::vector<Scene::Node>& nodes, const WriteOptions& opts)
+{
+    // Each model is written as a mesh per material. Faces without a material go in an
+    // extra untextured mesh after those of the model's materials.
+    struct Mesh
+    {
+        int model;
+        int matID;
+        int txID;
+    };  // end struct
+
+    std::vector<Mesh> meshes;
+    std::vector<int> firstMesh;     // Index of the first mesh of each model
+    std::vector<IntSet> remfids( models.size());
+    std::vector<std::pair<int, std::string> > mtf;  // Textures of all models
+    for ( size_t u = 0; u < models.size(); ++u)
+    {
+        const ObjModel* model = models[u].model;
+        if ( models[u].mtf.empty())
+            remfids[u] = model->faces();
+        else
+        {
+            const IntSet& fids = model->faces();
+            for ( int fid : fids)
+                if ( model->faceMaterialId(fid) < 0)
+                    remfids[u].insert(fid);
+        }   // end else
 
-        nodeGroup( ofs);
-        for ( int i = 0; i < nmesh; ++i)
-            nodeModel( ofs, i);
+        firstMesh.push_back( int(meshes.size()));
+        for ( const auto& mt : models[u].mtf)
+        {
+            meshes.push_back( Mesh{ int(u), mt.first, int(mtf.size())});
+            mtf.push_back( mt);
+        }   // end for
+        if ( !remfids[u].empty() || models[u].mtf.empty())
+            meshes.push_back( Mesh{ int(u), -1, -1});
+    }   // end for
+    firstMesh.push_back( int(meshes.size()));
 
-        nodeLight( ofs, 1);
-        resourceLight( ofs, 1);
+    const int nmesh = int(meshes.size());
+    TB t(1), tt(2);
+    NL n(1);
 
-        // Multi material models are defined as separate model resources under a single parent node.
-        // Model resource list (1 element)
-        ofs << "RESOURCE_LIST \"MODEL\" {" << n;
-        ofs << t << "RESOURCE_COUNT " << nmesh << n;
+    // File header
+    ofs << "FILE_FORMAT \"IDTF\"" << n;
+    ofs << "FORMAT_VERSION 100" << n << n;
 
-        for ( int i = 0; i < nmesh; ++i)
+    // Each node places all meshes of its model. Nodes for the first instance of each mesh
+    // are named after the mesh and later instances are numbered from one.
+    nodeGroup( ofs);
+    std::vector<std::pair<std::string, int> > meshNodes;    // Node name and mesh
+    std::vector<int> ninst( models.size(), 0);
+    for ( const Scene::Node& node : nodes)
+    {
+        const int k = ninst[node.model]++;
+        for ( int i = firstMesh[node.model]; i < firstMesh[node.model+1]; ++i)
         {
-            ofs << t << "RESOURCE " << i << " {" << n;
-            ofs << tt << "RESOURCE_NAME \"Mesh" << i << "\"" << n;
-            ofs << tt << "MODEL_TYPE \"MESH\"" << n;
-            ofs << tt << "MESH {" << n;
-            // meshID is the material ID if there's at least one material on the object
-            const int matID = nTX > 0 ? mtf[i].first : -1;
-            const ModelResource modelResource( model, media9, matID);
-            modelResource.writeMesh( ofs);
-            ofs << tt << "}" << n;    // end MESH
-            ofs << t << "}" << n;    // end RESOURCE
+            std::ostringstream oss;
+            oss << "Mesh" << i;
+            if ( k > 0)
+                oss << "_" << k;
+            meshNodes.push_back( std::make_pair( oss.str(), i));
+            nodeModel( ofs, oss.str(), i, node.tm);
         }   // end for
+    }   // end for
 
-        ofs << "}" << n << n;
-
-        resourceListShader( ofs, nmesh, nTX > 0);
-        resourceListMaterial( ofs);
-        resourceListTexture( ofs, mtf);
+    nodeLight( ofs, 1);
+    resourceLight( ofs, 1);
 
-        // Shading modifiers
-        for ( int i = 0; i < nmesh; ++i)
-            modifierShading( ofs, i);
+    // Multi material models are defined as separate model resources under a single parent node.
+    ofs << "RESOURCE_LIST \"MODEL\" {" << n;
+    ofs << t << "RESOURCE_COUNT " << nmesh << n;
 
-        ofs.close();
-    }   // end try
-    catch ( const std::exception &e)
+    // Mesh bodies are built and formatted concurrently (at most nworkers at a time)
+    // and written in resource order so the output doesn't depend on thread timing.
+    const auto meshBody = [&]( int i)
     {
-        errMsg = e.what();
-    }   // end catch
+        const Mesh& mesh = meshes[i];
+        const ObjModel* model = models[mesh.model].model;
+        const IntSet& fids = mesh.matID >= 0 ? model->materialFaceIds( mesh.matID) : remfids[mesh.model];
+        const ModelResource modelResource( model, opts, fids, mesh.matID);
+        std::ostringstream oss;
+        modelResource.writeMesh( oss);
+        return oss.str();
+    };  // end meshBody
+
+    const int nworkers = int( std::max<unsigned>( 1, std::thread::hardware_concurrency()));
+    std::vector<std::future<std::string> > bodies( nmesh);
+    int next = 0;   // Next mesh to write
+    const auto writeNext = [&]()
+    {
+        ofs << t << "RESOURCE " << next << " {" << n;
+        ofs << tt << "RESOURCE_NAME \"Mesh" << next << "\"" << n;
+        ofs << tt << "MODEL_TYPE \"MESH\"" << n;
+        ofs << tt << "MESH {" << n;
+        ofs << bodies[next].get();
+        ofs << tt << "}" << n;    // end MESH
+        ofs << t << "}" << n;    // end RESOURCE
+        next++;
+    };  // end writeNext
+
+    for ( int i = 0; i < nmesh; ++i)
+    {
+        if ( i - next >= nworkers)
+            writeNext();
+        bodies[i] = std::async( nmesh > 1 ? std::launch::async : std::launch::deferred, meshBody, i);
+    }   // end for
+    while ( next < nmesh)
+        writeNext();
+
+    ofs << "}" << n << n;
 
-    return errMsg;
+    std::vector<int> txIDs;
+    for ( const Mesh& mesh : meshes)
+        txIDs.push_back( mesh.txID);
+    resourceListShader( ofs, txIDs);
+    resourceListMaterial( ofs);
+    resourceListTexture( ofs, mtf);
+
+    // Shading modifiers
+    for ( const auto& mn : meshNodes)
+        modifierShading( ofs, mn.first, mn.second);
+
+    return ofs.good();
 }   // end writeFile
 
+
 }   // end namespace
 
 
 
+// public
+bool IDTFExporter::saveScene( const std::vector<Instance>& instances, const std::string& filename)
+{
+    return saveUsing( filename, [&]( const std::string& f){ return _saveScene( instances, f);});
+}   // end saveScene
+
+
 // protected
-bool IDTFExporter::doSave( const ObjModel& inmodel, const std::string& filename)
+bool IDTFExporter::doSave( const ObjModel& model, const std::string& filename)
 {
-    reset();
-    // Need to set all the texture map filenames (if present) and save out the textures.
-    // Image files are saved adjacent to the model.
-    using Path = boost::filesystem::path;
-    const Path mpath( filename);
-    Path tpath = mpath.parent_path();  // Directory model is being saved in
-    tpath /= mpath.stem();             // Use the stem of the save filename as the basis for the texture filenames
-
-    std::vector<std::pair<int, std::string> > mtf;  // Associate the texture filenames with the material ID
-    const ObjModel* model = nullptr;
-    ObjModel::Ptr nmodel;
-    if ( inmodel.numMats() <= 1)
-        model = &inmodel;
-    else
-    {
-        std::cerr << "[STATUS] RModelIO::IDTFExporter::doSave: Multi-material model being copied to single material model for export" << std::endl;
-        nmodel = inmodel.deepCopy( true);
-        nmodel->mergeMaterials();
-        model = nmodel.get();
-    }   // end else
+    return _saveScene( { Instance{ &model, Transform()}}, filename);
+}   // end doSave
 
-    const IntSet& mids = model->materialIds();
+
+// Queue the writing of the model's textures as files named with the given prefix
+// and record the filename of each material's texture in mtf.
+// private
+bool IDTFExporter::_addTextures( const ObjModel& model, const std::string& prefix, std::vector<std::pair<int, std::string> >& mtf)
+{
+    const IntSet& mids = model.materialIds();
     for ( int mid : mids)
     {
-        // Texture needs to be output in TGA format for conversion to the IDTF intermediate format.
-        cv::Mat tx = model->texture(mid);
+        // Textures are scaled and encoded as separate tasks so they're processed in parallel.
+        const cv::Mat tx = model.texture(mid);
         if ( tx.empty())
         {
             std::ostringstream eoss;
-            eoss << "[ERROR] RModelIO::IDTFExporter::doSave: Material " << mid << " has no texture!";
+            eoss << "[ERROR] RModelIO::IDTFExporter::save: Material " << mid << " has no texture!";
             setErr(eoss.str());
             return false;
         }   // end else
 
         std::ostringstream oss;
-        oss << tpath.string() << "_M" << mid << ".tga";
-        const std::string tgafname = oss.str();
-        _tgafiles.push_back( tgafname);    // Record to delete on destruction
-        if ( !RFeatures::saveTGA( tx, tgafname))
-            return false;
-        mtf.push_back( std::pair<int, std::string>( mid, tgafname));
+        oss << prefix << "_M" << mid << textureExtension( _txfmt);
+        const std::string txfname = oss.str();
+        _txfiles.push_back( txfname);    // Record to delete on destruction
+        const int maxDim = _maxTxDim;
+        if ( _txfmt == TGA)
+            fileSink().addTask( txfname, [tx, maxDim]( const std::string& f){ return RFeatures::saveTGA( RModelIO::scaleTexture( tx, maxDim), f);});
+        else
+        {
+            const std::string ext = textureExtension( _txfmt);
+            const std::vector<int> params = textureParams( _txfmt, _txqual);
+            fileSink().add( txfname, [tx, maxDim, ext, params]( std::ostream& os)
+            {
+                std::vector<uchar> buf;
+                if ( !cv::imencode( ext, RModelIO::scaleTexture( tx, maxDim), buf, params))
+                    return false;
+                os.write( reinterpret_cast<const char*>( buf.data()), buf.size());
+                return os.good();
+            });
+        }   // end else
+        mtf.push_back( std::pair<int, std::string>( mid, txfname));
     }   // end foreach
+    return true;
+}   // end _addTextures
+
+
+// private
+bool IDTFExporter::_saveScene( const std::vector<Instance>& instances, const std::string& filename)
+{
+    static const std::string estr = "[ERROR] RModelIO::IDTFExporter::save: ";
+    reset();
+    Scene scene;
+    std::string err;
+    if ( !scene.build( instances, transform(), _maxFaces, err))
+    {
+        setErr( estr + err);
+        return false;
+    }   // end if
+
+    // Image files are saved adjacent to the model using the stem of the save filename as the basis
+    // for the texture filenames (numbered by model if there's more than one unique model).
+    using Path = boost::filesystem::path;
+    const Path mpath( filename);
+    const std::string tpath = (mpath.parent_path() / mpath.stem()).string();
 
+    const std::vector<const ObjModel*>& umodels = scene.models();
+    std::vector<SceneModel> models( umodels.size());
+    for ( size_t u = 0; u < umodels.size(); ++u)
+    {
+        models[u].model = umodels[u];
+        const std::string prefix = umodels.size() > 1 ? tpath + "_" + std::to_string(u) : tpath;
+        if ( !_addTextures( *umodels[u], prefix, models[u].mtf))
+            return false;
+    }   // end for
+
+    if ( _texturesFirst && !fileSink().wait())
+    {
+        setErr( estr + "Unable to write textures! : " + fileSink().err());
+        return false;
+    }   // end if
+
+    // The IDTF file is written concurrently with the textures (each written as a separate task).
     _idtffile = filename;
-    const std::string errMsg = writeFile( model, _media9, filename, mtf);
-    if ( !errMsg.empty())
-        setErr( "Unable to write IDTF text file! : " + errMsg);
-    return errMsg.empty();
-}   // end doSave
+    const WriteOptions opts{ transform(), floatFormat(), _compactNormals};
+    fileSink().add( filename, [scene, models, opts]( std::ostream& os){ return writeFile( os, models, scene.nodes(), opts);});
+    return true;
+}   // end _saveScene
 
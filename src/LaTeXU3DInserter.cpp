@@ -32,6 +32,11 @@ using RFeatures::ObjModel;
 typedef RFeatures::CameraParams Cam;
 
 
+RModelIO::FileCache::Ptr LaTeXU3DInserter::U3DCache; // public static
+size_t LaTeXU3DInserter::U3DMaxFaces = 0;           // public static
+int LaTeXU3DInserter::U3DMaxTextureSize = 0;        // public static
+
+
 // public
 LaTeXU3DInserter::Ptr LaTeXU3DInserter::create( const ObjModel& model,
                                                 const std::string& sdirectory,
@@ -96,6 +101,9 @@ bool LaTeXU3DInserter::setModel( const ObjModel& model, const std::string& sdir)
 #else
     U3DExporter u3dxptr;
 #endif
+    u3dxptr.setCache( U3DCache);
+    u3dxptr.setMaxFaces( U3DMaxFaces);
+    u3dxptr.setMaxTextureSize( U3DMaxTextureSize);
     if ( !u3dxptr.save( model, u3dtmp))
     {
         std::cerr << u3dxptr.err() << std::endl;
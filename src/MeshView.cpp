@@ -0,0 +1,180 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include <MeshView.h>
+#include <unordered_map>
+using RModelIO::MeshView;
+using RModelIO::ModelArrays;
+using RFeatures::ObjModel;
+
+
+// public
+std::string MeshView::check() const
+{
+    if ( (nvtxs > 0 && !positions) || (nfaces > 0 && !indices))
+        return "Missing positions or indices";
+
+    const size_t nmats = textures.size();
+    if ( materialOffsets && !faceMaterials)
+    {
+        for ( size_t i = 0; i < nmats; ++i)
+            if ( materialOffsets[i] > materialOffsets[i+1])
+                return "Material offsets not in ascending order";
+        if ( materialOffsets[nmats] > nfaces)
+            return "Material offset out of range";
+    }   // end if
+
+    for ( size_t f = 0; f < nfaces; ++f)
+    {
+        const uint32_t* vidxs = &indices[3*f];
+        if ( vidxs[0] >= nvtxs || vidxs[1] >= nvtxs || vidxs[2] >= nvtxs)
+            return "Vertex index out of range";
+
+        const int m = material(f);
+        if ( m < 0)
+            continue;
+        if ( size_t(m) >= nmats)
+            return "Material index out of range";
+        for ( int i = 0; i < 3; ++i)
+            if ( uvIndex( f, i) >= nuvs)
+                return "Texture coordinate index out of range";
+    }   // end for
+
+    return "";
+}   // end check
+
+
+// public
+std::vector<std::vector<uint32_t> > MeshView::materialFaces() const
+{
+    const size_t nmats = textures.size();
+    std::vector<std::vector<uint32_t> > mfaces( nmats + 1);
+    for ( size_t f = 0; f < nfaces; ++f)
+    {
+        const int m = material(f);
+        mfaces[ m < 0 ? nmats : size_t(m)].push_back( uint32_t(f));
+    }   // end for
+    return mfaces;
+}   // end materialFaces
+
+
+// public
+ObjModel::Ptr MeshView::toModel() const
+{
+    ObjModel::Ptr model = ObjModel::create();
+
+    std::vector<int> vids( nvtxs);
+    for ( size_t i = 0; i < nvtxs; ++i)
+    {
+        const float* p = position( uint32_t(i));
+        vids[i] = model->addVertex( p[0], p[1], p[2]);
+    }   // end for
+
+    std::vector<int> fids( nfaces);
+    for ( size_t f = 0; f < nfaces; ++f)
+    {
+        const uint32_t* vidxs = &indices[3*f];
+        fids[f] = model->addFace( vids[vidxs[0]], vids[vidxs[1]], vids[vidxs[2]]);
+    }   // end for
+
+    std::vector<int> mids( textures.size());
+    for ( size_t m = 0; m < textures.size(); ++m)
+        mids[m] = model->addMaterial( textures[m]);
+
+    for ( size_t f = 0; f < nfaces; ++f)
+    {
+        const int m = material(f);
+        if ( m < 0 || fids[f] < 0 || mids[m] < 0)
+            continue;
+        cv::Vec2f fuvs[3];
+        for ( int i = 0; i < 3; ++i)
+        {
+            const float* uv = this->uv( uvIndex( f, i));
+            fuvs[i] = cv::Vec2f( uv[0], uv[1]);
+        }   // end for
+        model->setOrderedFaceUVs( mids[m], fids[f], fuvs);
+    }   // end for
+
+    return model;
+}   // end toModel
+
+
+// public
+ModelArrays::ModelArrays( const ObjModel& m)
+{
+    std::unordered_map<int,uint32_t> vmap;
+    pos.reserve( 3*m.numVtxs());
+    const IntSet& vids = m.vtxIds();
+    for ( int vid : vids)
+    {
+        const uint32_t vi = uint32_t( vmap.size());    // Read before inserting (evaluation order unspecified)
+        vmap[vid] = vi;
+        const cv::Vec3f& v = m.vtx(vid);
+        pos.insert( pos.end(), { v[0], v[1], v[2]});
+    }   // end for
+
+    std::unordered_map<int,uint32_t> fmap;
+    idx.reserve( 3*m.numPolys());
+    const IntSet& fids = m.faces();
+    for ( int fid : fids)
+    {
+        const uint32_t fi = uint32_t( fmap.size());
+        fmap[fid] = fi;
+        const int* f = m.fvidxs(fid);
+        idx.insert( idx.end(), { vmap.at(f[0]), vmap.at(f[1]), vmap.at(f[2])});
+    }   // end for
+
+    fmats.assign( fmap.size(), -1);
+    uvidx.assign( idx.size(), 0);
+    const IntSet& mids = m.materialIds();
+    for ( int mid : mids)
+    {
+        const int32_t midx = int32_t( view.textures.size());
+        view.textures.push_back( m.texture(mid));
+
+        std::unordered_map<int,uint32_t> uvmap;
+        const IntSet& uvids = m.uvs(mid);
+        for ( int uvid : uvids)
+        {
+            uvmap[uvid] = uint32_t( uvs.size() / 2);
+            const cv::Vec2f& uv = m.uv( mid, uvid);
+            uvs.insert( uvs.end(), { uv[0], uv[1]});
+        }   // end for
+
+        const IntSet& mfids = m.materialFaceIds(mid);
+        for ( int fid : mfids)
+        {
+            const uint32_t f = fmap.at(fid);
+            fmats[f] = midx;
+            const int* fuvs = m.faceUVs(fid);
+            for ( int i = 0; i < 3; ++i)
+                uvidx[3*f+i] = uvmap.at(fuvs[i]);
+        }   // end for
+    }   // end for
+
+    view.positions = pos.data();
+    view.nvtxs = pos.size() / 3;
+    view.indices = idx.data();
+    view.nfaces = idx.size() / 3;
+    if ( !view.textures.empty())
+    {
+        view.uvs = uvs.data();
+        view.nuvs = uvs.size() / 2;
+        view.uvIndices = uvidx.data();
+        view.faceMaterials = fmats.data();
+    }   // end if
+}   // end ctor
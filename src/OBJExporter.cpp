@@ -16,19 +16,105 @@
  ************************************************************************/
 
 #include <OBJExporter.h>
+#include <MeshWriters.h>
+#include <TextureSources.h>
+#include <ContentHash.h>
 using RModelIO::OBJExporter;
+using RModelIO::TextureSources;
+using RModelIO::FileSink;
+using RModelIO::MeshView;
 using RFeatures::ObjModel;
 #include <boost/filesystem/operations.hpp>
-#include <fstream>
+#include <algorithm>
 
 
-OBJExporter::OBJExporter() : RModelIO::ObjModelExporter()
+OBJExporter::OBJExporter() : RModelIO::ObjModelExporter(), _txfmt(PNG), _txqual(-1), _passThru(true), _hardLinks(false)
 {
     addSupported( "obj", "Wavefront OBJ");
 }   // end ctor
 
+
+// public
+void OBJExporter::setTextureFormat( TextureFormat fmt, int quality)
+{
+    _txfmt = fmt;
+    _txqual = quality;
+}   // end setTextureFormat
+
+
+// public
+void OBJExporter::setTexturePassThrough( bool enable, bool allowHardLinks)
+{
+    _passThru = enable;
+    _hardLinks = allowHardLinks;
+}   // end setTexturePassThrough
+
+
+// public
+bool OBJExporter::setTextureStore( const std::string& dir)
+{
+    _txstore = dir.empty() ? nullptr : TextureStore::create( dir);
+    return dir.empty() || _txstore != nullptr;
+}   // end setTextureStore
+
+
 namespace {
 
+std::string textureExtension( OBJExporter::TextureFormat fmt)
+{
+    switch ( fmt)
+    {
+        case OBJExporter::JPEG:
+            return ".jpg";
+        case OBJExporter::WEBP:
+            return ".webp";
+        default:
+            return ".png";
+    }   // end switch
+}   // end textureExtension
+
+
+std::vector<int> textureParams( OBJExporter::TextureFormat fmt, int quality)
+{
+    std::vector<int> params;
+    if ( quality < 0)
+        return params;
+
+    switch ( fmt)
+    {
+        case OBJExporter::JPEG:
+            params = { cv::IMWRITE_JPEG_QUALITY, std::min( quality, 100)};
+            break;
+        case OBJExporter::WEBP:
+            params = { cv::IMWRITE_WEBP_QUALITY, std::min( std::max( quality, 1), 100)};
+            break;
+        default:
+            params = { cv::IMWRITE_PNG_COMPRESSION, std::min( quality, 9)};
+            break;
+    }   // end switch
+    return params;
+}   // end textureParams
+
+
+// Returns the path to the stored file relative to the given directory if possible.
+std::string storedPath( const std::string& sfile, const std::string& ppath)
+{
+    boost::system::error_code ec;
+    const boost::filesystem::path rpath = boost::filesystem::relative( sfile, boost::filesystem::absolute( ppath), ec);
+    return ec || rpath.empty() ? sfile : rpath.generic_string();
+}   // end storedPath
+
+
+// Encode the texture into the given format and write the encoded bytes to the stream.
+bool writeTexture( std::ostream& os, const cv::Mat& tx, const std::string& ext, const std::vector<int>& params)
+{
+    std::vector<uchar> buf;
+    if ( !cv::imencode( ext, tx, buf, params))
+        return false;
+    os.write( reinterpret_cast<const char*>( buf.data()), buf.size());
+    return os.good();
+}   // end writeTexture
+
 std::string getMaterialName( const std::string& fname, int midx)
 {
     const std::string fstem = boost::filesystem::path(fname).filename().stem().string();
@@ -38,103 +124,94 @@ std::string getMaterialName( const std::string& fname, int midx)
 }   // end getMaterialName
 
 
-// Write out the .mtl file - returning any error string.
-std::string writeMaterialFile( const ObjModel* model, const std::string& fname)
+// Write out the .mtl file contents. Texture images are written separately.
+using IStrMap = std::unordered_map<int, std::string>;
+
+bool writeMaterialFile( std::ostream& ofs, const MeshView* model, const std::string& fname, const IStrMap& txfiles, bool pseudo)
 {
-    const boost::filesystem::path ppath = boost::filesystem::path(fname).parent_path();
-    std::string err;
-    std::ofstream ofs;
-    try
+    ofs << "# Wavefront OBJ material file produced by RModelIO (https://github.com/richeytastic/rModelIO)" << std::endl;
+    ofs << std::endl;
+
+    const int nmats = int(model->numMaterials());
+    for ( int mid = 0; mid < nmats; ++mid)
     {
-        ofs.open( fname.c_str(), std::ios::out);
-        ofs << "# Wavefront OBJ material file produced by RModelIO (https://github.com/richeytastic/rModelIO)" << std::endl;
+        const std::string matname = getMaterialName( fname, mid);
+        ofs << "newmtl " << matname << std::endl;
+        ofs << "illum 1" << std::endl;
+        if ( txfiles.count(mid) > 0)
+            ofs << "map_Kd " << txfiles.at(mid) << std::endl;
         ofs << std::endl;
+    }   // end foreach
 
-        int pmid = 0;   // Will be set to the 'pseudo' material ID in the event nfaces < total model faces.
-        int nfaces = 0;
-        const IntSet& mids = model->materialIds();
-        for ( int mid : mids)
-        {
-            nfaces += int(model->materialFaceIds(mid).size());
-            const std::string matname = getMaterialName( fname, mid);
-            ofs << "newmtl " << matname << std::endl;
-            ofs << "illum 1" << std::endl;
-            const cv::Mat tx = model->texture(mid);
-            if ( !tx.empty())
-            {
-                std::ostringstream oss;
-                oss << matname << ".png";
-                ofs << "map_Kd " << oss.str() << std::endl;
-                const std::string imgfile = (ppath / oss.str()).string();
-                cv::imwrite( imgfile, tx);
-            }   // end if
-
-            ofs << std::endl;
-            pmid = mid+1;
-        }   // end foreach
-
-        // Do we need an extra 'pseudo' material?
-        assert( nfaces <= model->numPolys());
-        if ( nfaces < model->numPolys())
-        {
-            ofs << "newmtl " << getMaterialName( fname, pmid) << std::endl;
-            ofs << "illum 1" << std::endl;
-        }   // end if
-
-        ofs.close();
-    }   // end try
-    catch ( const std::exception &e)
+    // Do we need an extra 'pseudo' material for the faces without a material?
+    if ( pseudo)
     {
-        err = e.what();
-    }   // end catch
+        ofs << "newmtl " << getMaterialName( fname, nmats) << std::endl;
+        ofs << "illum 1" << std::endl;
+    }   // end if
 
-    return err;
+    return ofs.good();
 }   // end writeMaterialFile
 
 
-using IIMap = std::unordered_map<int,int>;
-
-void writeVertices( std::ostream& os, const ObjModel* model, IIMap& vvmap)
+bool writeOBJFile( std::ostream& ofs, const MeshView& model, const RModelIO::Transform& xf, const RModelIO::FloatFormat& ff,
+                   const std::string& fname, const std::string& matfile)
 {
-    int i = 0;
-    const IntSet& vids = model->vtxIds();
-    for ( int vid : vids)
+    ofs << "# Wavefront OBJ file produced by RModelIO (https://github.com/richeytastic/rModelIO)" << std::endl;
+    ofs << std::endl;
+
+    if ( !matfile.empty())
     {
-        vvmap[vid] = ++i;   // Preincrement because vertex indices start at one for OBJ
-        const cv::Vec3f& v = model->vtx(vid);
-        os << "v\t" << v[0] << " " << v[1] << " " << v[2] << std::endl;
-    }   // end for
-}   // end writeVertices
+        ofs << "mtllib " << boost::filesystem::path(matfile).filename().string() << std::endl;
+        ofs << std::endl;
+    }   // end if
 
+    ofs << "# Model has " << model.nvtxs << " vertices" << std::endl;
+    RModelIO::MeshWriters::writePositions<RModelIO::MeshWriters::OBJ>( ofs, model, xf, ff);
+    ofs << std::endl;
 
-void writeMaterialUVs( std::ostream& os, const ObjModel* model, int midx, IIMap& uvmap)
-{
-    int i = 0;
-    const IntSet& uvids = model->uvs( midx);
-    for ( int uvid : uvids)
+    const std::vector<std::vector<uint32_t> > mfaces = model.materialFaces();
+    const int nmats = int(model.numMaterials());
+    if ( nmats > 0)
     {
-        uvmap[uvid] = ++i;  // Pre-increment (.obj lists start at 1)
-        const cv::Vec2f& uv = model->uv(midx, uvid);
-        os << "vt\t" << uv[0] << " " << uv[1] << " " << 0.0 << std::endl;
+        ofs << "# " << model.nuvs << " UV coordinates" << std::endl;
+        RModelIO::MeshWriters::writeUVs<RModelIO::MeshWriters::OBJ>( ofs, model.uvs, model.nuvs, ff);
+        ofs << std::endl;
+    }   // end if
+
+    for ( int mid = 0; mid < nmats; ++mid)
+    {
+        const std::string mname = getMaterialName( fname, mid);
+        ofs << std::endl;
+        ofs << "# Mesh '" << mname << "' with " << mfaces[mid].size() << " faces" << std::endl;
+        ofs << "usemtl " << mname << std::endl;
+        RModelIO::MeshWriters::writeFaces<RModelIO::MeshWriters::OBJ>( ofs, model, true, mfaces[mid].begin(), mfaces[mid].end());
     }   // end for
-    os << std::endl;
-}   // end writeMaterialUVs
+
+    ofs << std::endl;
+    // Not all faces accounted for in materials, so write out the remainder without texture coordinates.
+    const std::vector<uint32_t>& remfaces = mfaces.back();
+    if ( !remfaces.empty())
+    {
+        const std::string mname = getMaterialName( fname, nmats);
+        ofs << "# Mesh '" << mname << "' with " << remfaces.size() << " faces" << std::endl;
+        if ( !matfile.empty())
+            ofs << "usemtl " << mname << std::endl;
+        RModelIO::MeshWriters::writeFaces<RModelIO::MeshWriters::OBJ>( ofs, model, false, remfaces.begin(), remfaces.end());
+    }   // end if
+
+    ofs << std::endl;
+    return ofs.good();
+}   // end writeOBJFile
 
 
-void writeMaterialFaces( std::ostream& os, const ObjModel* model, int midx, const IIMap& vvmap, const IIMap& uvmap, IntSet& rfids)
+bool hasUnmaterialedFaces( const MeshView& model)
 {
-    // Vertex indices are +1 because .obj vertex list starts at 1.
-    const IntSet& mfids = model->materialFaceIds( midx);
-    for ( int fid : mfids)
-    {
-        rfids.erase(fid);
-        const int* vidxs = model->fvidxs(fid);
-        const int* fuvs = model->faceUVs(fid);
-        os << "f\t" << vvmap.at(vidxs[0]) << "/" << uvmap.at(fuvs[0]) << " "
-                    << vvmap.at(vidxs[1]) << "/" << uvmap.at(fuvs[1]) << " "
-                    << vvmap.at(vidxs[2]) << "/" << uvmap.at(fuvs[2]) << std::endl;
-    }   // end for
-}   // end writeMaterialFaces
+    for ( size_t f = 0; f < model.nfaces; ++f)
+        if ( model.material(f) < 0)
+            return true;
+    return false;
+}   // end hasUnmaterialedFaces
 
 }   // end namespace
 
@@ -142,89 +219,83 @@ void writeMaterialFaces( std::ostream& os, const ObjModel* model, int midx, cons
 // protected
 bool OBJExporter::doSave( const ObjModel& model, const std::string& fname)
 {
-    std::string err = "";
+    return doSaveView( viewOf(model), fname);
+}   // end doSave
 
-    // Only need to write out the material file if have materials
+
+// protected
+bool OBJExporter::doSaveView( const MeshView& model, const std::string& fname)
+{
+    // Only need to write out the material file and textures if have materials.
+    // The material file, textures and geometry are all written concurrently.
     std::string matfile = "";
-    if ( model.numMats() > 0)
+    if ( model.numMaterials() > 0)
     {
         matfile = boost::filesystem::path(fname).replace_extension("mtl").string();
-        err = writeMaterialFile( &model, matfile);
-        if ( !err.empty())
+        const std::string txext = textureExtension( _txfmt);
+        const std::vector<int> txparams = textureParams( _txfmt, _txqual);
+        const boost::filesystem::path ppath = boost::filesystem::path(fname).parent_path();
+        const std::string mdir = modelDir( fname);  // Stored textures are referenced relative to here
+
+        IStrMap txfiles;    // Texture filenames (relative to the .mtl file) keyed by material
+        RModelIO::TextureStore::Pending pending;    // Stored textures being written by other exports
+        const int nmats = int(model.numMaterials());
+        for ( int mid = 0; mid < nmats; ++mid)
         {
-            setErr( "Unable to write OBJ .mtl file! " + err);
-            return false;
-        }   // end if
-    }   // end if
-
-    std::ofstream ofs;
-    try
-    {
-        ofs.open( fname.c_str(), std::ios::out);
-        ofs << "# Wavefront OBJ file produced by RModelIO (https://github.com/richeytastic/rModelIO)" << std::endl;
-        ofs << std::endl;
-
-        if ( !matfile.empty())
-        {
-            ofs << "mtllib " << boost::filesystem::path(matfile).filename().string() << std::endl;
-            ofs << std::endl;
-        }   // end if
+            const cv::Mat tx = model.textures[mid];
+            if ( tx.empty())
+                continue;
 
-        ofs << "# Model has " << model.numVtxs() << " vertices" << std::endl;
-
-        IIMap vvmap;
-        writeVertices( ofs, &model, vvmap);
-
-        ofs << std::endl;
-
-        IntSet remfids; // Will hold face IDs not associated with a material
-        const IntSet& fids = model.faces();
-        for ( int fid : fids)
-            remfids.insert(fid);
+            // Copy the original image file if the texture is unchanged since loaded.
+            TextureSources::Source src;
+            if ( _passThru && TextureSources::find( tx, src))
+            {
+                const std::string srcext = boost::filesystem::path(src.path).extension().string();
+                if ( _txstore)
+                {
+                    const uint64_t key = hashBytes( srcext.data(), srcext.size(), src.fileHash);
+                    txfiles[mid] = storedPath( _txstore->storeCopy( fileSink(), key, srcext, src.path, pending), mdir);
+                }   // end if
+                else
+                {
+                    const std::string txfile = getMaterialName( fname, mid) + srcext;
+                    fileSink().addCopy( src.path, (ppath / txfile).string(), _hardLinks);
+                    txfiles[mid] = txfile;
+                }   // end else
+                continue;
+            }   // end if
 
-        int pmid = 0;   // Pseudo material ID if required.
-        const IntSet& mids = model.materialIds();
-        for ( int mid : mids)
-        {
-            const std::string mname = getMaterialName( fname, mid);
-            ofs << "# " << model.uvs(mid).size() << " UV coordinates on material '" << mname << "'" << std::endl;
-            IIMap uvmap;
-            writeMaterialUVs( ofs, &model, mid, uvmap);
-            ofs << std::endl;
-            ofs << "# Mesh '" << mname << "' with " << model.materialFaceIds(mid).size() << " faces" << std::endl;
-            ofs << "usemtl " << mname << std::endl;
-            writeMaterialFaces( ofs, &model, mid, vvmap, uvmap, remfids);
-            pmid = mid+1;
+            const FileSink::Writer writer = [=]( std::ostream& os){ return writeTexture( os, tx, txext, txparams);};
+            if ( _txstore)
+            {
+                // Key on the pixels and the encoding.
+                uint64_t key = hashBytes( txext.data(), txext.size());
+                key = hashBytes( txparams.data(), txparams.size() * sizeof(int), key);
+                key = hashImage( tx, key);
+                txfiles[mid] = storedPath( _txstore->store( fileSink(), key, txext, writer, pending), mdir);
+            }   // end if
+            else
+            {
+                const std::string txfile = getMaterialName( fname, mid) + txext;
+                fileSink().add( (ppath / txfile).string(), writer);
+                txfiles[mid] = txfile;
+            }   // end else
         }   // end for
 
-        ofs << std::endl;
-        // Not all faces accounted for in materials, so write out the remainder without texture coordinates.
-        if ( !remfids.empty())
+        const MeshView* mptr = &model;
+        const bool pseudo = hasUnmaterialedFaces( model);
+        fileSink().add( matfile, [=]( std::ostream& os){ return writeMaterialFile( os, mptr, matfile, txfiles, pseudo);});
+
+        if ( !RModelIO::TextureStore::wait( pending))
         {
-            const std::string mname = getMaterialName( fname, pmid);
-            ofs << "# Mesh '" << mname << "' with " << remfids.size() << " faces" << std::endl;
-            ofs << "usemtl " << mname << std::endl;
-            for ( int fid : remfids)
-            {
-                const int* vidxs = model.fvidxs(fid);
-                ofs << "f\t" << vvmap.at(vidxs[0]) << " " << vvmap.at(vidxs[1]) << " " << vvmap.at(vidxs[2]) << std::endl;
-            }   // end for
+            setErr( "[ERROR] RModelIO::OBJExporter::doSaveView: Unable to write stored textures!");
+            return false;
         }   // end if
-
-        ofs << std::endl;
-        ofs.close();
-    }   // end try
-    catch ( const std::exception &e)
-    {
-        err = e.what();
-    }   // end catch
-
-    bool success = true;
-    if ( !err.empty())
-    {
-        setErr( "Unable to write OBJ file! : " + err);
-        success = false;
     }   // end if
-    return success;
-}   // end doSave
 
+    const MeshView* mptr = &model;
+    const RModelIO::Transform xf = transform();
+    const RModelIO::FloatFormat ff = floatFormat();
+    fileSink().add( fname, [=]( std::ostream& os){ return writeOBJFile( os, *mptr, xf, ff, fname, matfile);});
+    return true;
+}   // end doSaveView
@@ -16,18 +16,149 @@
  ************************************************************************/
 
 #include <ObjModelExporter.h>
+#include <StreamSink.h>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/filesystem/operations.hpp>
 using RModelIO::ObjModelExporter;
+using RModelIO::MeshView;
+using RModelIO::ModelArrays;
 using RFeatures::ObjModel;
 
 
 // public
-ObjModelExporter::ObjModelExporter() : rlib::IOFormats()
+ObjModelExporter::ObjModelExporter() : rlib::IOFormats(), _nthreads(0), _maxPending(16), _wroteModel(false), _toStream(false)
 {
 }   // end ctor
 
 
+// public
+void ObjModelExporter::setFileConcurrency( size_t nthreads, size_t maxPending)
+{
+    _nthreads = nthreads;
+    _maxPending = maxPending;
+    _sink = nullptr;
+}   // end setFileConcurrency
+
+
+// protected
+RModelIO::FileSink& ObjModelExporter::fileSink()
+{
+    if ( !_sink)
+        _sink = FileSink::create( _nthreads, _maxPending);
+    return *_sink;
+}   // end fileSink
+
+
+// protected
+std::string ObjModelExporter::modelDir( const std::string& fname) const
+{
+    return _toStream ? _sideDir : boost::filesystem::path(fname).parent_path().string();
+}   // end modelDir
+
+
+// protected
+const MeshView& ObjModelExporter::viewOf( const ObjModel& model)
+{
+    std::shared_ptr<ModelArrays> arrays( new ModelArrays( model));
+    _held = arrays;
+    return arrays->view;
+}   // end viewOf
+
+
+// protected
+bool ObjModelExporter::saveUsing( const std::string& fname, const std::function<bool( const std::string&)>& saver)
+{
+    return _saveFile( fname, saver);
+}   // end saveUsing
+
+
+// protected virtual
+bool ObjModelExporter::doSaveView( const MeshView& view, const std::string& fname)
+{
+    const ObjModel::Ptr model = view.toModel();
+    _held = model;
+    return doSave( *model, fname);
+}   // end doSaveView
+
+
 // public
 bool ObjModelExporter::save( const ObjModel& model, const std::string& fname)
+{
+    return _saveFile( fname, [&]( const std::string& f){ return doSave( model, f);});
+}   // end save
+
+
+// public
+bool ObjModelExporter::save( const ObjModel& model, std::ostream& os, const std::string& name, FileSink* sideSink)
+{
+    return _saveStream( os, name, sideSink, [&]( const std::string& f){ return doSave( model, f);});
+}   // end save
+
+
+// public
+bool ObjModelExporter::save( const ObjModel& model, std::vector<char>& buf, const std::string& name, FileSink* sideSink)
+{
+    namespace bio = boost::iostreams;
+    buf.clear();
+    bio::stream<bio::back_insert_device<std::vector<char> > > os( buf);
+    const bool success = save( model, os, name, sideSink);
+    os.flush();
+    return success;
+}   // end save
+
+
+namespace {
+bool checkView( const MeshView& view, std::string& err)
+{
+    err = view.check();
+    if ( !err.empty())
+        err = "Invalid mesh view! : " + err;
+    return err.empty();
+}   // end checkView
+}   // end namespace
+
+
+// public
+bool ObjModelExporter::save( const MeshView& view, const std::string& fname)
+{
+    std::string verr;
+    if ( !checkView( view, verr))
+    {
+        setErr( verr);
+        return false;
+    }   // end if
+    return _saveFile( fname, [&]( const std::string& f){ return doSaveView( view, f);});
+}   // end save
+
+
+// public
+bool ObjModelExporter::save( const MeshView& view, std::ostream& os, const std::string& name, FileSink* sideSink)
+{
+    std::string verr;
+    if ( !checkView( view, verr))
+    {
+        setErr( verr);
+        return false;
+    }   // end if
+    return _saveStream( os, name, sideSink, [&]( const std::string& f){ return doSaveView( view, f);});
+}   // end save
+
+
+// public
+bool ObjModelExporter::save( const MeshView& view, std::vector<char>& buf, const std::string& name, FileSink* sideSink)
+{
+    namespace bio = boost::iostreams;
+    buf.clear();
+    bio::stream<bio::back_insert_device<std::vector<char> > > os( buf);
+    const bool success = save( view, os, name, sideSink);
+    os.flush();
+    return success;
+}   // end save
+
+
+// private
+bool ObjModelExporter::_saveFile( const std::string& fname, const Saver& saver)
 {
     if ( fname.empty())
     {
@@ -36,11 +167,119 @@ bool ObjModelExporter::save( const ObjModel& model, const std::string& fname)
     }   // end if
 
     setErr(""); // Clear error
-    if ( !isSupported( fname))
+    const std::string sname = stripCompression( fname);
+    if ( !isSupported( sname))
     {
         setErr( fname + " has an unsupported file extension for exporting!");
         return false;
     }   // end if
 
-    return doSave( model, fname);    // virtual
-}   // end save
+    const Compression c = compressionOf( fname);
+    if ( !compressionAvailable( c))
+    {
+        setErr( fname + " uses a compression format not available in this build!");
+        return false;
+    }   // end if
+
+    // Exporters save to the uncompressed name and the sink compresses the model file.
+    if ( c != NO_COMPRESSION)
+        fileSink().setCompression( sname, c);
+
+    _wroteModel = false;
+    bool success = saver( sname);
+
+    // Wait for completion of all files queued during the save.
+    if ( _sink && !_sink->wait() && success)
+    {
+        setErr( "Unable to write all files! : " + _sink->err());
+        success = false;
+    }   // end if
+    _held = nullptr;
+
+    if ( c != NO_COMPRESSION)
+    {
+        fileSink().setCompression( sname, NO_COMPRESSION);
+        // Exporters that write the model file directly rather than through the sink
+        // leave an uncompressed file which must be compressed here.
+        if ( success && _wroteModel)
+        {
+            success = compressFile( sname, fname, c);
+            if ( !success)
+                setErr( "Unable to compress " + sname + " to " + fname);
+            boost::system::error_code ec;
+            boost::filesystem::remove( sname, ec);
+        }   // end if
+    }   // end if
+
+    return success;
+}   // end _saveFile
+
+
+// private
+bool ObjModelExporter::_saveStream( std::ostream& os, const std::string& name, FileSink* sideSink, const Saver& saver)
+{
+    setErr(""); // Clear error
+    const std::string fname = name.find('.') == std::string::npos ? "model." + name : name;
+    const std::string sname = stripCompression( fname);
+    if ( !isSupported( sname))
+    {
+        setErr( fname + " has an unsupported file extension for exporting!");
+        return false;
+    }   // end if
+
+    const Compression c = compressionOf( fname);
+    if ( !compressionAvailable( c))
+    {
+        setErr( fname + " uses a compression format not available in this build!");
+        return false;
+    }   // end if
+
+    const bool success = writeCompressed( os, c, [&]( std::ostream& cos){ return _saveToStream( cos, sname, sideSink, saver);});
+    if ( !success && err().empty())
+        setErr( "Unable to write compressed model to stream!");
+    return success;
+}   // end _saveStream
+
+
+// private
+bool ObjModelExporter::_saveToStream( std::ostream& os, const std::string& fname, FileSink* sideSink, const Saver& saver)
+{
+    // Exporters save to names in a private working directory from which the stream sink
+    // streams the model file and passes on any side files. The directory only exists
+    // for exporters that write files directly.
+    namespace bfs = boost::filesystem;
+    boost::system::error_code ec;
+    const bfs::path workDir = bfs::temp_directory_path( ec) / bfs::unique_path( "rModelIO-%%%%-%%%%-%%%%");
+    const std::string wname = (workDir / bfs::path(fname).filename()).string();
+    if ( needsWorkingDir( wname) && (ec || !bfs::create_directories( workDir, ec)))
+    {
+        setErr( "Unable to create working directory for saving to stream!");
+        return false;
+    }   // end if
+
+    _toStream = true;
+    _sideDir = bfs::path(fname).parent_path().string();
+    std::shared_ptr<StreamSink> ssink( new StreamSink( os, wname, workDir.string(), sideSink, _sideDir));
+    const FileSink::Ptr fsink = _sink;
+    _sink = ssink;
+
+    bool success = saver( wname);
+    if ( !ssink->wait() && success)
+    {
+        setErr( "Unable to write all files! : " + ssink->err());
+        success = false;
+    }   // end if
+
+    if ( !ssink->finish() && success)
+    {
+        setErr( "Unable to write model or side files!" + (sideSink ? " : " + sideSink->err() : ""));
+        success = false;
+    }   // end if
+
+    _held = nullptr;
+    _sink = fsink;
+    _toStream = false;
+    _sideDir.clear();
+    bfs::remove_all( workDir, ec);
+    return success;
+}   // end _saveToStream
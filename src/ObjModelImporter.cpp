@@ -16,7 +16,19 @@
  ************************************************************************/
 
 #include <ObjModelImporter.h>
+#include <RMBExporter.h>
+#include <RMBFormat.h>
+#include <RMBImporter.h>
+#include <ContentHash.h>
+#include <boost/filesystem/operations.hpp>
+#include <iomanip>
+#include <sstream>
+#include <typeinfo>
 using RModelIO::ObjModelImporter;
+using RModelIO::FileCache;
+using RModelIO::FlatMesh;
+using RModelIO::ModelArrays;
+using RFeatures::ObjModel;
 
 
 ObjModelImporter::ObjModelImporter() : rlib::IOFormats()
@@ -24,14 +36,139 @@ ObjModelImporter::ObjModelImporter() : rlib::IOFormats()
 }   // end ctor
 
 
-RFeatures::ObjModel::Ptr ObjModelImporter::load( const std::string& fname)
+// private
+bool ObjModelImporter::_checkLoad( const std::string& fname)
 {
     setErr(""); // Clear error
-    if ( !isSupported( fname))
+    if ( !isSupported( stripCompression( fname)))
     {
         setErr( fname + " has an unsupported file extension for importing!");
+        return false;
+    }   // end if
+
+    if ( !compressionAvailable( compressionOf( fname)))
+    {
+        setErr( fname + " uses a compression format not available in this build!");
+        return false;
+    }   // end if
+
+    return true;
+}   // end _checkLoad
+
+
+// public
+RFeatures::ObjModel::Ptr ObjModelImporter::load( const std::string& fname)
+{
+    if ( !_checkLoad( fname))
         return RFeatures::ObjModel::Ptr();
+
+    if ( !_cache)
+        return doLoad( fname);  // virtual
+
+    std::string key;
+    if ( !_cacheKey( fname, "obj", key))
+        return doLoad( fname);
+
+    const std::string cfile = _cache->lookup( key);
+    if ( !cfile.empty())
+    {
+        RMBImporter rmb;
+        ObjModel::Ptr model = rmb.load( cfile);
+        if ( model)
+            return model;
+        _cache->invalidate( key);   // Corrupt, or evicted by another process since lookup
     }   // end if
 
-    return doLoad( fname);  // virtual
+    ObjModel::Ptr model = doLoad( fname);
+    if ( model)
+    {
+        const ObjModel* mptr = model.get();
+        if ( !_cache->insert( key, [mptr]( std::ostream& os){ return RModelIO::RMBExporter::write( os, *mptr);}))
+            std::cerr << "[WARNING] RModelIO::ObjModelImporter::load: Unable to cache model from " << fname << std::endl;
+    }   // end if
+    return model;
 }   // end load
+
+
+// public
+FlatMesh::Ptr ObjModelImporter::loadFlat( const std::string& fname)
+{
+    if ( !_checkLoad( fname))
+        return nullptr;
+
+    if ( !_cache)
+        return doLoadFlat( fname);  // virtual
+
+    std::string key;
+    if ( !_cacheKey( fname, "flat", key))
+        return doLoadFlat( fname);
+
+    const std::string cfile = _cache->lookup( key);
+    if ( !cfile.empty())
+    {
+        RMBImporter rmb;
+        FlatMesh::Ptr mesh = rmb.loadFlat( cfile);
+        if ( mesh)
+            return mesh;
+        _cache->invalidate( key);
+    }   // end if
+
+    FlatMesh::Ptr mesh = doLoadFlat( fname);
+    if ( mesh)
+    {
+        const FlatMesh* mptr = mesh.get();
+        if ( !_cache->insert( key, [mptr]( std::ostream& os){ return RModelIO::RMBExporter::write( os, mptr->view());}))
+            std::cerr << "[WARNING] RModelIO::ObjModelImporter::loadFlat: Unable to cache model from " << fname << std::endl;
+    }   // end if
+    return mesh;
+}   // end loadFlat
+
+
+// protected virtual
+FlatMesh::Ptr ObjModelImporter::doLoadFlat( const std::string& fname)
+{
+    const ObjModel::Ptr model = doLoad( fname);
+    if ( !model)
+        return nullptr;
+    const ModelArrays arrays( *model);
+    return FlatMesh::create( arrays.view);
+}   // end doLoadFlat
+
+
+// public static
+FileCache::Ptr ObjModelImporter::createCache( const std::string& dir, uint64_t maxBytes)
+{
+    return FileCache::create( dir, ".rmb", maxBytes);
+}   // end createCache
+
+
+// private
+// The mode distinguishes load from loadFlat since their cached files differ.
+bool ObjModelImporter::_cacheKey( const std::string& fname, const char* mode, std::string& key) const
+{
+    namespace bfs = boost::filesystem;
+    boost::system::error_code ec;
+    const bfs::path cpath = bfs::canonical( fname, ec);
+    if ( ec)
+        return false;
+    const uintmax_t fsize = bfs::file_size( cpath, ec);
+    if ( ec)
+        return false;
+    const std::time_t mtime = bfs::last_write_time( cpath, ec);
+    if ( ec)
+        return false;
+
+    std::ostringstream oss;
+    oss << cpath.string() << '\n' << fsize << '\n' << mtime << '\n'
+        << typeid(*this).name() << '\n' << optionsKey() << '\n' << RModelIO::RMB::VERSION << '\n' << mode;
+    if ( !_transform.isIdentity())
+    {
+        oss << std::setprecision(17);
+        for ( int i = 0; i < 3; ++i)
+            for ( int j = 0; j < 4; ++j)
+                oss << ' ' << _transform.matrix()(i,j);
+    }   // end if
+    const std::string desc = oss.str();
+    key = RModelIO::hashString( RModelIO::hashBytes( desc.data(), desc.size()));
+    return true;
+}   // end _cacheKey
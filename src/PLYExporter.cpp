@@ -16,9 +16,11 @@
  ************************************************************************/
 
 #include <PLYExporter.h>
+#include <MeshWriters.h>
+#include <boost/iterator/counting_iterator.hpp>
 using RModelIO::PLYExporter;
+using RModelIO::MeshView;
 using RFeatures::ObjModel;
-#include <fstream>
 #include <cassert>
 
 
@@ -29,54 +31,45 @@ PLYExporter::PLYExporter() : RModelIO::ObjModelExporter()
 
 
 
-// protected
-bool PLYExporter::doSave( const ObjModel& m, const std::string& fname)
-{
-    std::string err;
-    std::ofstream ofs;
-    try
-    {
-        const int nv = m.numVtxs();
-        const int np = m.numPolys();
+namespace {
 
-        ofs.open( fname.c_str(), std::ios::out);
-        ofs << "ply" << std::endl;
-        ofs << "format ascii 1.0" << std::endl;
-        ofs << "comment Polygon File Format file produced by RModelIO (https://github.com/richeytastic/rModelIO)" << std::endl;
-        ofs << "element vertex " << nv << std::endl;
-        ofs << "property float x" << std::endl;
-        ofs << "property float y" << std::endl;
-        ofs << "property float z" << std::endl;
-        ofs << "element face " << np << std::endl;
-        ofs << "property list uchar int vertex_index" << std::endl;
-        ofs << "end_header" << std::endl;
+bool writePLYFile( std::ostream& ofs, const MeshView& m, const RModelIO::Transform& xf, const RModelIO::FloatFormat& ff)
+{
+    ofs << "ply" << std::endl;
+    ofs << "format ascii 1.0" << std::endl;
+    ofs << "comment Polygon File Format file produced by RModelIO (https://github.com/richeytastic/rModelIO)" << std::endl;
+    ofs << "element vertex " << m.nvtxs << std::endl;
+    ofs << "property float x" << std::endl;
+    ofs << "property float y" << std::endl;
+    ofs << "property float z" << std::endl;
+    ofs << "element face " << m.nfaces << std::endl;
+    ofs << "property list uchar int vertex_index" << std::endl;
+    ofs << "end_header" << std::endl;
 
-        const IntSet& vids = m.vtxIds();
-        std::unordered_map<int,int> vvmap;
-        int i = 0;
-        for ( int vid : vids)
-        {
-            vvmap[vid] = i++;   // Post-increment for PLY
-            ofs << m.vtx(vid)[0] << " " << m.vtx(vid)[1] << " " << m.vtx(vid)[2] << std::endl;
-        }   // end for
+    using namespace RModelIO::MeshWriters;
+    writePositions<PLY>( ofs, m, xf, ff);
+    const boost::counting_iterator<size_t> fbegin(0), fend( m.nfaces);
+    writeFaces<PLY, NO_UVS>( ofs, m, fbegin, fend);
 
-        const IntSet& fids = m.faces();
-        for ( int fid : fids)
-        {
-            const int* f = m.fvidxs(fid);
-            ofs << "3 " << vvmap.at(f[0]) << " " << vvmap.at(f[1]) << " " << vvmap.at(f[2]) << std::endl;
-        }   // end for
+    return ofs.good();
+}   // end writePLYFile
 
-        ofs.close();
-    }   // end try
-    catch ( const std::exception &e)
-    {
-        err = e.what();
-    }   // end catch
+}   // end namespace
 
-    if ( !err.empty())
-        setErr( "Unable to write PLY file! : " + err);
 
-    return err.empty();
+// protected
+bool PLYExporter::doSave( const ObjModel& m, const std::string& fname)
+{
+    return doSaveView( viewOf(m), fname);
 }   // end doSave
 
+
+// protected
+bool PLYExporter::doSaveView( const MeshView& m, const std::string& fname)
+{
+    const MeshView* mptr = &m;
+    const RModelIO::Transform xf = transform();
+    const RModelIO::FloatFormat ff = floatFormat();
+    fileSink().add( fname, [mptr, xf, ff]( std::ostream& os){ return writePLYFile( os, *mptr, xf, ff);});
+    return true;
+}   // end doSaveView
@@ -0,0 +1,187 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include <RMBExporter.h>
+#include <RMBFormat.h>
+#include <cstring>
+using RModelIO::RMBExporter;
+using RModelIO::MeshView;
+using RModelIO::ModelArrays;
+using RModelIO::Transform;
+using RFeatures::ObjModel;
+namespace RMB = RModelIO::RMB;
+
+
+RMBExporter::RMBExporter() : RModelIO::ObjModelExporter()
+{
+    addSupported( "rmb", "RModelIO Binary Model");
+}   // end ctor
+
+
+namespace {
+
+// A section's contents before writing.
+struct Block
+{
+    RMB::Section sec;
+    const void* data;
+    std::vector<char> head;     // Written before data (texture header)
+};  // end struct
+
+
+void addBlock( std::vector<Block>& blocks, uint32_t type, uint32_t mat, const void* data, size_t n, const std::vector<char>& head=std::vector<char>())
+{
+    Block b;
+    b.sec.type = type;
+    b.sec.material = mat;
+    b.sec.offset = 0;
+    b.sec.size = head.size() + n;
+    b.data = data;
+    b.head = head;
+    blocks.push_back(b);
+}   // end addBlock
+
+
+void writePadding( std::ostream& os, uint64_t& pos)
+{
+    static const char zeros[RMB::ALIGNMENT] = {0};
+    const uint64_t apos = RMB::align( pos);
+    os.write( zeros, apos - pos);
+    pos = apos;
+}   // end writePadding
+
+}   // end namespace
+
+
+// public static
+bool RMBExporter::write( std::ostream& os, const ObjModel& m, const Transform& xf)
+{
+    const ModelArrays arrays( m);
+    return write( os, arrays.view, xf);
+}   // end write
+
+
+// public static
+bool RMBExporter::write( std::ostream& os, const MeshView& m, const Transform& xf)
+{
+    // Positions and faces are written straight from the view's arrays.
+    std::vector<Block> blocks;
+    addBlock( blocks, RMB::POSITIONS, 0, m.positions, m.nvtxs * 3 * sizeof(float));
+    addBlock( blocks, RMB::FACES, 0, m.indices, m.nfaces * 3 * sizeof(uint32_t));
+
+    // Per material face lists, corner texture coordinates and raw texture pixels.
+    const size_t nmats = m.numMaterials();
+    const std::vector<std::vector<uint32_t> > mfaces = m.materialFaces();
+    std::vector<std::vector<float> > muvs( nmats);
+    std::vector<cv::Mat> txs( nmats);
+    uint32_t midx = 0;
+    for ( ; midx < nmats; ++midx)
+    {
+        const std::vector<uint32_t>& mf = mfaces[midx];
+        std::vector<float>& uvs = muvs[midx];
+        uvs.reserve( 6*mf.size());
+        for ( uint32_t f : mf)
+        {
+            for ( int i = 0; i < 3; ++i)
+            {
+                const float* uv = m.uv( m.uvIndex( f, i));
+                uvs.push_back( uv[0]);
+                uvs.push_back( uv[1]);
+            }   // end for
+        }   // end for
+
+        cv::Mat tx = m.textures[midx];
+        if ( !tx.isContinuous())
+            tx = tx.clone();
+        txs[midx] = tx;
+
+        RMB::TextureHeader th;
+        th.rows = tx.rows;
+        th.cols = tx.cols;
+        th.type = tx.type();
+        th.reserved = 0;
+        std::vector<char> thead( sizeof(th));
+        std::memcpy( &thead[0], &th, sizeof(th));
+
+        addBlock( blocks, RMB::MATERIAL_FACES, midx, mf.data(), mf.size() * sizeof(uint32_t));
+        addBlock( blocks, RMB::MATERIAL_UVS, midx, uvs.data(), uvs.size() * sizeof(float));
+        addBlock( blocks, RMB::TEXTURE, midx, tx.data, tx.total() * tx.elemSize(), thead);
+    }   // end for
+
+    // Lay out the sections after the header and section table.
+    RMB::Header hdr;
+    std::memcpy( hdr.magic, RMB::MAGIC, sizeof(hdr.magic));
+    hdr.version = RMB::VERSION;
+    hdr.endianMark = RMB::ENDIAN_MARK;
+    hdr.nsections = uint32_t( blocks.size());
+    hdr.tableOffset = RMB::align( sizeof(RMB::Header));
+    hdr.nvtxs = uint32_t( m.nvtxs);
+    hdr.nfaces = uint32_t( m.nfaces);
+    hdr.nmats = midx;
+    hdr.reserved = 0;
+
+    uint64_t offset = hdr.tableOffset + blocks.size() * sizeof(RMB::Section);
+    for ( Block& b : blocks)
+    {
+        b.sec.offset = RMB::align( offset);
+        offset = b.sec.offset + b.sec.size;
+    }   // end for
+    hdr.fileSize = offset;
+
+    uint64_t wpos = 0;
+    os.write( reinterpret_cast<const char*>( &hdr), sizeof(hdr));
+    wpos += sizeof(hdr);
+    writePadding( os, wpos);
+    for ( const Block& b : blocks)
+        os.write( reinterpret_cast<const char*>( &b.sec), sizeof(b.sec));
+    wpos += blocks.size() * sizeof(RMB::Section);
+
+    for ( const Block& b : blocks)
+    {
+        writePadding( os, wpos);
+        if ( !b.head.empty())
+            os.write( b.head.data(), b.head.size());
+        const size_t n = size_t( b.sec.size - b.head.size());
+        if ( b.sec.type == RMB::POSITIONS)
+        {
+            xf.forEachBatch( m.positions, m.nvtxs, [&os]( const float* p, size_t np)
+                    { os.write( reinterpret_cast<const char*>( p), np * 3 * sizeof(float));});
+        }   // end if
+        else if ( n > 0)
+            os.write( reinterpret_cast<const char*>( b.data), n);
+        wpos += b.sec.size;
+    }   // end for
+
+    return os.good();
+}   // end write
+
+
+// protected
+bool RMBExporter::doSave( const ObjModel& m, const std::string& fname)
+{
+    return doSaveView( viewOf(m), fname);
+}   // end doSave
+
+
+// protected
+bool RMBExporter::doSaveView( const MeshView& m, const std::string& fname)
+{
+    const MeshView* mptr = &m;
+    const Transform xf = transform();
+    fileSink().add( fname, [mptr, xf]( std::ostream& os){ return write( os, *mptr, xf);});
+    return true;
+}   // end doSaveView
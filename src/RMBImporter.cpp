@@ -0,0 +1,347 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include <RMBImporter.h>
+#include <RMBFormat.h>
+#include <Compression.h>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <cstring>
+#include <sstream>
+using RModelIO::RMBImporter;
+using RModelIO::FlatMesh;
+using RModelIO::Transform;
+using RFeatures::ObjModel;
+namespace RMB = RModelIO::RMB;
+
+
+RMBImporter::RMBImporter( bool loadTextures)
+    : RModelIO::ObjModelImporter(), _loadTextures(loadTextures)
+{
+    addSupported( "rmb", "RModelIO Binary Model");
+}   // end ctor
+
+
+namespace {
+
+const int32_t MAX_TEXTURE_SIDE = 65536;     // Maximum texture rows and columns
+const size_t MAX_TEXTURE_ELEM = 32;         // Maximum bytes per texture element (four 64 bit channels)
+
+// The validated sections of a mapped file.
+struct Mapped
+{
+    const RMB::Header* hdr;
+    const float* pos;
+    const uint32_t* faces;
+    struct Material
+    {
+        const uint32_t* faces;
+        const float* uvs;
+        uint32_t nfaces;
+        const RMB::TextureHeader* tx;
+        const char* pixels;
+    };  // end struct
+    std::vector<Material> mats;
+};  // end struct
+
+
+// Check the header and section table returning an empty string if the file is good.
+std::string validate( const char* data, uint64_t fsize, Mapped& mp)
+{
+    if ( fsize < sizeof(RMB::Header))
+        return "File too small for header";
+
+    mp.hdr = reinterpret_cast<const RMB::Header*>( data);
+    const RMB::Header& hdr = *mp.hdr;
+    if ( std::memcmp( hdr.magic, RMB::MAGIC, sizeof(hdr.magic)) != 0)
+        return "Not an RMB file";
+    if ( hdr.endianMark != RMB::ENDIAN_MARK)
+        return "File byte order differs from this platform";
+    if ( hdr.version != RMB::VERSION)
+    {
+        std::ostringstream oss;
+        oss << "Unsupported format version " << hdr.version << " (expected " << RMB::VERSION << ")";
+        return oss.str();
+    }   // end if
+    if ( hdr.fileSize != fsize)
+        return "File size doesn't match header (truncated?)";
+    if ( hdr.tableOffset % RMB::ALIGNMENT != 0 || hdr.tableOffset > fsize
+            || uint64_t(hdr.nsections) > (fsize - hdr.tableOffset) / sizeof(RMB::Section))
+        return "Section table out of bounds";
+    if ( uint64_t(hdr.nmats) * 3 > hdr.nsections)     // Each material has faces, texture coordinates and a texture
+        return "Too many materials for the section table";
+
+    mp.pos = nullptr;
+    mp.faces = nullptr;
+    mp.mats.assign( hdr.nmats, Mapped::Material{ nullptr, nullptr, 0, nullptr, nullptr});
+    std::vector<bool> haveFaces( hdr.nmats, false), haveUVs( hdr.nmats, false);
+
+    const RMB::Section* secs = reinterpret_cast<const RMB::Section*>( data + hdr.tableOffset);
+    for ( uint32_t i = 0; i < hdr.nsections; ++i)
+    {
+        const RMB::Section& s = secs[i];
+        if ( s.offset % RMB::ALIGNMENT != 0 || s.offset > fsize || s.size > fsize - s.offset)
+            return "Section out of bounds";
+        const char* sdata = data + s.offset;
+
+        if ( s.type >= RMB::MATERIAL_FACES && s.type <= RMB::TEXTURE && s.material >= hdr.nmats)
+            return "Section has invalid material index";
+
+        switch ( s.type)
+        {
+            case RMB::POSITIONS:
+                if ( s.size != uint64_t(hdr.nvtxs) * 3 * sizeof(float))
+                    return "Positions size mismatch";
+                mp.pos = reinterpret_cast<const float*>( sdata);
+                break;
+            case RMB::FACES:
+                if ( s.size != uint64_t(hdr.nfaces) * 3 * sizeof(uint32_t))
+                    return "Faces size mismatch";
+                mp.faces = reinterpret_cast<const uint32_t*>( sdata);
+                break;
+            case RMB::MATERIAL_FACES:
+                if ( s.size % sizeof(uint32_t) != 0)
+                    return "Material faces size mismatch";
+                mp.mats[s.material].faces = reinterpret_cast<const uint32_t*>( sdata);
+                mp.mats[s.material].nfaces = uint32_t( s.size / sizeof(uint32_t));
+                haveFaces[s.material] = true;
+                break;
+            case RMB::MATERIAL_UVS:
+                mp.mats[s.material].uvs = reinterpret_cast<const float*>( sdata);
+                haveUVs[s.material] = true;
+                break;
+            case RMB::TEXTURE:
+            {
+                if ( s.size < sizeof(RMB::TextureHeader))
+                    return "Texture section too small";
+                const RMB::TextureHeader* th = reinterpret_cast<const RMB::TextureHeader*>( sdata);
+                if ( th->rows < 0 || th->cols < 0 || th->type < 0 || CV_MAT_DEPTH( th->type) > CV_64F || th->type > CV_MAT_TYPE_MASK)
+                    return "Invalid texture dimensions or type";
+                // Bounded so the expected size (checked below) can't overflow.
+                if ( th->rows > MAX_TEXTURE_SIDE || th->cols > MAX_TEXTURE_SIDE || size_t( CV_ELEM_SIZE( th->type)) > MAX_TEXTURE_ELEM)
+                    return "Texture too large";
+                mp.mats[s.material].tx = th;
+                mp.mats[s.material].pixels = sdata + sizeof(RMB::TextureHeader);
+                break;
+            }   // end case
+            default:
+                break;  // Unknown sections are ignored
+        }   // end switch
+    }   // end for
+
+    if ( !mp.pos || !mp.faces)
+        return "Missing positions or faces";
+
+    const uint64_t nf3 = 3 * uint64_t( hdr.nfaces);    // Can't overflow
+    for ( uint64_t i = 0; i < nf3; ++i)
+        if ( mp.faces[i] >= hdr.nvtxs)
+            return "Face vertex index out of range";
+
+    for ( uint32_t j = 0; j < hdr.nmats; ++j)
+    {
+        const Mapped::Material& mat = mp.mats[j];
+        if ( !haveFaces[j] || !haveUVs[j] || !mat.tx)
+            return "Incomplete material";
+        for ( uint32_t i = 0; i < mat.nfaces; ++i)
+            if ( mat.faces[i] >= hdr.nfaces)
+                return "Material face index out of range";
+    }   // end for
+
+    // Sizes that depend on other sections can only be checked once all have been read.
+    for ( uint32_t i = 0; i < hdr.nsections; ++i)
+    {
+        const RMB::Section& s = secs[i];
+        if ( s.type == RMB::MATERIAL_UVS)
+        {
+            if ( s.size != uint64_t( mp.mats[s.material].nfaces) * 6 * sizeof(float))
+                return "Material texture coordinates size mismatch";
+        }   // end if
+        else if ( s.type == RMB::TEXTURE)
+        {
+            const RMB::TextureHeader* th = mp.mats[s.material].tx;
+            if ( s.size - sizeof(RMB::TextureHeader) != uint64_t( th->rows) * th->cols * CV_ELEM_SIZE( th->type))
+                return "Texture size mismatch";
+        }   // end else if
+    }   // end for
+
+    return "";
+}   // end validate
+
+
+ObjModel::Ptr createModel( const Mapped& mp, bool loadTextures, const Transform& xf)
+{
+    const RMB::Header& hdr = *mp.hdr;
+    ObjModel::Ptr model = ObjModel::create();
+
+    std::vector<int> vids;
+    vids.reserve( hdr.nvtxs);
+    xf.forEachBatch( mp.pos, hdr.nvtxs, [&]( const float* p, size_t n)
+    {
+        for ( size_t i = 0; i < n; ++i, p += 3)
+            vids.push_back( model->addVertex( p[0], p[1], p[2]));
+    });
+
+    std::vector<int> fids( hdr.nfaces);
+    const uint32_t* f = mp.faces;
+    for ( uint32_t i = 0; i < hdr.nfaces; ++i, f += 3)
+        fids[i] = model->addFace( vids[f[0]], vids[f[1]], vids[f[2]]);
+
+    if ( !loadTextures)
+        return model;
+
+    for ( const Mapped::Material& mat : mp.mats)
+    {
+        // The mapping is released after loading so the texture must be copied out.
+        cv::Mat tx;
+        if ( mat.tx->rows > 0 && mat.tx->cols > 0)
+            tx = cv::Mat( mat.tx->rows, mat.tx->cols, mat.tx->type, const_cast<char*>( mat.pixels)).clone();
+        const int mid = model->addMaterial( tx);
+        if ( mid < 0)
+            return nullptr;
+
+        const float* uv = mat.uvs;
+        for ( uint32_t i = 0; i < mat.nfaces; ++i, uv += 6)
+        {
+            const int fid = fids[mat.faces[i]];
+            if ( fid < 0)
+                continue;
+            const cv::Vec2f uvs[3] = { cv::Vec2f( uv[0], uv[1]), cv::Vec2f( uv[2], uv[3]), cv::Vec2f( uv[4], uv[5])};
+            model->setOrderedFaceUVs( mid, fid, uvs);
+        }   // end for
+    }   // end for
+
+    return model;
+}   // end createModel
+
+
+// Copy the mapped sections straight into a flat mesh with faces reordered by material.
+FlatMesh::Ptr createFlat( const Mapped& mp, bool loadTextures, const Transform& xf)
+{
+    const RMB::Header& hdr = *mp.hdr;
+    FlatMesh::Ptr mesh = FlatMesh::create();
+    mesh->positions.resize( size_t(3) * hdr.nvtxs);
+    if ( hdr.nvtxs > 0)
+        xf.apply( mp.pos, hdr.nvtxs, &mesh->positions[0]);
+
+    if ( !loadTextures || hdr.nmats == 0)
+    {
+        mesh->indices.assign( mp.faces, mp.faces + size_t(3) * hdr.nfaces);
+        return mesh;
+    }   // end if
+
+    // Each material's texture coordinates are stored per face corner so are copied as a block.
+    size_t nmfaces = 0;
+    for ( const Mapped::Material& mat : mp.mats)
+        nmfaces += mat.nfaces;
+    mesh->indices.reserve( size_t(3) * hdr.nfaces);
+    mesh->uvs.resize( size_t(6) * nmfaces);
+    mesh->uvIndices.reserve( size_t(3) * hdr.nfaces);
+
+    std::vector<bool> textured( hdr.nfaces, false);
+    float* uvs = mesh->uvs.data();
+    for ( const Mapped::Material& mat : mp.mats)
+    {
+        mesh->materialOffsets.push_back( uint32_t( mesh->indices.size() / 3));
+        for ( uint32_t i = 0; i < mat.nfaces; ++i)
+        {
+            const uint32_t* f = &mp.faces[size_t(3) * mat.faces[i]];
+            mesh->indices.insert( mesh->indices.end(), f, f+3);
+            textured[mat.faces[i]] = true;
+        }   // end for
+
+        const uint32_t uv0 = uint32_t( mesh->uvIndices.size());
+        for ( size_t i = 0; i < size_t(3) * mat.nfaces; ++i)
+            mesh->uvIndices.push_back( uint32_t( uv0 + i));
+        if ( mat.nfaces > 0)
+            std::memcpy( uvs, mat.uvs, size_t(6) * mat.nfaces * sizeof(float));
+        uvs += size_t(6) * mat.nfaces;
+
+        cv::Mat tx;
+        if ( mat.tx->rows > 0 && mat.tx->cols > 0)
+            tx = cv::Mat( mat.tx->rows, mat.tx->cols, mat.tx->type, const_cast<char*>( mat.pixels)).clone();
+        mesh->textures.push_back( tx);
+    }   // end for
+    mesh->materialOffsets.push_back( uint32_t( mesh->indices.size() / 3));
+
+    // Remaining faces without a material.
+    for ( uint32_t i = 0; i < hdr.nfaces; ++i)
+    {
+        if ( textured[i])
+            continue;
+        mesh->indices.insert( mesh->indices.end(), &mp.faces[size_t(3) * i], &mp.faces[size_t(3) * i + 3]);
+        mesh->uvIndices.insert( mesh->uvIndices.end(), 3, 0);
+    }   // end for
+
+    return mesh;
+}   // end createFlat
+
+
+void create( const Mapped& mp, bool loadTextures, const Transform& xf, ObjModel::Ptr& model) { model = createModel( mp, loadTextures, xf);}
+void create( const Mapped& mp, bool loadTextures, const Transform& xf, FlatMesh::Ptr& mesh) { mesh = createFlat( mp, loadTextures, xf);}
+
+}   // end namespace
+
+
+// protected
+ObjModel::Ptr RMBImporter::doLoad( const std::string& fname) { return _load<ObjModel>( fname);}
+
+
+// protected
+FlatMesh::Ptr RMBImporter::doLoadFlat( const std::string& fname) { return _load<FlatMesh>( fname);}
+
+
+// private
+template <typename T>
+std::shared_ptr<T> RMBImporter::_load( const std::string& fname)
+{
+    using namespace boost::interprocess;
+    std::shared_ptr<T> model;
+    std::string err;
+    try
+    {
+        Mapped mp;
+        const Compression c = compressionOf( fname);
+        if ( c != NO_COMPRESSION)
+        {
+            // Compressed files can't be mapped so are decompressed into memory (aligned by new).
+            std::vector<char> data;
+            if ( !readCompressed( fname, c, data))
+                err = "Unable to decompress";
+            else if ( (err = validate( data.data(), data.size(), mp)).empty())
+                create( mp, _loadTextures, transform(), model);
+        }   // end if
+        else
+        {
+            const file_mapping fmap( fname.c_str(), read_only);
+            const mapped_region region( fmap, read_only);
+            const char* data = static_cast<const char*>( region.get_address());
+            if ( (err = validate( data, region.get_size(), mp)).empty())
+                create( mp, _loadTextures, transform(), model);
+        }   // end else
+    }   // end try
+    catch ( const interprocess_exception& e)
+    {
+        setErr( "Unable to map " + fname + " : " + e.what());
+        return nullptr;
+    }   // end catch
+
+    if ( !err.empty())
+        setErr( "Invalid RMB file " + fname + " : " + err);
+    else if ( !model)
+        setErr( "Unable to create model from " + fname);
+    return model;
+}   // end _load
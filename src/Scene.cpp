@@ -0,0 +1,167 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include <Scene.h>
+#include <ContentHash.h>
+#include <Decimation.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+using RModelIO::Scene;
+using RModelIO::ModelArrays;
+using RModelIO::FlatMesh;
+using RFeatures::ObjModel;
+
+
+namespace {
+
+template <typename T>
+bool sameBytes( const std::vector<T>& a, const std::vector<T>& b)
+{
+    return a.size() == b.size() && (a.empty() || memcmp( a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}   // end sameBytes
+
+
+// Returns true if the models have the same content (as hashed by hashModel).
+bool sameContent( const ObjModel& m0, const ObjModel& m1)
+{
+    const ModelArrays a0( m0);
+    const ModelArrays a1( m1);
+    if ( !sameBytes( a0.pos, a1.pos) || !sameBytes( a0.idx, a1.idx) || !sameBytes( a0.uvs, a1.uvs)
+      || !sameBytes( a0.uvidx, a1.uvidx) || !sameBytes( a0.fmats, a1.fmats)
+      || a0.view.textures.size() != a1.view.textures.size())
+        return false;
+    for ( size_t i = 0; i < a0.view.textures.size(); ++i)
+        if ( !RModelIO::sameImage( a0.view.textures[i], a1.view.textures[i]))
+            return false;
+    return true;
+}   // end sameContent
+
+}   // end namespace
+
+
+// public
+bool Scene::build( const std::vector<Instance>& instances, const Transform& xf, size_t maxFaces, std::string& err)
+{
+    _models.clear();
+    _simplified.clear();
+    _nodes.clear();
+    if ( instances.empty() || std::any_of( instances.begin(), instances.end(), []( const Instance& i){ return !i.model;}))
+    {
+        err = "No models given or null model!";
+        return false;
+    }   // end if
+
+    // Instances of the same model, or of models with the same content, share the model's resources.
+    std::vector<const ObjModel*> dmodels;   // Distinct models
+    std::unordered_map<const ObjModel*, int> dmap;
+    for ( const Instance& inst : instances)
+        if ( dmap.insert( std::make_pair( inst.model, int(dmodels.size()))).second)
+            dmodels.push_back( inst.model);
+
+    std::vector<int> dunique( dmodels.size(), 0);   // Unique model of each distinct model
+    _models.push_back( dmodels[0]);
+    if ( dmodels.size() > 1)
+    {
+        // Distinct models are hashed concurrently.
+        std::vector<uint64_t> hashes( dmodels.size());
+        const size_t nworkers = std::min<size_t>( dmodels.size(), std::max<unsigned>( 1, std::thread::hardware_concurrency()));
+        std::vector<std::future<void> > workers;
+        for ( size_t w = 0; w < nworkers; ++w)
+            workers.push_back( std::async( std::launch::async, [&, w]()
+            {
+                for ( size_t i = w; i < dmodels.size(); i += nworkers)
+                    hashes[i] = RModelIO::hashModel( *dmodels[i]);
+            }));
+        for ( std::future<void>& w : workers)
+            w.get();
+
+        // Models with the same hash are compared to confirm they're the same before sharing.
+        std::unordered_map<uint64_t, std::vector<int> > hmap;  // Unique models by hash
+        _models.clear();
+        for ( size_t i = 0; i < dmodels.size(); ++i)
+        {
+            std::vector<int>& cands = hmap[hashes[i]];
+            const auto it = std::find_if( cands.begin(), cands.end(), [&]( int u){ return sameContent( *_models[u], *dmodels[i]);});
+            if ( it != cands.end())
+                dunique[i] = *it;
+            else
+            {
+                dunique[i] = int(_models.size());
+                cands.push_back( dunique[i]);
+                _models.push_back( dmodels[i]);
+            }   // end else
+        }   // end for
+    }   // end if
+
+    // Vertices are written transformed by the exporter's transform X so an instance transform T
+    // becomes the node transform X T X^-1.
+    const cv::Matx44d& xm = xf.matrix();
+    const cv::Matx33d xr( xm(0,0), xm(0,1), xm(0,2), xm(1,0), xm(1,1), xm(1,2), xm(2,0), xm(2,1), xm(2,2));
+    const bool invertible = std::fabs( cv::determinant( xr)) > 1e-12;
+    for ( const Instance& inst : instances)
+    {
+        Node node{ dunique[dmap.at( inst.model)], cv::Matx44d::eye()};
+        if ( !inst.transform.isIdentity())
+        {
+            if ( !invertible)
+            {
+                err = "Instance transforms need an invertible exporter transform!";
+                return false;
+            }   // end if
+            node.tm = xf.isIdentity() ? inst.transform.matrix() : xm * inst.transform.matrix() * xm.inv();
+        }   // end if
+        _nodes.push_back( node);
+    }   // end for
+
+    // Models over the face budget are simplified.
+    for ( const ObjModel*& model : _models)
+    {
+        if ( maxFaces > 0 && size_t(model->numPolys()) > maxFaces)
+        {
+            const ModelArrays arrays( *model);
+            const FlatMesh::Ptr mesh = RModelIO::decimate( arrays.view, maxFaces);
+            if ( !mesh)
+            {
+                std::ostringstream eoss;
+                eoss << "Unable to simplify a model of " << model->numPolys() << " faces to within " << maxFaces << " faces!";
+                err = eoss.str();
+                return false;
+            }   // end if
+            _simplified.push_back( mesh->toModel());
+            model = _simplified.back().get();
+        }   // end if
+    }   // end for
+    return true;
+}   // end build
+
+
+cv::Mat RModelIO::scaleTexture( const cv::Mat& tx, int maxDim)
+{
+    const int dim = std::max( tx.rows, tx.cols);
+    if ( maxDim <= 0 || dim <= maxDim)
+        return tx;
+    const double s = double(maxDim) / dim;
+    const cv::Size sz( std::max( 1, int( tx.cols * s + 0.5)), std::max( 1, int( tx.rows * s + 0.5)));
+    cv::Mat stx;
+    cv::resize( tx, stx, sz, 0, 0, cv::INTER_AREA);
+    return stx;
+}   // end scaleTexture
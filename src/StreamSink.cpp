@@ -0,0 +1,157 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include <StreamSink.h>
+#include <boost/filesystem/operations.hpp>
+#include <fstream>
+using RModelIO::StreamSink;
+namespace bfs = boost::filesystem;
+
+
+// public
+StreamSink::StreamSink( std::ostream& os, const std::string& fname, const std::string& workDir,
+                        FileSink* side, const std::string& sideDir)
+    : FileSink( 0, 16), _os(os), _fname(fname), _workDir(workDir), _side(side), _sideDir(sideDir), _written(false)
+{
+}   // end ctor
+
+
+// public
+StreamSink::~StreamSink() { wait();}
+
+
+// private
+bool StreamSink::_inWorkDir( const std::string& fname) const
+{
+    return bfs::path(fname).parent_path() == bfs::path(_workDir);
+}   // end _inWorkDir
+
+
+// private
+std::string StreamSink::_sideName( const std::string& fname) const
+{
+    return (bfs::path(_sideDir) / bfs::path(fname).filename()).string();
+}   // end _sideName
+
+
+// private
+bool StreamSink::_streamFile( const std::string& src)
+{
+    std::ifstream ifs( src.c_str(), std::ios::in | std::ios::binary);
+    if ( !ifs.is_open())
+        return false;
+    std::vector<char> buf( 1 << 16);
+    while ( ifs)
+    {
+        ifs.read( buf.data(), buf.size());
+        _os.write( buf.data(), ifs.gcount());
+    }   // end while
+    _written = ifs.eof() && _os.good();
+    return _written;
+}   // end _streamFile
+
+
+// protected
+bool StreamSink::writeFile( const std::string& fname, const Writer& writer)
+{
+    if ( fname == _fname)
+    {
+        _written = writer( _os) && _os.good();
+        return _written;
+    }   // end if
+
+    if ( !_inWorkDir( fname))
+        return FileSink::writeFile( fname, writer);
+
+    if ( !_side)
+    {
+        std::cerr << "[ERROR] RModelIO::StreamSink: No sink given for side file " << _sideName( fname) << std::endl;
+        return false;
+    }   // end if
+    _side->add( _sideName( fname), writer);
+    return true;
+}   // end writeFile
+
+
+// protected
+bool StreamSink::runTask( const std::string& fname, const Task& task)
+{
+    if ( fname == _fname)   // The task writes the file in the working directory which is then streamed
+    {
+        boost::system::error_code ec;
+        bfs::create_directories( _workDir, ec);
+        return task( fname) && _streamFile( fname);
+    }   // end if
+
+    if ( !_inWorkDir( fname))
+        return FileSink::runTask( fname, task);
+
+    if ( !_side)
+    {
+        std::cerr << "[ERROR] RModelIO::StreamSink: No sink given for side file " << _sideName( fname) << std::endl;
+        return false;
+    }   // end if
+    _side->addTask( _sideName( fname), task);
+    return true;
+}   // end runTask
+
+
+// protected
+bool StreamSink::copyFile( const std::string& src, const std::string& fname, bool allowHardLink)
+{
+    if ( fname == _fname)
+        return _streamFile( src);
+
+    if ( !_inWorkDir( fname))
+        return FileSink::copyFile( src, fname, allowHardLink);
+
+    if ( !_side)
+    {
+        std::cerr << "[ERROR] RModelIO::StreamSink: No sink given for side file " << _sideName( fname) << std::endl;
+        return false;
+    }   // end if
+    _side->addCopy( src, _sideName( fname), allowHardLink);
+    return true;
+}   // end copyFile
+
+
+// public
+bool StreamSink::finish()
+{
+    boost::system::error_code ec;
+    if ( !_written && bfs::exists( _fname, ec))
+        _streamFile( _fname);
+
+    bool ok = _written;
+    // Pass on files written directly to the working directory (failing if there's nowhere to put them).
+    for ( bfs::directory_iterator it( _workDir, ec), end; !ec && it != end; it.increment(ec))
+    {
+        const std::string f = it->path().string();
+        if ( f == _fname || !bfs::is_regular_file( f, ec))
+            continue;
+        if ( _side)
+            _side->addCopy( f, _sideName( f));
+        else
+        {
+            std::cerr << "[ERROR] RModelIO::StreamSink: No sink given for side file " << _sideName( f) << std::endl;
+            ok = false;
+        }   // end else
+    }   // end for
+    if ( _side)
+        ok = _side->wait() && ok;
+    return ok;
+}   // end finish
@@ -0,0 +1,143 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include <TextureSources.h>
+#include <ContentHash.h>
+#include <FeatureUtils.h>   // RFeatures::loadImage
+#include <boost/filesystem/operations.hpp>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+using RModelIO::TextureSources;
+
+namespace {
+
+using LRUList = std::list<uint64_t>;    // Pixel hashes in most recently used first order
+
+std::mutex sourcesMutex;
+std::unordered_map<uint64_t, std::pair<TextureSources::Source, LRUList::iterator> > sources;  // Keyed by pixel hash
+LRUList lru;
+size_t maxSrcs = 4096;
+
+// Remove least recently used sources while there are more than n. Call with the mutex held.
+void prune( size_t n)
+{
+    while ( sources.size() > n)
+    {
+        sources.erase( lru.back());
+        lru.pop_back();
+    }   // end while
+}   // end prune
+
+}   // end namespace
+
+
+// public static
+void TextureSources::add( const cv::Mat& img, const std::string& path, uint64_t fileHash)
+{
+    if ( img.empty())
+        return;
+
+    boost::system::error_code ec;
+    const boost::filesystem::path fpath = boost::filesystem::absolute( path);
+    Source src;
+    src.path = fpath.string();
+    src.fileHash = fileHash;
+    src.fileSize = boost::filesystem::file_size( fpath, ec);
+    if ( ec)
+        return;
+    src.mtime = boost::filesystem::last_write_time( fpath, ec);
+    if ( ec)
+        return;
+
+    const uint64_t key = hashImage( img);
+    std::lock_guard<std::mutex> lock(sourcesMutex);
+    if ( maxSrcs == 0)
+        return;
+    const auto it = sources.find(key);
+    if ( it != sources.end())
+        lru.erase( it->second.second);
+    lru.push_front( key);
+    sources[key] = std::make_pair( src, lru.begin());
+    prune( maxSrcs);
+}   // end add
+
+
+// public static
+bool TextureSources::find( const cv::Mat& img, Source& src)
+{
+    {
+        std::lock_guard<std::mutex> lock(sourcesMutex);
+        if ( sources.empty())
+            return false;
+    }   // end lock
+
+    const uint64_t key = hashImage( img);
+    {
+        std::lock_guard<std::mutex> lock(sourcesMutex);
+        const auto it = sources.find(key);
+        if ( it == sources.end())
+            return false;
+        src = it->second.first;
+        lru.splice( lru.begin(), lru, it->second.second);  // Now most recently used
+    }   // end lock
+
+    // Check the file is unchanged - only rehashing its contents if its size and time differ.
+    boost::system::error_code ec;
+    const uintmax_t fsize = boost::filesystem::file_size( src.path, ec);
+    if ( ec || fsize != src.fileSize)
+        return false;
+    const std::time_t mtime = boost::filesystem::last_write_time( src.path, ec);
+    if ( ec)
+        return false;
+    if ( mtime != src.mtime)
+    {
+        uint64_t fhash = 0;
+        if ( !hashFile( src.path, fhash) || fhash != src.fileHash)
+            return false;
+    }   // end if
+
+    // Matching pixel hashes may collide so the pixels decoded from the file are compared too.
+    cv::Mat fimg;
+    return RFeatures::loadImage( src.path, fimg) && sameImage( img, fimg);
+}   // end find
+
+
+// public static
+void TextureSources::clear()
+{
+    std::lock_guard<std::mutex> lock(sourcesMutex);
+    sources.clear();
+    lru.clear();
+}   // end clear
+
+
+// public static
+void TextureSources::setMaxSources( size_t n)
+{
+    std::lock_guard<std::mutex> lock(sourcesMutex);
+    maxSrcs = n;
+    prune( n);
+}   // end setMaxSources
+
+
+// public static
+size_t TextureSources::maxSources()
+{
+    std::lock_guard<std::mutex> lock(sourcesMutex);
+    return maxSrcs;
+}   // end maxSources
@@ -0,0 +1,133 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include <TextureStore.h>
+#include <ContentHash.h>
+#include <boost/filesystem/operations.hpp>
+#include <fstream>
+#include <future>
+#include <unordered_map>
+using RModelIO::TextureStore;
+using RModelIO::FileSink;
+namespace bfs = boost::filesystem;
+
+namespace {
+
+// Files currently being written into any store by this process.
+std::mutex inflightMutex;
+std::unordered_map<std::string, std::shared_future<bool> > inflight;
+
+}   // end namespace
+
+
+// public static
+TextureStore::Ptr TextureStore::create( const std::string& dir)
+{
+    boost::system::error_code ec;
+    const bfs::path dpath = bfs::absolute( dir);
+    bfs::create_directories( dpath, ec);
+    if ( !bfs::is_directory( dpath))
+        return nullptr;
+    return Ptr( new TextureStore( dpath.string()));
+}   // end create
+
+
+// public static
+bool TextureStore::wait( Pending& pending)
+{
+    bool ok = true;
+    for ( const std::shared_future<bool>& w : pending)
+        ok = w.get() && ok;
+    pending.clear();
+    return ok;
+}   // end wait
+
+
+// private
+TextureStore::TextureStore( const std::string& dir) : _dir(dir) {}
+
+
+// public
+std::string TextureStore::store( FileSink& sink, uint64_t key, const std::string& ext, const FileSink::Writer& writer, Pending& pending)
+{
+    return _store( sink, key, ext, [writer]( const std::string& f)
+            {
+                std::ofstream ofs( f.c_str(), std::ios::out | std::ios::binary);
+                if ( !ofs.is_open())
+                    return false;
+                const bool ok = writer( ofs);
+                ofs.close();
+                return ok && !ofs.fail();
+            }, pending);
+}   // end store
+
+
+// public
+std::string TextureStore::storeCopy( FileSink& sink, uint64_t key, const std::string& ext, const std::string& src, Pending& pending)
+{
+    return _store( sink, key, ext, [src]( const std::string& f){ return FileSink::transferFile( src, f);}, pending);
+}   // end storeCopy
+
+
+// private
+std::string TextureStore::_store( FileSink& sink, uint64_t key, const std::string& ext, const FileSink::Task& writer, Pending& pending)
+{
+    const std::string fname = (bfs::path(_dir) / (hashString( key) + ext)).string();
+
+    // Decide what to do while holding the lock but queue on the sink only after
+    // releasing it since adding to the sink can block until its workers free up.
+    std::shared_future<bool> written;
+    std::shared_ptr<std::promise<bool> > done;
+    {
+        std::lock_guard<std::mutex> lock( inflightMutex);
+        if ( inflight.count( fname) > 0)
+            written = inflight.at( fname);
+        else if ( !bfs::exists( fname))
+        {
+            done.reset( new std::promise<bool>);
+            inflight[fname] = done->get_future().share();
+        }   // end else if
+    }   // end lock
+
+    // If being written by another export, the caller waits for that write rather than a sink
+    // worker since a worker blocked on a write queued behind it on another sink could deadlock.
+    if ( written.valid())
+        pending.push_back( written);
+    else if ( done)
+    {
+        sink.addTask( fname, [writer, done]( const std::string& f)
+                {
+                    bool ok = false;
+                    try
+                    {
+                        ok = FileSink::writeAtomic( f, writer);
+                    }   // end try
+                    catch ( const std::exception&)
+                    {
+                        ok = false;
+                    }   // end catch
+                    {
+                        std::lock_guard<std::mutex> lock( inflightMutex);
+                        inflight.erase( f);
+                    }   // end lock
+                    done->set_value( ok);
+                    return ok;
+                });
+    }   // end else if
+
+    return fname;
+}   // end _store
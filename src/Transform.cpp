@@ -0,0 +1,143 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include <Transform.h>
+using RModelIO::Transform;
+
+const size_t Transform::BATCH_SIZE;
+
+
+// public
+Transform::Transform() : _m( cv::Matx44d::eye())
+{
+    _set();
+}   // end ctor
+
+
+// public
+Transform::Transform( const cv::Matx44d& m) : _m(m)
+{
+    _set();
+}   // end ctor
+
+
+// private
+void Transform::_set()
+{
+    _identity = true;
+    for ( int i = 0; i < 3; ++i)
+    {
+        for ( int j = 0; j < 4; ++j)
+        {
+            _a[4*i+j] = float( _m(i,j));
+            if ( _m(i,j) != (i == j ? 1.0 : 0.0))
+                _identity = false;
+        }   // end for
+    }   // end for
+}   // end _set
+
+
+// public static
+Transform Transform::scale( double s)
+{
+    return Transform( cv::Matx44d( s, 0, 0, 0,
+                                   0, s, 0, 0,
+                                   0, 0, s, 0,
+                                   0, 0, 0, 1));
+}   // end scale
+
+
+// public static
+Transform Transform::translate( const cv::Vec3d& t)
+{
+    return Transform( cv::Matx44d( 1, 0, 0, t[0],
+                                   0, 1, 0, t[1],
+                                   0, 0, 1, t[2],
+                                   0, 0, 0, 1));
+}   // end translate
+
+
+// public static
+Transform Transform::yUpToZUp()
+{
+    return Transform( cv::Matx44d( 1, 0,  0, 0,
+                                   0, 0, -1, 0,
+                                   0, 1,  0, 0,
+                                   0, 0,  0, 1));
+}   // end yUpToZUp
+
+
+// public static
+Transform Transform::zUpToYUp()
+{
+    return Transform( cv::Matx44d( 1,  0, 0, 0,
+                                   0,  0, 1, 0,
+                                   0, -1, 0, 0,
+                                   0,  0, 0, 1));
+}   // end zUpToYUp
+
+
+// public
+Transform Transform::operator*( const Transform& other) const
+{
+    cv::Matx44d m;
+    for ( int i = 0; i < 4; ++i)
+    {
+        for ( int j = 0; j < 4; ++j)
+        {
+            double v = 0;
+            for ( int k = 0; k < 4; ++k)
+                v += _m(i,k) * other._m(k,j);
+            m(i,j) = v;
+        }   // end for
+    }   // end for
+    return Transform(m);
+}   // end operator*
+
+
+// public
+cv::Vec3f Transform::operator()( const cv::Vec3f& v) const
+{
+    cv::Vec3f r;
+    apply( &v[0], 1, &r[0]);
+    return r;
+}   // end operator()
+
+
+// public
+void Transform::apply( const float* src, size_t n, float* dst) const
+{
+    if ( _identity)
+    {
+        if ( dst != src)
+            std::copy( src, src + 3*n, dst);
+        return;
+    }   // end if
+
+    const float a00 = _a[0], a01 = _a[1], a02 = _a[2], a03 = _a[3];
+    const float a10 = _a[4], a11 = _a[5], a12 = _a[6], a13 = _a[7];
+    const float a20 = _a[8], a21 = _a[9], a22 = _a[10], a23 = _a[11];
+    for ( size_t i = 0; i < n; ++i)
+    {
+        const float x = src[3*i];
+        const float y = src[3*i+1];
+        const float z = src[3*i+2];
+        dst[3*i]   = a00*x + a01*y + a02*z + a03;
+        dst[3*i+1] = a10*x + a11*y + a12*z + a13;
+        dst[3*i+2] = a20*x + a21*y + a22*z + a23;
+    }   // end for
+}   // end apply
@@ -17,73 +17,230 @@
 
 #include <U3DExporter.h>
 #include <IDTFExporter.h>
+#include <U3DWriter.h>
+#include <ContentHash.h>
 #include <cassert>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <cstdlib>
 #include <cstdio>
 #include <boost/filesystem/operations.hpp>
 #include <boost/process.hpp>    // Requires at least boost 1.64+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #ifdef _WIN32
 #include <boost/process/windows.hpp>    // For hiding console window
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 using RModelIO::IDTFExporter;
 using RModelIO::U3DExporter;
+using RModelIO::Transform;
+using RModelIO::Scene;
 using RFeatures::ObjModel;
 
 
 std::string U3DExporter::IDTFConverter( "IDTFConverter"); // public static
 
 
+namespace {
+
+std::string converterName()
+{
+    return U3DExporter::IDTFConverter.empty() ? std::string("IDTFConverter") : U3DExporter::IDTFConverter;
+}   // end converterName
+
+}   // end namespace
+
+
+// Searching the PATH is slow so is done (and any warning given) just once per converter name.
 // public static
 bool U3DExporter::isAvailable()
 {
-    if ( boost::filesystem::exists( IDTFConverter))
-        return true;
-    const boost::filesystem::path exepath = boost::process::search_path( IDTFConverter);
-    return !exepath.empty();
+    static std::mutex mtx;
+    static std::unordered_map<std::string, bool> found;
+    const std::string exe = converterName();
+    std::lock_guard<std::mutex> lock( mtx);
+    auto it = found.find( exe);
+    if ( it == found.end())
+    {
+        const bool avail = boost::filesystem::exists( exe) || !boost::process::search_path( exe).empty();
+        if ( !avail)
+            std::cerr << "[WARNING] RModelIO::U3DExporter: U3D export disabled; " << exe << " not found on PATH!" << std::endl;
+        it = found.insert( std::make_pair( exe, avail)).first;
+    }   // end if
+    return it->second;
 }   // end isAvailable
 
 
 // public
 U3DExporter::U3DExporter( bool delOnDestroy, bool m9)
-    : RModelIO::ObjModelExporter(), _delOnDestroy(delOnDestroy), _media9(m9)
+    : RModelIO::ObjModelExporter(), _delOnDestroy(delOnDestroy), _native(false), _transport(IDTF_FILE), _maxFaces(0), _txfmt(IDTFExporter::PNG), _txqual(1), _maxTxDim(0), _timeout(0), _maxConcurrent(0), _cacheLinks(false)
 {
-    if ( IDTFConverter.empty())
-        IDTFConverter = "IDTFConverter";
+    if ( m9)
+        setTransform( Transform::media9());
 
     if ( isAvailable())
         addSupported( "u3d", "Universal 3D");
-    else
-        std::cerr << "[WARNING] RModelIO::U3DExporter: U3D export disabled; IDTFConverter not found on PATH!" << std::endl;
 }   // end ctor
 
 
+// public
+void U3DExporter::setNativeWriter( bool native)
+{
+    _native = native;
+    if ( _native)
+        addSupported( "u3d", "Universal 3D");
+}   // end setNativeWriter
+
+
+// public
+void U3DExporter::setMaxConcurrent( size_t n)
+{
+    waitAsync();
+    _maxConcurrent = n;
+    _pool = nullptr;
+}   // end setMaxConcurrent
+
+
+// public
+std::future<std::string> U3DExporter::saveAsync( const ObjModel::Ptr& model, const std::string& filename)
+{
+    if ( !_pool)
+        _pool = FileSink::create( _maxConcurrent, 2*std::max<size_t>( 1, _maxConcurrent));
+
+    // Settings are copied since this exporter may be changed or used again before the save runs.
+    const bool delOnDestroy = _delOnDestroy;
+    const bool native = _native;
+    const Transform xf = transform();
+    const RModelIO::FloatFormat ff = floatFormat();
+    const IDTFTransport transport = _transport;
+    const Quality quality = _quality;
+    const size_t maxFaces = _maxFaces;
+    const IDTFExporter::TextureFormat txfmt = _txfmt;
+    const int txqual = _txqual;
+    const int maxTxDim = _maxTxDim;
+    const int timeout = _timeout;
+    const FileCache::Ptr cache = _cache;
+    const bool cacheLinks = _cacheLinks;
+
+    std::shared_ptr<std::promise<std::string> > result( new std::promise<std::string>);
+    _pool->addTask( filename, [=]( const std::string& fname)
+    {
+        U3DExporter exporter( delOnDestroy);
+        exporter.setNativeWriter( native);
+        exporter.setTransform( xf);
+        exporter.setFloatFormat( ff);
+        exporter.setIDTFTransport( transport);
+        exporter.setQuality( quality);
+        exporter.setMaxFaces( maxFaces);
+        exporter.setTextureFormat( txfmt, txqual);
+        exporter.setMaxTextureSize( maxTxDim);
+        exporter.setTimeout( timeout);
+        exporter.setCache( cache, cacheLinks);
+        const bool ok = exporter.save( *model, fname);
+        result->set_value( ok ? "" : exporter.err());
+        return ok;
+    });
+    return result->get_future();
+}   // end saveAsync
+
+
+// public
+void U3DExporter::waitAsync()
+{
+    if ( _pool)
+        _pool->wait();  // Errors are given by the futures
+}   // end waitAsync
+
+
 namespace {
-bool convertIDTF2U3D( const std::string& idtffile, const std::string& u3dfile)
+namespace bp = boost::process;
+namespace bfs = boost::filesystem;
+
+// Saves IDTF to the given file using the given exporter.
+using IDTFSaver = std::function<bool( IDTFExporter&, const std::string&)>;
+
+// Options given to the converter.
+struct ConverterOptions
 {
-    bool success = false;
+    U3DExporter::Quality quality;
+    int timeout;    // Seconds (0 for no limit)
+};  // end struct
+
+
+int clampQuality( int q, int maxq) { return std::max( 0, std::min( q, maxq));}
+
+std::string converterCommand( const U3DExporter::Quality& q, const std::string& idtffile, const std::string& u3dfile)
+{
+    std::ostringstream cmd;
+    cmd << "\"" << converterName() << "\""
+        << " -debuglevel 0" // no debug dump
+        << " -pq " << clampQuality( q.position, 1000)   // Position quality
+        << " -tcq " << clampQuality( q.texCoord, 1000)  // Texture coordinates quality
+        << " -gq " << clampQuality( q.geometry, 1000)   // Geometry quality
+        << " -tq " << clampQuality( q.texture, 100)     // Texture quality
+        << " -en 1"     // Enable normals exclusion 
+        << " -eo 65535" // Export everything
+        << " -input " << idtffile
+        << " -output " << u3dfile;
+    return cmd.str();
+}   // end converterCommand
+
+
+// Start the converter returning null on failure.
+std::unique_ptr<bp::child> launchConverter( const ConverterOptions& opts, const std::string& idtffile, const std::string& u3dfile)
+{
+    const std::string pexe = converterCommand( opts.quality, idtffile, u3dfile);
+    std::cerr << pexe << std::endl;
     try
     {
-        std::ostringstream cmd;
-        cmd << "\"" << U3DExporter::IDTFConverter << "\""
-            << " -debuglevel 0" // no debug dump
-            << " -pq 1000"  // Position quality MAX
-            << " -tcq 1000" // Texture coordinates quality MAX
-            << " -gq 1000"  // Geometry quality MAX
-            << " -tq 100"   // Texture quality MAX
-            << " -en 1"     // Enable normals exclusion 
-            << " -eo 65535" // Export everything
-            << " -input " << idtffile
-            << " -output " << u3dfile;
-        const std::string pexe = cmd.str();
-        std::cerr << pexe << std::endl;
 #ifdef _WIN32
-        boost::process::child c( pexe, boost::process::windows::hide);
+        return std::unique_ptr<bp::child>( new bp::child( pexe, bp::windows::hide));
 #else
-        boost::process::child c( pexe);
-//      success = std::system( pexe.c_str()) == 0;
+        return std::unique_ptr<bp::child>( new bp::child( pexe));
 #endif
+    }   // end try
+    catch ( const std::exception& e)
+    {
+        std::cerr << "Failed to start " << converterName() << std::endl;
+        std::cerr << e.what() << std::endl;
+    }   // end catch
+    return nullptr;
+}   // end launchConverter
+
+
+// Wait for the converter to finish, terminating it if it runs for longer than the timeout.
+bool waitConverter( bp::child& c, int timeout)
+{
+    bool success = false;
+    try
+    {
+        // Poll rather than use child::wait_for which replaces the process wide SIGCHLD handler
+        // and so isn't safe with concurrent conversions.
+        if ( timeout > 0)
+        {
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds( timeout);
+            while ( c.running() && std::chrono::steady_clock::now() < deadline)
+                std::this_thread::sleep_for( std::chrono::milliseconds(20));
+            if ( c.running())
+            {
+                std::cerr << converterName() << " timed out after " << timeout << " seconds" << std::endl;
+                c.terminate();
+                return false;
+            }   // end if
+        }   // end if
         c.wait();
         success = c.exit_code() == 0;
     }   // end try
@@ -93,38 +250,304 @@ bool convertIDTF2U3D( const std::string& idtffile, const std::string& u3dfile)
         std::cerr << e.what() << std::endl;
         success = false;
     }   // end catch
-
     return success;
+}   // end waitConverter
+
+
+bool convertIDTF2U3D( const ConverterOptions& opts, const std::string& idtffile, const std::string& u3dfile)
+{
+    std::unique_ptr<bp::child> c = launchConverter( opts, idtffile, u3dfile);
+    return c && waitConverter( *c, opts.timeout);
 }   // end convertIDTF2U3D
+
+
+// Create a uniquely named scratch directory on tmpfs if available.
+bfs::path createScratchDir()
+{
+    boost::system::error_code ec;
+    bfs::path base( "/dev/shm");
+    if ( !bfs::is_directory( base, ec))
+        base = bfs::temp_directory_path( ec);
+    const bfs::path dir = base / bfs::unique_path( "rModelIO-u3d-%%%%-%%%%-%%%%");
+    if ( ec || !bfs::create_directories( dir, ec))
+        return bfs::path();
+    return dir;
+}   // end createScratchDir
+
+
+#ifndef _WIN32
+// Open and immediately close the other end of the named pipe without blocking. Releases the
+// converter or the writer if blocked opening their end because the other has failed.
+void releasePipe( const std::string& fifo, int flags)
+{
+    const int fd = open( fifo.c_str(), flags | O_NONBLOCK);
+    if ( fd >= 0)
+        close( fd);
+}   // end releasePipe
+
+
+// Write the IDTF into the named pipe while the converter reads from it.
+bool convertThroughPipe( IDTFExporter& idtfExporter, const IDTFSaver& saveIDTF, const ConverterOptions& opts,
+                         const std::string& fifo, const std::string& u3dfile, std::string& err)
+{
+    std::unique_ptr<bp::child> c = launchConverter( opts, fifo, u3dfile);
+    if ( !c)
+    {
+        err = "Unable to start " + converterName() + "!";
+        return false;
+    }   // end if
+
+    // If the converter exits early, the read end is opened and closed so a writer blocked
+    // opening the pipe proceeds and then fails on the broken pipe. The writer may not have
+    // reached the pipe yet (e.g. if writing textures first) so this repeats until the save returns.
+    std::atomic<bool> exited(false);
+    std::atomic<bool> savedDone(false);
+    bool converted = false;
+    std::thread watcher( [&]()
+    {
+        converted = waitConverter( *c, opts.timeout);
+        exited = true;
+        while ( !savedDone)
+        {
+            releasePipe( fifo, O_RDONLY);
+            std::this_thread::sleep_for( std::chrono::milliseconds(20));
+        }   // end while
+    });
+
+    // Block SIGPIPE so that writing to a pipe closed by the converter fails rather than
+    // terminating the process. The exporter's file writing threads inherit the mask.
+    sigset_t pipeSet, oldSet;
+    sigemptyset( &pipeSet);
+    sigaddset( &pipeSet, SIGPIPE);
+    pthread_sigmask( SIG_BLOCK, &pipeSet, &oldSet);
+    const bool saved = saveIDTF( idtfExporter, fifo);
+    savedDone = true;
+    if ( !saved)
+        err = idtfExporter.err();
+
+    // If writing failed the converter may be waiting to open the pipe.
+    while ( !saved && !exited)
+    {
+        releasePipe( fifo, O_WRONLY);
+        std::this_thread::sleep_for( std::chrono::milliseconds(20));
+    }   // end while
+    watcher.join();
+    pthread_sigmask( SIG_SETMASK, &oldSet, nullptr);
+
+    if ( saved && !converted)
+        err = "Unable to convert from IDTF format to U3D format!";
+    return saved && converted;
+}   // end convertThroughPipe
+#endif
+
+
+// Write the IDTF (or stream it through a named pipe if pipe is true) to a scratch directory
+// which is removed after conversion.
+bool convertViaScratch( IDTFExporter& idtfExporter, const IDTFSaver& saveIDTF, const ConverterOptions& opts,
+                        bool pipe, const std::string& u3dfile, std::string& err)
+{
+    const bfs::path dir = createScratchDir();
+    if ( dir.empty())
+    {
+        err = "Unable to create scratch directory for IDTF conversion!";
+        return false;
+    }   // end if
+
+    const std::string idtffile = (dir / bfs::path(u3dfile).filename().replace_extension("idtf")).string();
+    const std::string u3dabs = bfs::absolute( u3dfile).string();
+    bool success = false;
+#ifndef _WIN32
+    if ( pipe && mkfifo( idtffile.c_str(), 0600) == 0)
+        success = convertThroughPipe( idtfExporter, saveIDTF, opts, idtffile, u3dabs, err);
+    else
+#endif
+    if ( !saveIDTF( idtfExporter, idtffile))
+        err = idtfExporter.err();
+    else if ( !(success = convertIDTF2U3D( opts, idtffile, u3dabs)))
+        err = "Unable to convert from IDTF format to U3D format!";
+
+    boost::system::error_code ec;
+    bfs::remove_all( dir, ec);
+    return success;
+}   // end convertViaScratch
+
 }   // end namespace
 
 
+// public static
+RModelIO::FileCache::Ptr U3DExporter::createCache( const std::string& dir, uint64_t maxBytes)
+{
+    return FileCache::create( dir, ".u3d", maxBytes);
+}   // end createCache
+
+
+// private
+std::string U3DExporter::_cacheKey( const ObjModel& model) const
+{
+    std::ostringstream oss;
+    oss << (_native ? std::string("native") : converterName()) << '\n' << floatFormat().digits() << '\n'
+        << _quality.position << ' ' << _quality.texCoord << ' ' << _quality.geometry << ' ' << _quality.texture << '\n' << _maxFaces << '\n'
+        << _txfmt << ' ' << _txqual << ' ' << _maxTxDim << '\n';
+    if ( !transform().isIdentity())
+    {
+        oss << std::setprecision(17);
+        for ( int i = 0; i < 3; ++i)
+            for ( int j = 0; j < 4; ++j)
+                oss << ' ' << transform().matrix()(i,j);
+    }   // end if
+    const std::string desc = oss.str();
+    return RModelIO::hashString( RModelIO::hashModel( model, RModelIO::hashBytes( desc.data(), desc.size())));
+}   // end _cacheKey
+
+
 // protected
 bool U3DExporter::doSave( const ObjModel& model, const std::string& filename)
+{
+    const IDTFSaver saveIDTF = [&model]( IDTFExporter& x, const std::string& f){ return x.save( model, f);};
+    const auto saveU3D = [&]( const std::string& f)
+    {
+        return _native ? _writeNative( { IDTFExporter::Instance{ &model, Transform()}}, f, _cache != nullptr) : _convert( saveIDTF, f);
+    };  // end saveU3D
+    if ( !_cache)
+        return saveU3D( filename);
+
+    const std::string key = _cacheKey( model);
+    const std::string cfile = _cache->lookup( key);
+    if ( !cfile.empty())
+    {
+        if ( FileSink::transferFile( cfile, filename, _cacheLinks))
+        {
+            std::cerr << "[INFO] RModelIO::U3DExporter::doSave: Using cached conversion " << cfile << std::endl;
+            wroteModelFile();
+            return true;
+        }   // end if
+        _cache->invalidate( key);   // Evicted by another process since lookup
+    }   // end if
+
+    if ( !saveU3D( filename))
+        return false;
+    if ( !_cache->insertFile( key, [&filename]( const std::string& f){ return FileSink::transferFile( filename, f);}))
+        std::cerr << "[WARNING] RModelIO::U3DExporter::doSave: Unable to cache conversion of " << filename << std::endl;
+    return true;
+}   // end doSave
+
+
+// public
+bool U3DExporter::saveScene( const std::vector<IDTFExporter::Instance>& instances, const std::string& filename)
+{
+    const IDTFSaver saveIDTF = [&instances]( IDTFExporter& x, const std::string& f){ return x.saveScene( instances, f);};
+    return saveUsing( filename, [&]( const std::string& f){ return _native ? _writeNative( instances, f, false) : _convert( saveIDTF, f);});
+}   // end saveScene
+
+
+// The file is written through the file sink unless direct is true in which case it's
+// written immediately (as by the converter) so that it exists for caching on return.
+// private
+bool U3DExporter::_writeNative( const std::vector<IDTFExporter::Instance>& instances, const std::string& filename, bool direct)
+{
+    static const std::string estr = "[ERROR] RModelIO::U3DExporter::save: ";
+    if ( _quality.position != 1000 || _quality.texCoord != 1000 || _quality.geometry != 1000)
+    {
+        setErr( estr + "Position, texture coordinate and geometry quality can't be reduced when writing natively!");
+        return false;
+    }   // end if
+
+    std::shared_ptr<Scene> scene( new Scene);
+    std::string err;
+    if ( !scene->build( instances, transform(), _maxFaces, err))
+    {
+        setErr( estr + err);
+        return false;
+    }   // end if
+
+    for ( const ObjModel* model : scene->models())
+    {
+        const IntSet& mids = model->materialIds();
+        for ( int mid : mids)
+        {
+            if ( model->texture(mid).empty())
+            {
+                std::ostringstream eoss;
+                eoss << estr << "Material " << mid << " has no texture!";
+                setErr( eoss.str());
+                return false;
+            }   // end if
+        }   // end for
+    }   // end for
+
+    RModelIO::U3DWriteOptions opts;
+    opts.xf = transform();
+    opts.textureQuality = _quality.texture;
+    opts.maxTextureDim = _maxTxDim;
+    if ( !direct)
+    {
+        // The scene references the instanced models which are kept until the save is complete.
+        fileSink().add( filename, [scene, opts]( std::ostream& os){ return RModelIO::writeU3D( os, *scene, opts);});
+        return true;
+    }   // end if
+
+    std::ofstream ofs( filename, std::ios::binary);
+    const bool written = ofs.is_open() && RModelIO::writeU3D( ofs, *scene, opts);
+    ofs.close();
+    if ( !written || ofs.fail())
+    {
+        setErr( estr + "Unable to write U3D file " + filename + "!");
+        return false;
+    }   // end if
+
+    wroteModelFile();   // Written directly rather than through the file sink
+    return true;
+}   // end _writeNative
+
+
+// private
+bool U3DExporter::_convert( const IDTFSaver& saveIDTF, const std::string& filename)
 {
     static const std::string istr = "[INFO] RModelIO::U3DExporter::doSave: ";
     static const std::string wstr = "[WARNING] RModelIO::U3DExporter::doSave: ";
     bool savedOkay = true;
 
     // First save to intermediate IDTF format.
-    IDTFExporter idtfExporter( _delOnDestroy, _media9);
-    const std::string idtffile = boost::filesystem::path(filename).replace_extension("idtf").string();
+    IDTFExporter idtfExporter( _delOnDestroy);
+    idtfExporter.setTransform( transform());
+    idtfExporter.setFloatFormat( floatFormat());
+    idtfExporter.setCompactNormals( true);  // Normals are excluded by the converter (-en 1)
+    idtfExporter.setMaxFaces( _maxFaces);
+    idtfExporter.setTextureFormat( _txfmt, _txqual);
+    idtfExporter.setMaxTextureSize( _maxTxDim);
+    const ConverterOptions opts{ _quality, _timeout};
     std::cerr << istr << "Saving model to IDTF format" << std::endl;
-    if ( !idtfExporter.save( model, idtffile))
-    {   
-        setErr( idtfExporter.err());
-        savedOkay = false;
-    }   // end if
-    else if ( !convertIDTF2U3D( idtffile, filename))
+    if ( _transport != IDTF_FILE)
     {
-        setErr("Unable to convert from IDTF format to U3D format!");
-        savedOkay = false;
+        // Textures must exist once the converter has read all of the IDTF.
+        idtfExporter.setWriteTexturesFirst( _transport == IDTF_PIPE);
+        std::string err;
+        savedOkay = convertViaScratch( idtfExporter, saveIDTF, opts, _transport == IDTF_PIPE, filename, err);
+        if ( !savedOkay)
+            setErr( err);
     }   // end if
+    else
+    {
+        const std::string idtffile = boost::filesystem::path(filename).replace_extension("idtf").string();
+        if ( !saveIDTF( idtfExporter, idtffile))
+        {   
+            setErr( idtfExporter.err());
+            savedOkay = false;
+        }   // end if
+        else if ( !convertIDTF2U3D( opts, idtffile, filename))
+        {
+            setErr("Unable to convert from IDTF format to U3D format!");
+            savedOkay = false;
+        }   // end if
+    }   // end else
 
     if ( savedOkay)
+    {
         std::cerr << istr << "Successfully converted IDTF to U3D" << std::endl;
+        wroteModelFile();   // Written by the converter rather than through the file sink
+    }   // end if
     else
         std::cerr << wstr << "Failed to convert from IDTF to U3D!" << std::endl;
 
     return savedOkay;
-}   // end doSave
+}   // end _convert
@@ -0,0 +1,669 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include <U3DWriter.h>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <future>
+#include <numeric>
+#include <thread>
+#include <unordered_map>
+using RModelIO::Scene;
+using RModelIO::U3DWriteOptions;
+using RFeatures::ObjModel;
+
+
+namespace {
+
+// Block types (ECMA-363 section 9).
+const uint32_t FILE_HEADER = 0x00443355;
+const uint32_t MODIFIER_CHAIN = 0xFFFFFF14;
+const uint32_t GROUP_NODE = 0xFFFFFF21;
+const uint32_t MODEL_NODE = 0xFFFFFF22;
+const uint32_t LIGHT_NODE = 0xFFFFFF23;
+const uint32_t CLOD_MESH_DECLARATION = 0xFFFFFF31;
+const uint32_t CLOD_BASE_MESH_CONTINUATION = 0xFFFFFF3B;
+const uint32_t SHADING_MODIFIER = 0xFFFFFF45;
+const uint32_t LIGHT_RESOURCE = 0xFFFFFF51;
+const uint32_t LIT_TEXTURE_SHADER = 0xFFFFFF53;
+const uint32_t MATERIAL_RESOURCE = 0xFFFFFF54;
+const uint32_t TEXTURE_DECLARATION = 0xFFFFFF55;
+const uint32_t TEXTURE_CONTINUATION = 0xFFFFFF5C;
+
+// Modifier chain types.
+const uint32_t NODE_CHAIN = 0;
+const uint32_t MODEL_CHAIN = 1;
+const uint32_t TEXTURE_CHAIN = 2;
+
+// Values of static contexts with a range at least this are written uncompressed.
+const uint32_t MAX_STATIC_RANGE = 0x3FFF;
+
+// Readers halve the counts of a dynamic context once their total reaches this and never
+// add symbols of at least MAX_DYNAMIC_SYMBOL (so those are always escaped).
+const uint32_t MAX_DYNAMIC_TOTAL = 0x1FFF;
+const uint32_t MAX_DYNAMIC_SYMBOL = 0xFFFF;
+
+// Quality factors recorded with each mesh (positions etc. are written unquantised).
+const uint32_t MAX_QUALITY = 1000;
+
+
+uint8_t swapBits8( uint8_t v)
+{
+    uint8_t r = 0;
+    for ( int i = 0; i < 8; ++i)
+        r |= uint8_t( ((v >> i) & 1) << (7 - i));
+    return r;
+}   // end swapBits8
+
+
+// Symbol counts of a dynamic context kept exactly as readers keep them. Symbol 0 escapes
+// values not yet seen (or whose count has been halved to zero) and other symbols are one
+// more than the value they stand for.
+struct Histogram
+{
+    std::vector<uint32_t> counts = std::vector<uint32_t>( 1, 1);
+    uint32_t total = 1;
+
+    void add( uint32_t s)
+    {
+        if ( s >= MAX_DYNAMIC_SYMBOL)
+            return;
+        if ( total >= MAX_DYNAMIC_TOTAL)
+        {
+            // Halve the counts keeping at least one escape.
+            total = 0;
+            for ( uint32_t& c : counts)
+            {
+                c >>= 1;
+                total += c;
+            }   // end for
+            counts[0]++;
+            total++;
+        }   // end if
+        if ( s >= counts.size())
+            counts.resize( s + 1, 0);
+        counts[s]++;
+        total++;
+    }   // end add
+};  // end struct
+
+
+// The data of a block written as described by section 10 of the standard. Values are
+// passed through a 16 bit arithmetic coder using a static context of range 256 per byte.
+// Until the first compressed value, the coder's state is unchanged by each byte and
+// outputs it as is, so bytes are appended directly until then.
+class BitStream
+{
+public:
+    BitStream() : _nbits(0), _low(0), _high(0xFFFF), _underflow(0), _compressed(false) {}
+
+    void u8( uint8_t v)
+    {
+        if ( _compressed)
+            _symbol( swapBits8(v), 1, 256);
+        else
+        {
+            _data.push_back(v);
+            _nbits += 8;
+        }   // end else
+    }   // end u8
+
+    void u16( uint16_t v) { u8( uint8_t(v)); u8( uint8_t(v >> 8));}
+    void u32( uint32_t v) { u16( uint16_t(v)); u16( uint16_t(v >> 16));}
+    void u64( uint64_t v) { u32( uint32_t(v)); u32( uint32_t(v >> 32));}
+    void i16( int16_t v) { u16( uint16_t(v));}
+
+    void f32( float v)
+    {
+        uint32_t u;
+        memcpy( &u, &v, 4);
+        u32(u);
+    }   // end f32
+
+    void str( const std::string& s)
+    {
+        u16( uint16_t( s.size()));
+        bytes( reinterpret_cast<const uint8_t*>( s.data()), s.size());
+    }   // end str
+
+    void bytes( const uint8_t* p, size_t n)
+    {
+        if ( _compressed)
+            for ( size_t i = 0; i < n; ++i)
+                u8( p[i]);
+        else
+        {
+            _data.insert( _data.end(), p, p + n);
+            _nbits += 8*n;
+        }   // end else
+    }   // end bytes
+
+    // Matrices are written by column.
+    void matrix( const cv::Matx44d& m)
+    {
+        for ( int j = 0; j < 4; ++j)
+            for ( int i = 0; i < 4; ++i)
+                f32( float( m(i,j)));
+    }   // end matrix
+
+    // Pad with zeros to the next multiple of four bytes (only before compressed values).
+    void align4()
+    {
+        assert( !_compressed);
+        while ( _data.size() % 4 != 0)
+            u8(0);
+    }   // end align4
+
+    // Write v in [0,range) using the static context of the given range.
+    void staticU32( uint32_t range, uint32_t v)
+    {
+        assert( v < range);
+        _compressed = true;
+        if ( range < MAX_STATIC_RANGE)
+            _symbol( v, 1, range);
+        else
+            u32(v);
+    }   // end staticU32
+
+    // Write v using the given dynamic context.
+    void dynamicU32( Histogram& h, uint32_t v)
+    {
+        _compressed = true;
+        const uint32_t s = v + 1;
+        if ( s < h.counts.size() && h.counts[s] > 0)
+        {
+            _symbol( std::accumulate( h.counts.begin(), h.counts.begin() + s, 0u), h.counts[s], h.total);
+            h.add( s);
+        }   // end if
+        else
+        {
+            _symbol( 0, h.counts[0], h.total);
+            h.add( 0);
+            u32(v);
+            h.add( s);
+        }   // end else
+    }   // end dynamicU32
+
+    // Returns the data after flushing the coder (if compressed values were written).
+    std::vector<uint8_t> finish()
+    {
+        if ( _compressed)
+            u32(0);
+        return std::move( _data);
+    }   // end finish
+
+private:
+    std::vector<uint8_t> _data;
+    size_t _nbits;
+    uint32_t _low, _high, _underflow;
+    bool _compressed;
+
+    // Bits are packed from the least significant bit of each byte.
+    void _bit( uint32_t b)
+    {
+        if ( _nbits % 8 == 0)
+            _data.push_back(0);
+        if ( b)
+            _data.back() |= uint8_t( 1 << (_nbits % 8));
+        _nbits++;
+    }   // end _bit
+
+    void _symbol( uint32_t cum, uint32_t freq, uint32_t total)
+    {
+        const uint32_t range = _high + 1 - _low;
+        _high = _low - 1 + range * (cum + freq) / total;
+        _low = _low + range * cum / total;
+
+        // Shift out matching most significant bits followed by any pending underflow bits.
+        while ( (_low & 0x8000) == (_high & 0x8000))
+        {
+            const uint32_t b = _low >> 15;
+            _bit( b);
+            for ( ; _underflow > 0; --_underflow)
+                _bit( 1 - b);
+            _low = (_low << 1) & 0xFFFF;
+            _high = ((_high << 1) & 0xFFFF) | 1;
+        }   // end while
+
+        // Expand the range about its middle while it straddles the midpoint narrowly.
+        while ( (_low & 0x4000) && !(_high & 0x4000))
+        {
+            _underflow++;
+            _low = (_low & 0x3FFF) << 1;
+            _high = ((_high & 0x3FFF) << 1) | 0x8001;
+        }   // end while
+    }   // end _symbol
+};  // end class
+
+
+void appendU32( std::vector<uint8_t>& out, uint32_t v)
+{
+    for ( int i = 0; i < 4; ++i)
+        out.push_back( uint8_t( v >> (8*i)));
+}   // end appendU32
+
+
+// Append the block of the given type with the stream's data (padded to four bytes) and no meta data.
+void appendBlock( std::vector<uint8_t>& out, uint32_t type, BitStream& bs)
+{
+    const std::vector<uint8_t> data = bs.finish();
+    appendU32( out, type);
+    appendU32( out, uint32_t( data.size()));
+    appendU32( out, 0);
+    out.insert( out.end(), data.begin(), data.end());
+    out.resize( (out.size() + 3) & ~size_t(3), 0);
+}   // end appendBlock
+
+
+// Append a modifier chain of the given type holding the given blocks.
+void appendChain( std::vector<uint8_t>& out, const std::string& name, uint32_t type, const std::vector<uint8_t>& blocks, uint32_t nblocks)
+{
+    BitStream bs;
+    bs.str( name);
+    bs.u32( type);
+    bs.u32( 0);     // No bounding sphere or box
+    bs.align4();
+    bs.u32( nblocks);
+    bs.bytes( blocks.data(), blocks.size());
+    appendBlock( out, MODIFIER_CHAIN, bs);
+}   // end appendChain
+
+
+void writeParent( BitStream& bs, const std::string& parent, const cv::Matx44d& tm)
+{
+    bs.u32( 1);
+    bs.str( parent);
+    bs.matrix( tm);
+}   // end writeParent
+
+
+void appendGroupNode( std::vector<uint8_t>& out)
+{
+    std::vector<uint8_t> blocks;
+    BitStream bs;
+    bs.str( "ModelGroup");
+    writeParent( bs, "", cv::Matx44d::eye());  // The world
+    appendBlock( blocks, GROUP_NODE, bs);
+    appendChain( out, "ModelGroup", NODE_CHAIN, blocks, 1);
+}   // end appendGroupNode
+
+
+void appendModelNode( std::vector<uint8_t>& out, const std::string& nodeName, const std::string& meshName,
+                      const std::string& shaderName, const cv::Matx44d& tm)
+{
+    std::vector<uint8_t> blocks;
+    BitStream node;
+    node.str( nodeName);
+    writeParent( node, "ModelGroup", tm);
+    node.str( meshName);
+    node.u32( 1);   // Front visible
+    appendBlock( blocks, MODEL_NODE, node);
+
+    BitStream shading;
+    shading.str( nodeName);
+    shading.u32( 1);    // Chain index
+    shading.u32( 1);    // Shades meshes
+    shading.u32( 1);    // Shader lists
+    shading.u32( 1);    // Shaders in list
+    shading.str( shaderName);
+    appendBlock( blocks, SHADING_MODIFIER, shading);
+
+    appendChain( out, nodeName, NODE_CHAIN, blocks, 2);
+}   // end appendModelNode
+
+
+void appendLight( std::vector<uint8_t>& out)
+{
+    std::vector<uint8_t> blocks;
+    BitStream node;
+    node.str( "Light1");
+    writeParent( node, "", cv::Matx44d::eye());
+    node.str( "AmbientLight1");
+    appendBlock( blocks, LIGHT_NODE, node);
+    appendChain( out, "Light1", NODE_CHAIN, blocks, 1);
+
+    BitStream res;
+    res.str( "AmbientLight1");
+    res.u32( 1);        // Enabled
+    res.u8( 0);         // Ambient
+    for ( float c : { 1.0f, 1.0f, 1.0f, 1.0f})    // Colour (and reserved)
+        res.f32( c);
+    for ( float a : { 1.0f, 0.0f, 0.0f})    // Attenuation (constant, linear, quadratic)
+        res.f32( a);
+    res.f32( 180.0f);   // Spot angle (unused)
+    res.f32( 1.0f);     // Intensity
+    appendBlock( out, LIGHT_RESOURCE, res);
+}   // end appendLight
+
+
+void appendShader( std::vector<uint8_t>& out, const std::string& name, const std::string& txName)
+{
+    const bool hasTX = !txName.empty();
+    BitStream bs;
+    bs.str( name);
+    bs.u32( 1);         // Lighting enabled
+    bs.f32( 0.0f);      // Alpha test reference
+    bs.u32( 0x617);     // Alpha test function (always)
+    bs.u32( 0x606);     // Colour blend function (alpha blend)
+    bs.u32( 1);         // Render pass flags
+    bs.u32( hasTX ? 1 : 0);     // Active texture channels
+    bs.u32( 0);         // Alpha texture channels
+    bs.str( "Material0");   // All shaders reference the same material
+    if ( hasTX)
+    {
+        bs.str( txName);
+        bs.f32( 1.0f);  // Intensity
+        bs.u8( 0);      // Blend function (multiply)
+        bs.u8( 1);      // Blend source (constant)
+        bs.f32( 1.0f);  // Blend constant
+        bs.u8( 0);      // Texture mode (use texture coordinates)
+        bs.matrix( cv::Matx44d::eye());     // Texture transform
+        bs.matrix( cv::Matx44d::eye());     // Wrap transform
+        bs.u8( 3);      // Repeat in both directions
+    }   // end if
+    appendBlock( out, LIT_TEXTURE_SHADER, bs);
+}   // end appendShader
+
+
+void appendMaterial( std::vector<uint8_t>& out)
+{
+    BitStream bs;
+    bs.str( "Material0");
+    bs.u32( 0x3F);  // All of the following are given
+    for ( float c : { 1.0f, 1.0f, 1.0f,     // Ambient
+                      1.0f, 1.0f, 1.0f,     // Diffuse
+                      0.0f, 0.0f, 0.0f,     // Specular
+                      0.0f, 0.0f, 0.0f})    // Emissive
+        bs.f32( c);
+    bs.f32( 0.0f);  // Reflectivity
+    bs.f32( 1.0f);  // Opacity
+    appendBlock( out, MATERIAL_RESOURCE, bs);
+}   // end appendMaterial
+
+
+// A mesh of the faces of a model textured by material matID (or those without a material if matID < 0).
+struct Mesh
+{
+    int model;
+    int matID;
+    int texture;    // Index of the texture used by the mesh's shader (-1 for none)
+    std::vector<int> fids;
+};  // end struct
+
+
+// Append the mesh's declaration (in a model resource chain) and its base mesh continuation.
+void encodeMesh( const ObjModel& model, const Mesh& mesh, const std::string& name, const U3DWriteOptions& opts,
+                 std::vector<uint8_t>& decl, std::vector<uint8_t>& cont)
+{
+    const bool hasTX = mesh.matID >= 0;
+    const size_t nfaces = mesh.fids.size();
+    std::unordered_map<int, uint32_t> vmap, uvmap;
+    std::vector<int> vids, uvids;
+    std::vector<uint32_t> vcorners( 3*nfaces);
+    std::vector<uint32_t> uvcorners( hasTX ? 3*nfaces : 0);
+    for ( size_t f = 0; f < nfaces; ++f)
+    {
+        const int* vidxs = model.fvidxs( mesh.fids[f]);
+        for ( int i = 0; i < 3; ++i)
+        {
+            const auto vit = vmap.insert( std::make_pair( vidxs[i], uint32_t( vids.size())));
+            if ( vit.second)
+                vids.push_back( vidxs[i]);
+            vcorners[3*f+i] = vit.first->second;
+        }   // end for
+
+        if ( hasTX)
+        {
+            const int* fuvs = model.faceUVs( mesh.fids[f]);
+            for ( int i = 0; i < 3; ++i)
+            {
+                const auto uit = uvmap.insert( std::make_pair( fuvs[i], uint32_t( uvids.size())));
+                if ( uit.second)
+                    uvids.push_back( fuvs[i]);
+                uvcorners[3*f+i] = uit.first->second;
+            }   // end for
+        }   // end if
+    }   // end for
+
+    const uint32_t npos = uint32_t( vids.size());
+    const uint32_t nuvs = uint32_t( uvids.size());
+
+    BitStream dbs;
+    dbs.str( name);
+    dbs.u32( 0);        // Chain index
+    dbs.u32( 1);        // Normals excluded
+    for ( uint32_t n : { uint32_t(nfaces), npos, 0u, 0u, 0u, nuvs, 1u})   // Faces, positions, normals, diffuse and specular colours, texture coordinates and shadings
+        dbs.u32( n);
+    dbs.u32( 0);        // Shading attributes (no vertex colours)
+    dbs.u32( hasTX ? 1 : 0);    // Texture layers
+    if ( hasTX)
+        dbs.u32( 2);    // Texture coordinate dimensions
+    dbs.u32( 0);        // Original shading ID
+    dbs.u32( npos);     // Minimum resolution
+    dbs.u32( npos);     // Final maximum resolution (the base mesh is complete)
+    for ( int i = 0; i < 3; ++i)    // Position, normal and texture coordinate quality
+        dbs.u32( MAX_QUALITY);
+    for ( int i = 0; i < 5; ++i)    // Inverse quantisation (unused without resolution updates)
+        dbs.f32( 1.0f);
+    dbs.f32( 0.9f);     // Normal crease parameter
+    dbs.f32( 0.5f);     // Normal update parameter
+    dbs.f32( 0.985f);   // Normal tolerance parameter
+    dbs.u32( 0);        // No bones
+    std::vector<uint8_t> blocks;
+    appendBlock( blocks, CLOD_MESH_DECLARATION, dbs);
+    appendChain( decl, name, MODEL_CHAIN, blocks, 1);
+
+    BitStream cbs;
+    cbs.str( name);
+    cbs.u32( 0);        // Chain index
+    for ( uint32_t n : { uint32_t(nfaces), npos, 0u, 0u, 0u, nuvs})
+        cbs.u32( n);
+
+    // Gather positions in batches to be transformed together.
+    float buf[3*RModelIO::Transform::BATCH_SIZE];
+    for ( size_t i = 0; i < vids.size(); i += RModelIO::Transform::BATCH_SIZE)
+    {
+        const size_t nb = std::min( RModelIO::Transform::BATCH_SIZE, vids.size() - i);
+        for ( size_t j = 0; j < nb; ++j)
+        {
+            const cv::Vec3f& v = model.vtx( vids[i+j]);
+            buf[3*j] = v[0];
+            buf[3*j+1] = v[1];
+            buf[3*j+2] = v[2];
+        }   // end for
+        opts.xf.apply( buf, nb, buf);
+        for ( size_t j = 0; j < 3*nb; ++j)
+            cbs.f32( buf[j]);
+    }   // end for
+
+    for ( int uvid : uvids)
+    {
+        const cv::Vec2f& uv = model.uv( mesh.matID, uvid);
+        for ( float c : { uv[0], uv[1], 0.0f, 0.0f})
+            cbs.f32( c);
+    }   // end for
+
+    Histogram shading;
+    for ( size_t f = 0; f < nfaces; ++f)
+    {
+        cbs.dynamicU32( shading, 0);
+        for ( int i = 0; i < 3; ++i)
+        {
+            cbs.staticU32( npos, vcorners[3*f+i]);
+            if ( hasTX)
+                cbs.staticU32( nuvs, uvcorners[3*f+i]);
+        }   // end for
+    }   // end for
+    appendBlock( cont, CLOD_BASE_MESH_CONTINUATION, cbs);
+}   // end encodeMesh
+
+
+// Append the texture's declaration (in a texture chain) and continuation returning false if it
+// can't be encoded. Textures are PNG at quality 100 and JPEG otherwise (PNG if having alpha).
+bool encodeTexture( const cv::Mat& tx, const std::string& name, const U3DWriteOptions& opts,
+                    std::vector<uint8_t>& decl, std::vector<uint8_t>& cont)
+{
+    const cv::Mat img = RModelIO::scaleTexture( tx, opts.maxTextureDim);
+    const int nch = img.channels();
+    if ( img.empty() || img.depth() != CV_8U || (nch != 1 && nch != 3 && nch != 4))
+        return false;
+
+    const bool png = opts.textureQuality >= 100 || nch == 4;
+    std::vector<int> params;
+    if ( !png)
+        params = { cv::IMWRITE_JPEG_QUALITY, std::max( 0, opts.textureQuality)};
+    std::vector<uchar> buf;
+    if ( !cv::imencode( png ? ".png" : ".jpg", img, buf, params))
+        return false;
+
+    const uint8_t itype = nch == 1 ? 0x10 : nch == 3 ? 0x0E : 0x0F;   // Luminance, RGB or RGBA
+    BitStream dbs;
+    dbs.str( name);
+    dbs.u32( uint32_t( img.rows));
+    dbs.u32( uint32_t( img.cols));
+    dbs.u8( itype);
+    dbs.u32( 1);    // Continuation images
+    dbs.u8( png ? 2 : nch == 1 ? 3 : 1);    // PNG, JPEG-8 or JPEG-24
+    dbs.u8( itype); // Channels of the image
+    dbs.u16( 0);    // Image data is in the continuation
+    dbs.u32( uint32_t( buf.size()));
+    std::vector<uint8_t> blocks;
+    appendBlock( blocks, TEXTURE_DECLARATION, dbs);
+    appendChain( decl, name, TEXTURE_CHAIN, blocks, 1);
+
+    BitStream cbs;
+    cbs.str( name);
+    cbs.u32( 0);    // Continuation image index
+    cbs.bytes( buf.data(), buf.size());
+    appendBlock( cont, TEXTURE_CONTINUATION, cbs);
+    return true;
+}   // end encodeTexture
+
+}   // end namespace
+
+
+bool RModelIO::writeU3D( std::ostream& os, const Scene& scene, const U3DWriteOptions& opts)
+{
+    // Each model is written as a mesh per material, followed by one for faces without a material.
+    // Each mesh has its own shader.
+    const std::vector<const ObjModel*>& models = scene.models();
+    std::vector<Mesh> meshes;
+    std::vector<int> firstMesh;     // Index of the first mesh of each model
+    std::vector<cv::Mat> textures;
+    const auto addMesh = [&]( int u, int matID, const std::vector<int>& fids)
+    {
+        if ( !fids.empty())
+            meshes.push_back( Mesh{ u, matID, matID >= 0 ? int( textures.size()) - 1 : -1, fids});
+    };  // end addMesh
+
+    for ( size_t u = 0; u < models.size(); ++u)
+    {
+        const ObjModel* model = models[u];
+        firstMesh.push_back( int( meshes.size()));
+        const IntSet& mids = model->materialIds();
+        for ( int mid : mids)
+        {
+            textures.push_back( model->texture(mid));
+            const IntSet& mfids = model->materialFaceIds(mid);
+            addMesh( int(u), mid, std::vector<int>( mfids.begin(), mfids.end()));
+        }   // end for
+
+        std::vector<int> remfids;
+        const IntSet& fids = model->faces();
+        for ( int fid : fids)
+            if ( mids.empty() || model->faceMaterialId(fid) < 0)
+                remfids.push_back( fid);
+        addMesh( int(u), -1, remfids);
+    }   // end for
+    firstMesh.push_back( int( meshes.size()));
+
+    // Meshes and textures are encoded concurrently.
+    const size_t njobs = meshes.size() + textures.size();
+    std::vector<std::vector<uint8_t> > decls( njobs), conts( njobs);
+    std::atomic<size_t> next(0);
+    std::atomic<bool> encoded(true);
+    const size_t nworkers = std::min<size_t>( njobs, std::max<unsigned>( 1, std::thread::hardware_concurrency()));
+    std::vector<std::future<void> > workers;
+    for ( size_t w = 0; w < nworkers; ++w)
+        workers.push_back( std::async( std::launch::async, [&]()
+        {
+            for ( size_t j = next++; j < njobs; j = next++)
+            {
+                if ( j < meshes.size())
+                    encodeMesh( *models[meshes[j].model], meshes[j], "Mesh" + std::to_string(j), opts, decls[j], conts[j]);
+                else
+                {
+                    const size_t t = j - meshes.size();
+                    if ( !encodeTexture( textures[t], "Texture" + std::to_string(t), opts, decls[j], conts[j]))
+                        encoded = false;
+                }   // end else
+            }   // end for
+        }));
+    for ( std::future<void>& w : workers)
+        w.get();
+    if ( !encoded)
+        return false;
+
+    // Each node places all meshes of its model. Nodes for the first instance of each mesh
+    // are named after the mesh and later instances are numbered from one.
+    std::vector<uint8_t> decl;
+    appendGroupNode( decl);
+    std::vector<int> ninst( models.size(), 0);
+    for ( const Scene::Node& node : scene.nodes())
+    {
+        const int k = ninst[node.model]++;
+        for ( int i = firstMesh[node.model]; i < firstMesh[node.model+1]; ++i)
+        {
+            const std::string mname = "Mesh" + std::to_string(i);
+            appendModelNode( decl, k > 0 ? mname + "_" + std::to_string(k) : mname, mname,
+                             "Shader" + std::to_string(i), node.tm);
+        }   // end for
+    }   // end for
+    appendLight( decl);
+
+    for ( size_t j = 0; j < meshes.size(); ++j)
+        decl.insert( decl.end(), decls[j].begin(), decls[j].end());
+    for ( size_t j = 0; j < meshes.size(); ++j)
+        appendShader( decl, "Shader" + std::to_string(j), meshes[j].texture >= 0 ? "Texture" + std::to_string( meshes[j].texture) : "");
+    appendMaterial( decl);
+    for ( size_t j = meshes.size(); j < njobs; ++j)
+        decl.insert( decl.end(), decls[j].begin(), decls[j].end());
+
+    // The header gives the size of the declarations (including the header) and of the file.
+    static const size_t HEADER_SIZE = 36;
+    uint64_t fileSize = HEADER_SIZE + decl.size();
+    for ( const std::vector<uint8_t>& c : conts)
+        fileSize += c.size();
+    BitStream hbs;
+    hbs.i16( 0);    // Major version
+    hbs.i16( 0);    // Minor version
+    hbs.u32( 0);    // Base profile
+    hbs.u32( uint32_t( HEADER_SIZE + decl.size()));
+    hbs.u64( fileSize);
+    hbs.u32( 106);  // UTF-8 strings
+    std::vector<uint8_t> header;
+    appendBlock( header, FILE_HEADER, hbs);
+    assert( header.size() == HEADER_SIZE);
+
+    os.write( reinterpret_cast<const char*>( header.data()), header.size());
+    os.write( reinterpret_cast<const char*>( decl.data()), decl.size());
+    for ( const std::vector<uint8_t>& c : conts)
+        os.write( reinterpret_cast<const char*>( c.data()), c.size());
+    return os.good();
+}   // end writeU3D
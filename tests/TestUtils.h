@@ -0,0 +1,175 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+/**
+ * Minimal support for the behaviour checks in this directory. Each check is
+ * a small executable run by ctest that reports failed CHECKs and returns
+ * nonzero if any failed.
+ */
+
+#ifndef RMODELIO_TEST_UTILS_H
+#define RMODELIO_TEST_UTILS_H
+
+#include <ObjModel.h>   // RFeatures
+#include <boost/filesystem/operations.hpp>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace RModelIOTest {
+
+inline std::atomic<int>& failures() { static std::atomic<int> n(0); return n;}   // CHECK may be used by several threads
+
+#define CHECK( cond) \
+    do { if ( !(cond)) { RModelIOTest::failures()++; \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK( " #cond ") failed" << std::endl;}} while (0)
+
+// Returns the exit code for main.
+inline int result()
+{
+    if ( failures() > 0)
+        std::cerr << failures().load() << " check(s) failed" << std::endl;
+    return failures() > 0 ? 1 : 0;
+}   // end result
+
+
+// A uniquely named empty directory removed on destruction.
+class TempDir
+{
+public:
+    TempDir() : _path( boost::filesystem::temp_directory_path() / boost::filesystem::unique_path( "rModelIO-test-%%%%-%%%%"))
+    {
+        boost::filesystem::create_directories( _path);
+    }   // end ctor
+
+    ~TempDir()
+    {
+        boost::system::error_code ec;
+        boost::filesystem::remove_all( _path, ec);
+    }   // end dtor
+
+    std::string path( const std::string& fname) const { return (_path / fname).string();}
+
+private:
+    const boost::filesystem::path _path;
+};  // end class
+
+
+inline std::string readFile( const std::string& fname)
+{
+    std::ifstream ifs( fname.c_str(), std::ios::in | std::ios::binary);
+    return std::string( std::istreambuf_iterator<char>( ifs), std::istreambuf_iterator<char>());
+}   // end readFile
+
+
+inline void writeFile( const std::string& fname, const std::string& data)
+{
+    std::ofstream ofs( fname.c_str(), std::ios::out | std::ios::binary);
+    ofs.write( data.data(), data.size());
+}   // end writeFile
+
+
+// Returns an n by n grid of squares (each two faces) offset in z. If textured, faces in the first
+// half of the rows are given texture coordinates in a single material with a small texture.
+inline RFeatures::ObjModel::Ptr makeGrid( int n, float z=0.0f, bool textured=true)
+{
+    RFeatures::ObjModel::Ptr model = RFeatures::ObjModel::create();
+    std::vector<int> vids;
+    for ( int i = 0; i <= n; ++i)
+        for ( int j = 0; j <= n; ++j)
+            vids.push_back( model->addVertex( float(i), float(j), z + 0.01f*i*j));
+
+    int mid = -1;
+    if ( textured)
+    {
+        cv::Mat tx( 8, 8, CV_8UC3, cv::Scalar( 10, 20, 30));
+        tx.at<cv::Vec3b>(3,5) = cv::Vec3b( 200, 100, 50);
+        mid = model->addMaterial( tx);
+    }   // end if
+
+    const float s = 1.0f / n;
+    for ( int i = 0; i < n; ++i)
+        for ( int j = 0; j < n; ++j)
+        {
+            const int a = vids[i*(n+1)+j];
+            const int b = vids[(i+1)*(n+1)+j];
+            const int c = vids[i*(n+1)+j+1];
+            const int d = vids[(i+1)*(n+1)+j+1];
+            const int f0 = model->addFace( a, b, c);
+            const int f1 = model->addFace( b, d, c);
+            if ( mid >= 0 && i < n/2)
+            {
+                const cv::Vec2f uv0[3] = { cv::Vec2f( i*s, j*s), cv::Vec2f( (i+1)*s, j*s), cv::Vec2f( i*s, (j+1)*s)};
+                const cv::Vec2f uv1[3] = { cv::Vec2f( (i+1)*s, j*s), cv::Vec2f( (i+1)*s, (j+1)*s), cv::Vec2f( i*s, (j+1)*s)};
+                model->setOrderedFaceUVs( mid, f0, uv0);
+                model->setOrderedFaceUVs( mid, f1, uv1);
+            }   // end if
+        }   // end for
+    return model;
+}   // end makeGrid
+
+
+// Returns a sorted description of each face of the model (its corner positions
+// and texture coordinates) for comparing models irrespective of element IDs.
+inline std::vector<std::string> faceList( const RFeatures::ObjModel& model)
+{
+    std::vector<std::string> faces;
+    const IntSet& fids = model.faces();
+    for ( int fid : fids)
+    {
+        std::ostringstream oss;
+        const int* vidxs = model.fvidxs( fid);
+        for ( int i = 0; i < 3; ++i)
+        {
+            const cv::Vec3f& v = model.vtx( vidxs[i]);
+            oss << v[0] << ' ' << v[1] << ' ' << v[2] << ' ';
+        }   // end for
+        const int mid = model.faceMaterialId( fid);
+        if ( mid >= 0)
+        {
+            const int* uvids = model.faceUVs( fid);
+            for ( int i = 0; i < 3; ++i)
+            {
+                const cv::Vec2f& uv = model.uv( mid, uvids[i]);
+                oss << uv[0] << ' ' << uv[1] << ' ';
+            }   // end for
+        }   // end if
+        faces.push_back( oss.str());
+    }   // end for
+    std::sort( faces.begin(), faces.end());
+    return faces;
+}   // end faceList
+
+
+inline bool sameTexture( const cv::Mat& a, const cv::Mat& b)
+{
+    if ( a.rows != b.rows || a.cols != b.cols || a.type() != b.type())
+        return false;
+    for ( int i = 0; i < a.rows; ++i)
+        if ( !std::equal( a.ptr(i), a.ptr(i) + a.cols * a.elemSize(), b.ptr(i)))
+            return false;
+    return true;
+}   // end sameTexture
+
+}   // end namespace
+
+#endif
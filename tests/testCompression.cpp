@@ -0,0 +1,94 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include "TestUtils.h"
+#include <Compression.h>
+#include <RMBExporter.h>
+#include <RMBImporter.h>
+#include <random>
+using RModelIO::Compression;
+using namespace RModelIOTest;
+
+
+int main()
+{
+    TempDir dir;
+
+    CHECK( RModelIO::compressionOf( "model.obj") == RModelIO::NO_COMPRESSION);
+    CHECK( RModelIO::compressionOf( "model.obj.gz") == RModelIO::GZIP);
+    CHECK( RModelIO::compressionOf( "MODEL.RMB.ZST") == RModelIO::ZSTD);
+    CHECK( RModelIO::stripCompression( "model.obj.gz") == "model.obj");
+    CHECK( RModelIO::stripCompression( "model.obj") == "model.obj");
+    CHECK( RModelIO::compressionAvailable( RModelIO::GZIP));
+
+    // Compressible text followed by incompressible bytes.
+    std::string data;
+    for ( int i = 0; i < 5000; ++i)
+        data += "v " + std::to_string(i) + " 0.5 1.25\n";
+    std::mt19937 rng( 33);
+    for ( int i = 0; i < 50000; ++i)
+        data += char( rng());
+
+    for ( Compression c : { RModelIO::NO_COMPRESSION, RModelIO::GZIP, RModelIO::ZSTD})
+    {
+        if ( !RModelIO::compressionAvailable( c))
+            continue;
+        const std::string suffix = RModelIO::compressionSuffix( c);
+        const std::string fname = dir.path( "data" + suffix);
+
+        // Stream round trip.
+        std::ostringstream oss;
+        CHECK( RModelIO::writeCompressed( oss, c, [&data]( std::ostream& os){ os << data; return true;}));
+        if ( c != RModelIO::NO_COMPRESSION)
+            CHECK( oss.str().size() < data.size());
+        writeFile( fname, oss.str());
+        std::vector<char> out;
+        CHECK( RModelIO::readCompressed( fname, c, out));
+        CHECK( std::string( out.begin(), out.end()) == data);
+
+        // Writer failures are reported.
+        std::ostringstream fss;
+        CHECK( !RModelIO::writeCompressed( fss, c, []( std::ostream&){ return false;}));
+
+        // File compression.
+        writeFile( dir.path( "src"), data);
+        const std::string cname = dir.path( "copy" + suffix);
+        CHECK( RModelIO::compressFile( dir.path( "src"), cname, c));
+        CHECK( RModelIO::readCompressed( cname, c, out));
+        CHECK( std::string( out.begin(), out.end()) == data);
+
+        // Models saved and loaded with a compression suffix.
+        const RFeatures::ObjModel::Ptr model = makeGrid( 5);
+        RModelIO::RMBExporter exporter;
+        CHECK( exporter.save( *model, dir.path( "model.rmb" + suffix)));
+        RModelIO::RMBImporter importer;
+        const RFeatures::ObjModel::Ptr loaded = importer.load( dir.path( "model.rmb" + suffix));
+        CHECK( loaded && faceList( *loaded) == faceList( *model));
+
+        if ( c != RModelIO::NO_COMPRESSION)
+        {
+            // Corrupt and missing files fail to read.
+            std::string bad = oss.str();
+            bad.resize( bad.size() / 2);
+            writeFile( fname, bad);
+            CHECK( !RModelIO::readCompressed( fname, c, out));
+            CHECK( !RModelIO::readCompressed( dir.path( "missing" + suffix), c, out));
+        }   // end if
+    }   // end for
+
+    return result();
+}   // end main
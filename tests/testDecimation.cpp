@@ -0,0 +1,84 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include "TestUtils.h"
+#include <Decimation.h>
+#include <Scene.h>
+using RModelIO::FlatMesh;
+using RModelIO::ModelArrays;
+using namespace RModelIOTest;
+
+
+int main()
+{
+    const RFeatures::ObjModel::Ptr model = makeGrid( 60);
+    const ModelArrays arrays( *model);
+    const size_t nfaces = model->numPolys();
+
+    // Simplified meshes are within the budget and keep the texture and its mapped faces.
+    for ( size_t budget : { size_t(50), size_t(500), size_t(2000), nfaces - 1})
+    {
+        const FlatMesh::Ptr mesh = RModelIO::decimate( arrays.view, budget);
+        CHECK( mesh != nullptr);
+        if ( !mesh)
+            continue;
+        CHECK( mesh->numFaces() > 0 && mesh->numFaces() <= budget);
+        CHECK( mesh->view().check().empty());
+        CHECK( mesh->numMaterials() == 1);
+        CHECK( mesh->materialSize(0) > 0 && mesh->materialSize(0) < mesh->numFaces());
+        for ( size_t i = 0; i < mesh->positions.size(); i += 3)
+            CHECK( mesh->positions[i] >= 0 && mesh->positions[i] <= 60 && mesh->positions[i+1] >= 0 && mesh->positions[i+1] <= 60);
+    }   // end for
+
+    // Meshes already within the budget are copied unchanged.
+    for ( size_t budget : { nfaces, 10*nfaces})
+    {
+        const FlatMesh::Ptr mesh = RModelIO::decimate( arrays.view, budget);
+        CHECK( mesh != nullptr);
+        if ( mesh)
+            CHECK( faceList( *mesh->toModel()) == faceList( *model));
+    }   // end for
+
+    // Two faces can't be reduced to one without collapsing both.
+    const RFeatures::ObjModel::Ptr square = RFeatures::ObjModel::create();
+    const int a = square->addVertex( 0, 0, 0);
+    const int b = square->addVertex( 1, 0, 0);
+    const int c = square->addVertex( 0, 1, 0);
+    const int d = square->addVertex( 1, 1, 0);
+    square->addFace( a, b, c);
+    square->addFace( d, b, c);
+    CHECK( RModelIO::decimate( ModelArrays( *square).view, 1) == nullptr);
+
+    // Scenes simplify unique models over the budget leaving the originals unchanged.
+    {
+        RModelIO::Scene scene;
+        std::string err;
+        CHECK( scene.build( { { model.get(), RModelIO::Transform()}, { square.get(), RModelIO::Transform()}}, RModelIO::Transform(), 1000, err));
+        CHECK( scene.models().size() == 2);
+        if ( scene.models().size() == 2)
+        {
+            CHECK( scene.models()[0] != model.get() && scene.models()[0]->numPolys() <= 1000);
+            CHECK( scene.models()[1] == square.get());
+        }   // end if
+        CHECK( size_t( model->numPolys()) == nfaces);
+
+        CHECK( !scene.build( { { square.get(), RModelIO::Transform()}}, RModelIO::Transform(), 1, err));
+        CHECK( !err.empty());
+    }
+
+    return result();
+}   // end main
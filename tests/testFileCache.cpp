@@ -0,0 +1,127 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include "TestUtils.h"
+#include <FileCache.h>
+#include <ctime>
+#include <thread>
+using RModelIO::FileCache;
+using RModelIO::FileSink;
+using namespace RModelIOTest;
+namespace bfs = boost::filesystem;
+
+namespace {
+
+FileSink::Writer bytes( size_t n, char c)
+{
+    return [n, c]( std::ostream& os){ os << std::string( n, c); return true;};
+}   // end bytes
+
+
+uint64_t cacheSize( const std::string& dir, size_t& ntmp)
+{
+    uint64_t total = 0;
+    ntmp = 0;
+    for ( bfs::directory_iterator it( dir), end; it != end; ++it)
+    {
+        if ( it->path().extension() == ".bin")
+            total += bfs::file_size( it->path());
+        else if ( it->path().extension() == ".tmp")
+            ntmp++;
+    }   // end for
+    return total;
+}   // end cacheSize
+
+}   // end namespace
+
+
+int main()
+{
+    TempDir dir;
+
+    // Hits, misses, stores and invalidations are counted separately.
+    {
+        FileCache::Ptr cache = FileCache::create( dir.path( "counts"), ".bin", 1000);
+        CHECK( cache != nullptr);
+        CHECK( cache->lookup( "a").empty());
+        CHECK( cache->insert( "a", bytes( 300, 'a')));
+        const std::string fa = cache->lookup( "a");
+        CHECK( !fa.empty() && readFile( fa) == std::string( 300, 'a'));
+
+        cache->invalidate( "a");
+        CHECK( cache->lookup( "a").empty());
+        cache->invalidate( "b");    // Never cached
+
+        CHECK( !cache->insertFile( "c", []( const std::string& f){ writeFile( f, "partial"); return false;}));
+        CHECK( cache->lookup( "c").empty());
+
+        const FileCache::Stats stats = cache->stats();
+        CHECK( stats.hits == 1);
+        CHECK( stats.misses == 3);
+        CHECK( stats.stores == 1);
+        CHECK( stats.invalidations == 2);
+        CHECK( stats.evictions == 0);
+    }
+
+    // The least recently used entries are evicted once over the size limit.
+    {
+        FileCache::Ptr cache = FileCache::create( dir.path( "lru"), ".bin", 1000);
+        CHECK( cache->insert( "old", bytes( 300, 'o')));
+        CHECK( cache->insert( "used", bytes( 300, 'u')));
+        CHECK( cache->insert( "new", bytes( 300, 'n')));
+        const std::time_t now = std::time(nullptr);
+        bfs::last_write_time( cache->directory() + "/old.bin", now - 200);
+        bfs::last_write_time( cache->directory() + "/used.bin", now - 100);
+        bfs::last_write_time( cache->directory() + "/new.bin", now - 50);
+        CHECK( !cache->lookup( "used").empty());  // Now the most recently used
+        CHECK( cache->insert( "extra", bytes( 300, 'e')));
+
+        CHECK( cache->lookup( "old").empty());
+        CHECK( !cache->lookup( "used").empty());
+        CHECK( !cache->lookup( "new").empty());
+        CHECK( !cache->lookup( "extra").empty());
+        CHECK( cache->stats().evictions == 1);
+    }
+
+    // Caches shared by threads stay within their limit and leave no temporary files.
+    {
+        const std::string cdir = dir.path( "shared");
+        std::vector<std::thread> threads;
+        for ( int t = 0; t < 8; ++t)
+            threads.push_back( std::thread( [t, &cdir]()
+            {
+                FileCache::Ptr cache = FileCache::create( cdir, ".bin", 1000);
+                for ( int i = 0; i < 20; ++i)
+                {
+                    const std::string key = std::to_string(t) + "_" + std::to_string(i);
+                    CHECK( cache->insert( key, bytes( 100, char('a' + t))));
+                    cache->lookup( key);
+                }   // end for
+                CHECK( cache->stats().stores == 20);
+            }));
+        for ( std::thread& t : threads)
+            t.join();
+
+        FileCache::Ptr cache = FileCache::create( cdir, ".bin", 1000);
+        cache->trim();
+        size_t ntmp = 0;
+        CHECK( cacheSize( cdir, ntmp) <= 1000);
+        CHECK( ntmp == 0);
+    }
+
+    return result();
+}   // end main
@@ -0,0 +1,105 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include "TestUtils.h"
+#include <FileSink.h>
+#include <boost/filesystem/operations.hpp>
+#include <sstream>
+using RModelIO::FileSink;
+using namespace RModelIOTest;
+namespace bfs = boost::filesystem;
+
+
+int main()
+{
+    TempDir dir;
+
+    // Files queued with writers are all written by the time wait returns.
+    {
+        FileSink::Ptr sink = FileSink::create( 2, 4);
+        for ( int i = 0; i < 20; ++i)
+        {
+            const std::string data( 1000 + i, char('a' + i));
+            sink->add( dir.path( "f" + std::to_string(i)), [data]( std::ostream& os){ os << data; return true;});
+        }   // end for
+        CHECK( sink->wait());
+        for ( int i = 0; i < 20; ++i)
+            CHECK( readFile( dir.path( "f" + std::to_string(i))) == std::string( 1000 + i, char('a' + i)));
+    }
+
+    // Tasks write their named files and copies duplicate existing files (replacing the target).
+    {
+        FileSink sink( 1);
+        sink.addTask( dir.path( "task"), []( const std::string& f){ writeFile( f, "task"); return true;});
+        CHECK( sink.wait());
+        CHECK( readFile( dir.path( "task")) == "task");
+
+        writeFile( dir.path( "copy"), "stale and longer than the source");
+        sink.addCopy( dir.path( "task"), dir.path( "copy"));
+        sink.addCopy( dir.path( "task"), dir.path( "link"), true);
+        CHECK( sink.wait());
+        CHECK( readFile( dir.path( "copy")) == "task");
+        CHECK( readFile( dir.path( "link")) == "task");
+    }
+
+    // Failures are reported by the next wait only.
+    {
+        FileSink sink( 1);
+        sink.add( dir.path( "bad"), []( std::ostream&){ return false;});
+        sink.add( dir.path( "nodir/file"), []( std::ostream& os){ os << "x"; return true;});
+        CHECK( !sink.wait());
+        CHECK( !sink.err().empty());
+        sink.add( dir.path( "good"), []( std::ostream& os){ os << "x"; return true;});
+        CHECK( sink.wait());
+        CHECK( sink.err().empty());
+    }
+
+    // Files can be compressed as they're written.
+    {
+        FileSink sink( 1);
+        sink.setCompression( dir.path( "model.txt"), RModelIO::GZIP);
+        sink.add( dir.path( "model.txt"), []( std::ostream& os){ os << "compressed contents"; return true;});
+        CHECK( sink.wait());
+        CHECK( !bfs::exists( dir.path( "model.txt")));
+        std::vector<char> data;
+        CHECK( RModelIO::readCompressed( dir.path( "model.txt.gz"), RModelIO::GZIP, data));
+        CHECK( std::string( data.begin(), data.end()) == "compressed contents");
+    }
+
+    // Transfers replace existing files and atomic writes leave nothing behind on failure.
+    {
+        writeFile( dir.path( "src"), "source");
+        writeFile( dir.path( "dst"), "existing destination");
+        CHECK( FileSink::transferFile( dir.path( "src"), dir.path( "dst")));
+        CHECK( readFile( dir.path( "dst")) == "source");
+        CHECK( FileSink::transferFile( dir.path( "src"), dir.path( "dst"), true));
+        CHECK( readFile( dir.path( "dst")) == "source");
+        CHECK( !FileSink::transferFile( dir.path( "missing"), dir.path( "dst2")));
+
+        CHECK( FileSink::writeAtomic( dir.path( "atomic"), []( const std::string& f){ writeFile( f, "whole"); return true;}));
+        CHECK( readFile( dir.path( "atomic")) == "whole");
+        CHECK( !FileSink::writeAtomic( dir.path( "failed"), []( const std::string& f){ writeFile( f, "part"); return false;}));
+        CHECK( !bfs::exists( dir.path( "failed")));
+        size_t ntmp = 0;
+        for ( bfs::directory_iterator it( dir.path( "")), end; it != end; ++it)
+            if ( it->path().extension() == ".tmp")
+                ntmp++;
+        CHECK( ntmp == 0);
+    }
+
+    return result();
+}   // end main
@@ -0,0 +1,132 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include "TestUtils.h"
+#include <FloatFormat.h>
+#include <OBJExporter.h>
+#include <cctype>
+#include <cfloat>
+#include <clocale>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+using RModelIO::FloatFormat;
+using namespace RModelIOTest;
+
+namespace {
+
+std::string format( const FloatFormat& ff, float v)
+{
+    char buf[FloatFormat::BUF_SIZE];
+    return std::string( buf, ff.format( buf, v));
+}   // end format
+
+
+bool sameBits( float a, float b) { return std::memcmp( &a, &b, sizeof(float)) == 0;}
+
+
+uint32_t bitsOf( float v)
+{
+    uint32_t bits;
+    std::memcpy( &bits, &v, sizeof(bits));
+    return bits;
+}   // end bitsOf
+
+}   // end namespace
+
+
+int main()
+{
+    const FloatFormat rt = FloatFormat::roundTrip();
+    CHECK( !rt.usesStream());
+    CHECK( FloatFormat::stream().usesStream());
+    CHECK( FloatFormat::significant( 20).digits() == 9);
+
+    // Shortest round trip forms of exactly representable values.
+    CHECK( format( rt, 0.5f) == "0.5");
+    CHECK( format( rt, 1.0f) == "1");
+    CHECK( format( rt, -2.25f) == "-2.25");
+    CHECK( format( rt, 0.0f) == "0");
+    CHECK( format( rt, 0.1f) == "0.1");
+
+    // Every finite value reads back exactly.
+    std::vector<float> values = { FLT_MIN, FLT_MAX, -FLT_MAX, FLT_EPSILON, 1.0f/3, 16777217.0f, 1e-30f, 123456.789f, -0.0f};
+    std::mt19937 rng( 40);
+    while ( values.size() < 100000)
+    {
+        const uint32_t bits = rng();
+        float v;
+        std::memcpy( &v, &bits, sizeof(v));
+        if ( std::isfinite(v) && std::fpclassify(v) != FP_SUBNORMAL)
+            values.push_back( v);
+    }   // end while
+    size_t failed = 0;
+    for ( float v : values)
+    {
+        const std::string s = format( rt, v);
+        if ( s.size() >= size_t( FloatFormat::BUF_SIZE) || !sameBits( std::strtof( s.c_str(), nullptr), v))
+            failed++;
+    }   // end for
+    CHECK( failed == 0);
+
+    // Significant digits.
+    CHECK( format( FloatFormat::significant(3), 1.23456f) == "1.23");
+    CHECK( format( FloatFormat::significant(1), 0.25f) == "0.2" || format( FloatFormat::significant(1), 0.25f) == "0.3");
+    CHECK( format( FloatFormat::significant(4), 1234567.0f) == "1.235e+06");
+
+    // Output doesn't depend on the global C locale.
+    if ( std::setlocale( LC_ALL, "de_DE.UTF-8") || std::setlocale( LC_ALL, "fr_FR.UTF-8"))
+    {
+        CHECK( format( rt, 0.5f) == "0.5");
+        CHECK( format( FloatFormat::significant(3), 1.23456f) == "1.23");
+        std::setlocale( LC_ALL, "C");
+    }   // end if
+
+    // Models written with the round trip format keep their vertex positions exactly.
+    {
+        TempDir dir;
+        RFeatures::ObjModel::Ptr model = RFeatures::ObjModel::create();
+        const int a = model->addVertex( 0.1f, 1.0f/3, 123456.789f);
+        const int b = model->addVertex( -FLT_MIN, 2.5f, 1e-7f);
+        const int c = model->addVertex( 7.0f, -0.0f, 1e30f);
+        model->addFace( a, b, c);
+        RModelIO::OBJExporter exporter;
+        exporter.setFloatFormat( rt);
+        CHECK( exporter.save( *model, dir.path( "model.obj")));
+        std::istringstream iss( readFile( dir.path( "model.obj")));
+        std::vector<uint32_t> read;     // Vertices may be written in any order
+        std::string line;
+        while ( std::getline( iss, line))
+        {
+            if ( line.size() < 2 || line[0] != 'v' || !std::isspace( line[1]))
+                continue;
+            std::istringstream lss( line.substr(2));
+            std::string tok;
+            while ( lss >> tok)
+                read.push_back( bitsOf( std::strtof( tok.c_str(), nullptr)));
+        }   // end while
+        std::vector<uint32_t> expected;
+        for ( float v : { 0.1f, 1.0f/3, 123456.789f, -FLT_MIN, 2.5f, 1e-7f, 7.0f, -0.0f, 1e30f})
+            expected.push_back( bitsOf(v));
+        std::sort( read.begin(), read.end());
+        std::sort( expected.begin(), expected.end());
+        CHECK( read == expected);
+    }
+
+    return result();
+}   // end main
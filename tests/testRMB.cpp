@@ -0,0 +1,203 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include "TestUtils.h"
+#include <RMBExporter.h>
+#include <RMBFormat.h>
+#include <RMBImporter.h>
+#include <cstring>
+#include <random>
+using RModelIO::RMBExporter;
+using RModelIO::RMBImporter;
+namespace RMB = RModelIO::RMB;
+using namespace RModelIOTest;
+
+namespace {
+
+RMB::Header header( const std::string& data)
+{
+    RMB::Header hdr;
+    std::memcpy( &hdr, data.data(), sizeof(hdr));
+    return hdr;
+}   // end header
+
+
+RMB::Section* findSection( std::string& data, uint32_t type)
+{
+    const RMB::Header hdr = header( data);
+    RMB::Section* secs = reinterpret_cast<RMB::Section*>( &data[hdr.tableOffset]);
+    for ( uint32_t i = 0; i < hdr.nsections; ++i)
+        if ( secs[i].type == type)
+            return &secs[i];
+    return nullptr;
+}   // end findSection
+
+
+// Write the data to a file and return whether it loads.
+bool loads( const TempDir& dir, const std::string& data)
+{
+    const std::string fname = dir.path( "corrupt.rmb");
+    writeFile( fname, data);
+    RMBImporter importer;
+    const bool loaded = importer.load( fname) != nullptr;
+    CHECK( loaded || !importer.err().empty());
+    RMBImporter flatImporter;
+    CHECK( (flatImporter.loadFlat( fname) != nullptr) == loaded);
+    return loaded;
+}   // end loads
+
+}   // end namespace
+
+
+int main()
+{
+    TempDir dir;
+    const RFeatures::ObjModel::Ptr model = makeGrid( 6);
+    const std::string fname = dir.path( "grid.rmb");
+
+    // Round trip.
+    RMBExporter exporter;
+    CHECK( exporter.save( *model, fname));
+    {
+        RMBImporter importer;
+        const RFeatures::ObjModel::Ptr loaded = importer.load( fname);
+        CHECK( loaded != nullptr);
+        if ( loaded)
+        {
+            CHECK( loaded->numVtxs() == model->numVtxs());
+            CHECK( faceList( *loaded) == faceList( *model));
+            CHECK( loaded->materialIds().size() == 1);
+            if ( loaded->materialIds().size() == 1)
+                CHECK( sameTexture( loaded->texture( *loaded->materialIds().begin()), model->texture( *model->materialIds().begin())));
+        }   // end if
+
+        const RModelIO::FlatMesh::Ptr flat = RMBImporter().loadFlat( fname);
+        CHECK( flat != nullptr);
+        if ( flat)
+        {
+            CHECK( flat->numVtxs() == size_t( model->numVtxs()));
+            CHECK( flat->numFaces() == size_t( model->numPolys()));
+        }   // end if
+
+        RMBImporter untextured( false);
+        const RFeatures::ObjModel::Ptr geom = untextured.load( fname);
+        CHECK( geom && geom->materialIds().empty() && geom->numPolys() == model->numPolys());
+    }
+
+    // The stream writer gives the same bytes as the file.
+    const std::string good = readFile( fname);
+    {
+        std::ostringstream oss;
+        CHECK( RMBExporter::write( oss, *model));
+        CHECK( oss.str() == good);
+    }
+
+    CHECK( loads( dir, good));
+
+    // Truncated files and bad headers.
+    CHECK( !loads( dir, good.substr( 0, good.size() - 8)));
+    CHECK( !loads( dir, good.substr( 0, sizeof(RMB::Header) - 1)));
+    CHECK( !loads( dir, std::string()));
+    {
+        std::string bad = good;
+        bad[0] = 'X';
+        CHECK( !loads( dir, bad));
+    }
+    {
+        std::string bad = good;
+        RMB::Header hdr = header( bad);
+        hdr.version = RMB::VERSION + 1;
+        std::memcpy( &bad[0], &hdr, sizeof(hdr));
+        CHECK( !loads( dir, bad));
+    }
+    {
+        std::string bad = good;
+        RMB::Header hdr = header( bad);
+        hdr.tableOffset = bad.size();
+        hdr.nsections = 1;
+        std::memcpy( &bad[0], &hdr, sizeof(hdr));
+        CHECK( !loads( dir, bad));
+    }
+
+    // Counts too large for the sections (including ones whose corner counts overflow 32 bits).
+    for ( uint32_t nfaces : { uint32_t( model->numPolys() + 1), 0x55555556u, 0xFFFFFFFFu})
+    {
+        std::string bad = good;
+        RMB::Header hdr = header( bad);
+        hdr.nfaces = nfaces;
+        std::memcpy( &bad[0], &hdr, sizeof(hdr));
+        CHECK( !loads( dir, bad));
+    }
+    {
+        std::string bad = good;
+        RMB::Header hdr = header( bad);
+        hdr.nvtxs = 0xFFFFFFFFu;
+        std::memcpy( &bad[0], &hdr, sizeof(hdr));
+        CHECK( !loads( dir, bad));
+    }
+
+    // Out of range indices and sections.
+    {
+        std::string bad = good;
+        const RMB::Section* s = findSection( bad, RMB::FACES);
+        CHECK( s != nullptr);
+        const uint32_t vidx = header( bad).nvtxs;
+        std::memcpy( &bad[s->offset + 4*sizeof(uint32_t)], &vidx, sizeof(vidx));
+        CHECK( !loads( dir, bad));
+    }
+    {
+        std::string bad = good;
+        const RMB::Section* s = findSection( bad, RMB::MATERIAL_FACES);
+        CHECK( s != nullptr);
+        const uint32_t fidx = header( bad).nfaces;
+        std::memcpy( &bad[s->offset], &fidx, sizeof(fidx));
+        CHECK( !loads( dir, bad));
+    }
+    {
+        std::string bad = good;
+        RMB::Section* s = findSection( bad, RMB::POSITIONS);
+        s->offset = bad.size() - RMB::ALIGNMENT;
+        CHECK( !loads( dir, bad));
+    }
+    {
+        std::string bad = good;
+        RMB::Section* s = findSection( bad, RMB::TEXTURE);
+        s->material = header( bad).nmats;
+        CHECK( !loads( dir, bad));
+    }
+    {
+        std::string bad = good;
+        const RMB::Section* s = findSection( bad, RMB::TEXTURE);
+        RMB::TextureHeader th;
+        std::memcpy( &th, &bad[s->offset], sizeof(th));
+        th.rows = 0x7FFFFFFF;
+        std::memcpy( &bad[s->offset], &th, sizeof(th));
+        CHECK( !loads( dir, bad));
+    }
+
+    // Random corruption of any byte never crashes the loader.
+    std::mt19937 rng( 31);
+    for ( int i = 0; i < 500; ++i)
+    {
+        std::string bad = good;
+        for ( int j = 0; j < 4; ++j)
+            bad[rng() % bad.size()] = char( rng());
+        loads( dir, bad);
+    }   // end for
+
+    return result();
+}   // end main
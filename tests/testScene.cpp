@@ -0,0 +1,110 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include "TestUtils.h"
+#include <Scene.h>
+#include <cmath>
+using RModelIO::Scene;
+using RModelIO::Transform;
+using namespace RModelIOTest;
+
+namespace {
+
+bool near( const cv::Matx44d& a, const cv::Matx44d& b)
+{
+    for ( int i = 0; i < 16; ++i)
+        if ( std::fabs( a.val[i] - b.val[i]) > 1e-9)
+            return false;
+    return true;
+}   // end near
+
+}   // end namespace
+
+
+int main()
+{
+    const RFeatures::ObjModel::Ptr a = makeGrid( 4);
+    const RFeatures::ObjModel::Ptr sameAsA = makeGrid( 4);           // Same content as a
+    const RFeatures::ObjModel::Ptr raised = makeGrid( 4, 1.0f);      // Different positions
+    const RFeatures::ObjModel::Ptr plain = makeGrid( 4, 0.0f, false);  // No material
+    const Transform t0 = Transform::translate( cv::Vec3d( 1, 2, 3));
+    const Transform t1 = Transform::translate( cv::Vec3d( -4, 0, 1)) * Transform::scale( 2);
+
+    // Instances of the same model or of models with the same content share a unique model.
+    {
+        Scene scene;
+        std::string err;
+        CHECK( scene.build( { { a.get(), Transform()}, { a.get(), t0}, { sameAsA.get(), t1},
+                              { raised.get(), Transform()}, { plain.get(), Transform()}}, Transform(), 0, err));
+        CHECK( scene.models().size() == 3);
+        CHECK( scene.nodes().size() == 5);
+        if ( scene.models().size() == 3 && scene.nodes().size() == 5)
+        {
+            CHECK( scene.models()[0] == a.get());
+            CHECK( scene.models()[1] == raised.get());
+            CHECK( scene.models()[2] == plain.get());
+            const int expected[5] = { 0, 0, 0, 1, 2};
+            for ( int i = 0; i < 5; ++i)
+                CHECK( scene.nodes()[i].model == expected[i]);
+            CHECK( near( scene.nodes()[0].tm, cv::Matx44d::eye()));
+            CHECK( near( scene.nodes()[1].tm, t0.matrix()));
+            CHECK( near( scene.nodes()[2].tm, t1.matrix()));
+        }   // end if
+    }
+
+    // A single model is its own unique model.
+    {
+        Scene scene;
+        std::string err;
+        CHECK( scene.build( { { plain.get(), t0}}, Transform(), 0, err));
+        CHECK( scene.models().size() == 1 && scene.models()[0] == plain.get());
+        CHECK( scene.nodes().size() == 1);
+    }
+
+    // Instance transforms T become X T X^-1 for the exporter's transform X.
+    {
+        const Transform xf = Transform::media9();   // (a,b,c) --> (a,-c,b)
+        Scene scene;
+        std::string err;
+        CHECK( scene.build( { { a.get(), Transform()}, { a.get(), t0}, { a.get(), t1}}, xf, 0, err));
+        CHECK( scene.nodes().size() == 3);
+        if ( scene.nodes().size() == 3)
+        {
+            CHECK( near( scene.nodes()[0].tm, cv::Matx44d::eye()));
+            CHECK( near( scene.nodes()[1].tm, Transform::translate( cv::Vec3d( 1, -3, 2)).matrix()));
+            CHECK( near( scene.nodes()[2].tm, (Transform::translate( cv::Vec3d( -4, -1, 0)) * Transform::scale( 2)).matrix()));
+        }   // end if
+
+        // Only instances placed other than at the identity need an invertible transform.
+        CHECK( scene.build( { { a.get(), Transform()}}, Transform::scale( 0), 0, err));
+        CHECK( !scene.build( { { a.get(), t0}}, Transform::scale( 0), 0, err));
+        CHECK( !err.empty());
+    }
+
+    // No instances or a null model are errors.
+    {
+        Scene scene;
+        std::string err;
+        CHECK( !scene.build( {}, Transform(), 0, err));
+        CHECK( !err.empty());
+        err.clear();
+        CHECK( !scene.build( { { nullptr, Transform()}}, Transform(), 0, err));
+        CHECK( !err.empty());
+    }
+
+    return result();
+}   // end main
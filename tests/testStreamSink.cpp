@@ -0,0 +1,113 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include "TestUtils.h"
+#include <GLTFExporter.h>
+#include <OBJExporter.h>
+#include <RMBExporter.h>
+#include <cstdlib>
+using RModelIO::FileSink;
+using namespace RModelIOTest;
+namespace bfs = boost::filesystem;
+
+
+int main()
+{
+    TempDir dir;
+    const RFeatures::ObjModel::Ptr model = makeGrid( 4);
+
+    // Saving to a stream gives the same bytes as saving to a file.
+    {
+        RModelIO::RMBExporter exporter;
+        CHECK( exporter.save( *model, dir.path( "model.rmb")));
+        const std::string fdata = readFile( dir.path( "model.rmb"));
+        std::ostringstream oss;
+        CHECK( exporter.save( *model, oss, "rmb"));
+        CHECK( oss.str() == fdata);
+        std::vector<char> buf;
+        CHECK( exporter.save( *model, buf, "model.rmb"));
+        CHECK( std::string( buf.begin(), buf.end()) == fdata);
+
+        // Compressed to the stream.
+        std::ostringstream zss;
+        CHECK( exporter.save( *model, zss, "model.rmb.gz"));
+        writeFile( dir.path( "stream.rmb.gz"), zss.str());
+        std::vector<char> unz;
+        CHECK( RModelIO::readCompressed( dir.path( "stream.rmb.gz"), RModelIO::GZIP, unz));
+        CHECK( std::string( unz.begin(), unz.end()) == fdata);
+    }
+
+    // Side files go to the side sink named relative to the given directory.
+    {
+        bfs::create_directories( dir.path( "obj"));
+        FileSink side( 1);
+        RModelIO::OBJExporter exporter;
+        std::ostringstream oss;
+        CHECK( exporter.save( *model, oss, dir.path( "obj/model.obj"), &side));
+        CHECK( oss.str().find( "mtllib model.mtl") != std::string::npos);
+        CHECK( !bfs::exists( dir.path( "obj/model.obj")));
+        CHECK( bfs::exists( dir.path( "obj/model.mtl")));
+        size_t nfiles = 0;
+        for ( bfs::directory_iterator it( dir.path( "obj")), end; it != end; ++it)
+            nfiles++;
+        CHECK( nfiles >= 2);    // Material file and texture
+
+        // Formats with side files fail without a side sink.
+        std::ostringstream nss;
+        CHECK( !exporter.save( *model, nss, dir.path( "obj/other.obj")));
+        CHECK( !exporter.err().empty());
+        CHECK( !bfs::exists( dir.path( "obj/other.mtl")));
+    }
+
+#ifndef _WIN32
+    // Formats written through the file sink need no temporary directory.
+    {
+        const char* tmpdir = std::getenv( "TMPDIR");
+        const std::string oldTmp = tmpdir ? tmpdir : "";
+        setenv( "TMPDIR", dir.path( "missing").c_str(), 1);
+
+        bfs::create_directories( dir.path( "notmp"));
+        FileSink side( 1);
+        RModelIO::OBJExporter objExporter;
+        std::ostringstream oss;
+        CHECK( objExporter.save( *model, oss, dir.path( "notmp/model.obj"), &side));
+        RModelIO::GLTFExporter glbExporter;
+        std::ostringstream gss;
+        CHECK( glbExporter.save( *model, gss, "model.glb"));
+        CHECK( gss.str().compare( 0, 4, "glTF") == 0);
+
+        if ( tmpdir)
+            setenv( "TMPDIR", oldTmp.c_str(), 1);
+        else
+            unsetenv( "TMPDIR");
+    }
+#endif
+
+    // Files that exporters write directly are passed on to the side sink.
+    {
+        bfs::create_directories( dir.path( "gltf"));
+        FileSink side( 1);
+        RModelIO::GLTFExporter exporter;
+        std::ostringstream oss;
+        CHECK( exporter.save( *model, oss, dir.path( "gltf/model.gltf"), &side));
+        CHECK( oss.str().find( "\"model.bin\"") != std::string::npos);
+        CHECK( bfs::exists( dir.path( "gltf/model.bin")));
+        CHECK( !bfs::exists( dir.path( "gltf/model.gltf")));
+    }
+
+    return result();
+}   // end main
@@ -0,0 +1,452 @@
+/************************************************************************
+ * Copyright (C) 2019 Richard Palmer
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ************************************************************************/
+
+#include "TestUtils.h"
+#include <U3DExporter.h>
+#include <U3DWriter.h>
+#include <cstring>
+#include <map>
+#include <numeric>
+using RModelIO::Scene;
+using RModelIO::Transform;
+using namespace RModelIOTest;
+
+namespace {
+
+// Decodes values written by the U3D bit stream (ECMA-363 ReadSymbol with a 16 bit code window).
+class Reader
+{
+public:
+    explicit Reader( const std::string& d) : _d(d), _pos(0), _low(0), _high(0xFFFF), _underflow(0) {}
+
+    uint32_t u8()
+    {
+        const uint32_t v = symbol( 256, nullptr) - 1;
+        uint32_t r = 0;
+        for ( int i = 0; i < 8; ++i)
+            r |= ((v >> i) & 1) << (7-i);
+        return r;
+    }   // end u8
+
+    uint32_t u16() { const uint32_t a = u8(); return a | (u8() << 8);}
+    uint32_t u32() { const uint32_t a = u16(); return a | (u16() << 16);}
+    uint64_t u64() { const uint64_t a = u32(); return a | (uint64_t(u32()) << 32);}
+    float f32() { const uint32_t v = u32(); float f; memcpy( &f, &v, 4); return f;}
+
+    std::string str()
+    {
+        std::string s( u16(), ' ');
+        for ( char& c : s)
+            c = char(u8());
+        return s;
+    }   // end str
+
+    cv::Vec3f translation()  // Returns the translation of a matrix (stored by column)
+    {
+        float m[16];
+        for ( float& v : m)
+            v = f32();
+        return cv::Vec3f( m[12], m[13], m[14]);
+    }   // end translation
+
+    // Value from a static context of the given range.
+    uint32_t cu32( uint32_t range)
+    {
+        if ( range >= 0x3FFF)
+            return u32();
+        return symbol( range, nullptr) - 1;
+    }   // end cu32
+
+    // Value from a dynamic context (escaping symbols not yet seen).
+    uint32_t cu32( std::vector<uint32_t>& hist)
+    {
+        const uint32_t sym = symbol( 0, &hist);
+        if ( sym != 0)
+            return sym - 1;
+        const uint32_t v = u32();
+        add( hist, v + 1);
+        return v;
+    }   // end cu32
+
+    size_t bytePos() const { return (_pos + 7) / 8;}
+    void setBytePos( size_t p) { _pos = 8*p;}
+
+private:
+    const std::string& _d;
+    size_t _pos;    // In bits
+    uint32_t _low, _high, _underflow;
+
+    uint32_t bit( size_t p) const { return (p >> 3) < _d.size() ? (uint8_t(_d[p >> 3]) >> (p & 7)) & 1 : 0;}
+
+    static void add( std::vector<uint32_t>& hist, uint32_t sym)
+    {
+        if ( sym >= 0xFFFF)
+            return;
+        if ( std::accumulate( hist.begin(), hist.end(), 0u) >= 0x1FFF)
+        {
+            for ( uint32_t& c : hist)
+                c >>= 1;
+            hist[0]++;
+        }   // end if
+        if ( hist.size() <= sym)
+            hist.resize( sym+1, 0);
+        hist[sym]++;
+    }   // end add
+
+    uint32_t symbol( uint32_t total, std::vector<uint32_t>* hist)
+    {
+        size_t p = _pos;
+        uint32_t code = bit(p);
+        p += 1 + _underflow;
+        for ( int i = 0; i < 15; ++i)
+            code = (code << 1) | bit(p++);
+
+        if ( hist)
+        {
+            if ( hist->empty())
+                hist->push_back(1);
+            total = std::accumulate( hist->begin(), hist->end(), 0u);
+        }   // end if
+        const uint64_t rng = _high + 1 - _low;
+        const uint32_t ccf = uint32_t((uint64_t(total) * (1 + code - _low) - 1) / rng);
+        uint32_t sym = ccf + 1;
+        uint32_t cum = ccf;
+        uint32_t freq = 1;
+        if ( hist)
+        {
+            cum = 0;
+            for ( sym = 0; cum + (*hist)[sym] <= ccf; ++sym)
+                cum += (*hist)[sym];
+            freq = (*hist)[sym];
+        }   // end if
+
+        uint32_t high = uint32_t(_low - 1 + rng * (cum + freq) / total);
+        uint32_t low = uint32_t(_low + rng * cum / total);
+        if ( hist)
+            add( *hist, sym);
+
+        uint32_t nbits = 0;
+        while ( (low & 0x8000) == (high & 0x8000))
+        {
+            low = (low & 0x7FFF) << 1;
+            high = ((high & 0x7FFF) << 1) | 1;
+            nbits++;
+        }   // end while
+        if ( nbits > 0)
+        {
+            nbits += _underflow;
+            _underflow = 0;
+        }   // end if
+        while ( (low & 0xC000) == 0x4000 && (high & 0xC000) == 0x8000)
+        {
+            low = (low & 0x3FFF) << 1;
+            high = ((high & 0x3FFF) << 1) | 0x8001;
+            _underflow++;
+        }   // end while
+        _low = low;
+        _high = high;
+        _pos += nbits;
+        return sym;
+    }   // end symbol
+};  // end class
+
+
+struct Block
+{
+    uint32_t type;
+    std::string data;
+};  // end struct
+
+
+// Splits the blocks in buf[off,end) checking that data and metadata are padded to four bytes.
+std::vector<Block> readBlocks( const std::string& buf, size_t off, size_t end)
+{
+    std::vector<Block> blocks;
+    while ( off + 12 <= end)
+    {
+        uint32_t h[3];
+        memcpy( h, &buf[off], 12);
+        blocks.push_back( Block{ h[0], buf.substr( off + 12, h[1])});
+        off += 12 + ((h[1] + 3) & ~3u) + ((h[2] + 3) & ~3u);
+    }   // end while
+    CHECK( off == end);
+    return blocks;
+}   // end readBlocks
+
+
+struct Mesh
+{
+    bool textured;
+    std::vector<std::string> faces;    // Described as by faceList
+};  // end struct
+
+
+struct ModelNode
+{
+    std::string name;
+    std::string mesh;
+    std::string shader;
+    cv::Vec3f translation;
+};  // end struct
+
+
+struct U3DFile
+{
+    std::map<std::string, Mesh> meshes;
+    std::vector<ModelNode> nodes;
+    std::map<std::string, std::string> shaders;   // Texture name of each shader
+};  // end struct
+
+
+void parseBlock( const Block& blk, U3DFile& file)
+{
+    Reader r( blk.data);
+    if ( blk.type == 0xFFFFFF14)    // Modifier chain
+    {
+        r.str();
+        r.u32();
+        CHECK( r.u32() == 0);       // No bounds
+        r.setBytePos( (r.bytePos() + 3) & ~size_t(3));
+        const uint32_t n = r.u32();
+        const std::vector<Block> blocks = readBlocks( blk.data, r.bytePos(), blk.data.size());
+        CHECK( blocks.size() == n);
+        for ( const Block& b : blocks)
+            parseBlock( b, file);
+    }   // end if
+    else if ( blk.type == 0xFFFFFF22)   // Model node
+    {
+        ModelNode node;
+        node.name = r.str();
+        CHECK( r.u32() == 1);
+        CHECK( r.str() == "ModelGroup");
+        node.translation = r.translation();
+        node.mesh = r.str();
+        file.nodes.push_back( node);
+    }   // end else if
+    else if ( blk.type == 0xFFFFFF45)   // Shading modifier of the preceding model node
+    {
+        CHECK( !file.nodes.empty() && r.str() == file.nodes.back().name);
+        r.u32();
+        r.u32();
+        CHECK( r.u32() == 1);
+        CHECK( r.u32() == 1);
+        file.nodes.back().shader = r.str();
+    }   // end else if
+    else if ( blk.type == 0xFFFFFF53)   // Shader
+    {
+        const std::string name = r.str();
+        r.u32();
+        r.f32();
+        r.u32();
+        r.u32();
+        r.u32();
+        const uint32_t channels = r.u32();
+        r.u32();
+        r.str();
+        file.shaders[name] = (channels & 1) ? r.str() : "";
+    }   // end else if
+    else if ( blk.type == 0xFFFFFF31)   // CLOD mesh declaration
+    {
+        const std::string name = r.str();
+        CHECK( file.meshes.count( name) == 0);
+        r.u32();
+        r.u32();
+        uint32_t counts[7];
+        for ( uint32_t& c : counts)
+            c = r.u32();
+        CHECK( counts[6] == 1);     // One shading description
+        r.u32();
+        const uint32_t nlayers = r.u32();
+        file.meshes[name].textured = nlayers > 0;
+        CHECK( counts[5] > 0 || nlayers == 0);
+    }   // end else if
+    else if ( blk.type == 0xFFFFFF3B)   // Base mesh continuation
+    {
+        const std::string name = r.str();
+        CHECK( file.meshes.count( name) == 1);
+        Mesh& mesh = file.meshes[name];
+        r.u32();
+        uint32_t counts[6];
+        for ( uint32_t& c : counts)
+            c = r.u32();
+        const uint32_t nfaces = counts[0];
+        const uint32_t npos = counts[1];
+        const uint32_t nuvs = counts[5];
+        std::vector<cv::Vec3f> pos( npos);
+        for ( cv::Vec3f& v : pos)
+            for ( int i = 0; i < 3; ++i)
+                v[i] = r.f32();
+        std::vector<cv::Vec2f> uvs( nuvs);
+        for ( cv::Vec2f& uv : uvs)
+        {
+            uv[0] = r.f32();
+            uv[1] = r.f32();
+            r.f32();
+            r.f32();
+        }   // end for
+
+        std::vector<uint32_t> shadingHist;
+        for ( uint32_t f = 0; f < nfaces; ++f)
+        {
+            CHECK( r.cu32( shadingHist) == 0);
+            uint32_t pids[3], tids[3];
+            for ( int i = 0; i < 3; ++i)
+            {
+                pids[i] = r.cu32( npos);
+                tids[i] = mesh.textured ? r.cu32( nuvs) : 0;
+                if ( pids[i] >= npos || (mesh.textured && tids[i] >= nuvs))
+                {
+                    CHECK( false);
+                    return;
+                }   // end if
+            }   // end for
+            std::ostringstream oss;
+            for ( int i = 0; i < 3; ++i)
+                oss << pos[pids[i]][0] << ' ' << pos[pids[i]][1] << ' ' << pos[pids[i]][2] << ' ';
+            if ( mesh.textured)
+                for ( int i = 0; i < 3; ++i)
+                    oss << uvs[tids[i]][0] << ' ' << uvs[tids[i]][1] << ' ';
+            mesh.faces.push_back( oss.str());
+        }   // end for
+        CHECK( r.bytePos() <= blk.data.size());
+    }   // end else if
+}   // end parseBlock
+
+
+// Parses the file checking its header and block layout.
+U3DFile parseFile( const std::string& buf)
+{
+    U3DFile file;
+    const std::vector<Block> blocks = readBlocks( buf, 0, buf.size());
+    CHECK( !blocks.empty() && blocks[0].type == 0x00443355);
+    if ( blocks.empty())
+        return file;
+    Reader r( blocks[0].data);
+    r.u16();
+    r.u16();
+    r.u32();
+    const uint32_t declSize = r.u32();
+    CHECK( r.u64() == buf.size());
+
+    // Continuations follow the declarations.
+    size_t off = 0;
+    for ( const Block& blk : blocks)
+    {
+        const bool continuation = blk.type == 0xFFFFFF3B || blk.type == 0xFFFFFF5C;
+        CHECK( continuation == (off >= declSize));
+        off += 12 + ((blk.data.size() + 3) & ~size_t(3));
+        parseBlock( blk, file);
+    }   // end for
+    return file;
+}   // end parseFile
+
+
+std::string writeScene( const std::vector<Scene::Instance>& instances)
+{
+    Scene scene;
+    std::string err;
+    CHECK( scene.build( instances, Transform(), 0, err));
+    std::ostringstream oss;
+    CHECK( RModelIO::writeU3D( oss, scene, RModelIO::U3DWriteOptions()));
+    return oss.str();
+}   // end writeScene
+
+}   // end namespace
+
+
+int main()
+{
+    // The large model's meshes (10000 faces each) exceed the dynamic histogram's count limit.
+    const RFeatures::ObjModel::Ptr a = makeGrid( 100);
+    const RFeatures::ObjModel::Ptr b = makeGrid( 3, 2.0f);
+    const RFeatures::ObjModel::Ptr c = makeGrid( 4, 1.0f, false);
+    const std::vector<Scene::Instance> instances = {
+        { a.get(), Transform()},
+        { b.get(), Transform::translate( cv::Vec3d( 5, 0, 0))},
+        { a.get(), Transform::translate( cv::Vec3d( 0, 3, 0))},
+        { c.get(), Transform()}};
+    const std::string data = writeScene( instances);
+    const U3DFile file = parseFile( data);
+
+    // A mesh per material and one for the other faces (none for c which has no material).
+    CHECK( file.meshes.size() == 5);
+    size_t textured = 0;
+    std::vector<std::string> faces;
+    for ( const auto& p : file.meshes)
+    {
+        textured += p.second.textured ? 1 : 0;
+        faces.insert( faces.end(), p.second.faces.begin(), p.second.faces.end());
+    }   // end for
+    CHECK( textured == 2);
+    CHECK( faces.size() == 2*(100*100 + 3*3 + 4*4));
+
+    // Every face of each unique model is decoded as written.
+    std::vector<std::string> expected;
+    for ( const RFeatures::ObjModel* m : { a.get(), b.get(), c.get()})
+    {
+        const std::vector<std::string> mfaces = faceList( *m);
+        expected.insert( expected.end(), mfaces.begin(), mfaces.end());
+    }   // end for
+    std::sort( faces.begin(), faces.end());
+    std::sort( expected.begin(), expected.end());
+    CHECK( faces == expected);
+
+    // A node per mesh per instance placed by the instance transform with the mesh's shader.
+    CHECK( file.nodes.size() == 2 + 2 + 2 + 1);
+    std::map<std::string, std::vector<cv::Vec3f> > placements;
+    for ( const ModelNode& node : file.nodes)
+    {
+        CHECK( file.meshes.count( node.mesh) == 1);
+        CHECK( file.shaders.count( node.shader) == 1);
+        if ( file.meshes.count( node.mesh) && file.shaders.count( node.shader))
+            CHECK( file.meshes.at( node.mesh).textured == !file.shaders.at( node.shader).empty());
+        placements[node.mesh].push_back( node.translation);
+    }   // end for
+    CHECK( placements.size() == 5);
+    size_t twice = 0;
+    for ( const auto& p : placements)
+    {
+        if ( p.second.size() == 2)  // The meshes of a
+        {
+            twice++;
+            CHECK( p.second[0] == cv::Vec3f( 0, 0, 0));
+            CHECK( p.second[1] == cv::Vec3f( 0, 3, 0));
+        }   // end if
+        else
+            CHECK( p.second.size() == 1 && (p.second[0] == cv::Vec3f( 5, 0, 0) || p.second[0] == cv::Vec3f( 0, 0, 0)));
+    }   // end for
+    CHECK( twice == 2);
+
+    // Writing is deterministic.
+    CHECK( writeScene( instances) == data);
+
+    // The native exporter can't reduce position, texture coordinate or geometry quality.
+    {
+        TempDir dir;
+        RModelIO::U3DExporter exporter;
+        exporter.setNativeWriter( true);
+        CHECK( exporter.save( *b, dir.path( "b.u3d")));
+        CHECK( parseFile( readFile( dir.path( "b.u3d"))).meshes.size() == 2);
+        RModelIO::U3DExporter::Quality q;
+        q.position = 500;
+        exporter.setQuality( q);
+        CHECK( !exporter.save( *b, dir.path( "c.u3d")));
+        CHECK( !exporter.err().empty());
+    }
+
+    return result();
+}   // end main